@@ -28,6 +28,8 @@ def main(progname, argv):
 		  print line
 		elif "* SNAPPY *" in line:
 		  print line
+		elif "compression level set on" in line:
+		  print line.split(":")[0]
 		elif "file:" in line:
 		  line = line.split("/")
 		  print line[2][:len(line[2])-1]
@@ -0,0 +1,9 @@
+#!/bin/bash
+readonly ITERATIONS=10
+readonly WORK_FACTORS="1 30 100 250"
+
+# blockSize100k sweep (levels 1-9) of streaming bzip2 for every work factor, decompression with and without --small.
+for factor in $WORK_FACTORS; do
+    ./qemukvm-benchmark --bzip2 --levels 1-9 --work-factor $factor -t $ITERATIONS --output results-bzip2.csv testdata
+    ./qemukvm-benchmark --bzip2 --levels 1-9 --work-factor $factor --small -t $ITERATIONS --output results-bzip2.csv testdata
+done
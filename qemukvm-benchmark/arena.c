@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "util.h"
+
+struct arena_chunk {
+    arena_chunk *next;
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    int backing;
+};
+
+void arena_init(arena *a)
+{
+    memset(a, 0, sizeof(*a));
+    a->backing = ARENA_HUGETLB;
+}
+
+/**
+ * @brief Maps and touches new chunk. Reserved huge pages are tried first,
+ * then regular mapping with transparent huge pages advised.
+ * @param a arena
+ * @param size minimum chunk size
+ * @return Returns chunk or NULL if something go wrong.
+ */
+static arena_chunk *map_chunk(arena *a, size_t size)
+{
+    struct timespec start_ts, stop_ts;
+    arena_chunk *chunk = (arena_chunk*)malloc(sizeof(arena_chunk));
+    void *base;
+    int backing = ARENA_HUGETLB;
+
+    if (!chunk) {
+        return NULL;
+    }
+
+    size = (size + ARENA_CHUNK_SIZE - 1) / ARENA_CHUNK_SIZE * ARENA_CHUNK_SIZE;
+
+    get_time(&start_ts);
+    base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (base == MAP_FAILED) {
+        backing = ARENA_SMALL_PAGES;
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            free(chunk);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (madvise(base, size, MADV_HUGEPAGE) == 0) {
+            backing = ARENA_THP;
+        }
+#endif
+    }
+
+    // First touch, so page faults are paid here and not in measured iterations.
+    memset(base, 0, size);
+    get_time(&stop_ts);
+
+    chunk->base = (unsigned char*)base;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->backing = backing;
+    chunk->next = a->chunks;
+    a->chunks = chunk;
+    a->mapped += size;
+    a->setup_ns += elapsed_ns(start_ts, stop_ts);
+    if (backing < a->backing) {
+        a->backing = backing;
+    }
+
+    return chunk;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+    arena_chunk *chunk = a->chunks;
+    void *ptr;
+
+    size = (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+    if (size == 0) {
+        size = BUFFER_ALIGNMENT;
+    }
+
+    // Only the newest chunk is used, the rest of older ones is left.
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = map_chunk(a, size);
+        if (!chunk) {
+            puts("Error: problem with mapping arena memory.");
+            return NULL;
+        }
+    }
+
+    ptr = chunk->base + chunk->used;
+    chunk->used += size;
+    a->used += size;
+    return ptr;
+}
+
+void arena_destroy(arena *a)
+{
+    arena_chunk *chunk = a->chunks;
+
+    while (chunk) {
+        arena_chunk *next = chunk->next;
+        munmap(chunk->base, chunk->size);
+        free(chunk);
+        chunk = next;
+    }
+
+    arena_init(a);
+}
+
+const char *arena_backing(const arena *a)
+{
+    if (!a->mapped) {
+        return "none";
+    }
+
+    switch (a->backing) {
+    case ARENA_HUGETLB:
+        return "hugetlb";
+    case ARENA_THP:
+        return "thp";
+    default:
+        return "small";
+    }
+}
+
+void print_arena(const arena *a)
+{
+    printf("Buffers: %zu bytes used, %zu bytes mapped (%s pages)\n", a->used, a->mapped, arena_backing(a));
+    printf("Allocation and first touch time: %.3f ms\n", a->setup_ns / 1e6);
+}
+
+int work_buffer_reserve(work_buffer *b, size_t size, arena *a)
+{
+    unsigned char *data;
+
+    if (b->data && b->size >= size) {
+        return 0;
+    }
+
+    if (a) {
+        data = (unsigned char*)arena_alloc(a, size);
+    } else {
+        data = alloc_aligned_buffer(size);
+    }
+    if (!data) {
+        return 1;
+    }
+
+    work_buffer_free(b);
+    b->data = data;
+    b->size = size;
+    b->owned = !a;
+    return 0;
+}
+
+void work_buffer_free(work_buffer *b)
+{
+    if (b->owned) {
+        free(b->data);
+    }
+    b->data = NULL;
+    b->size = 0;
+    b->owned = 0;
+}
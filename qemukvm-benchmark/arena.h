@@ -0,0 +1,90 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of arena chunks, which is also size of huge page on x86.
+#define ARENA_CHUNK_SIZE (2 * 1024 * 1024)
+
+// Backing of arena memory.
+enum {
+    ARENA_SMALL_PAGES,
+    ARENA_THP,          // Transparent huge pages advised (madvise(MADV_HUGEPAGE)).
+    ARENA_HUGETLB       // Reserved huge pages (MAP_HUGETLB).
+};
+
+typedef struct arena_chunk arena_chunk;
+
+/**
+ * Benchmark-scoped memory: buffers are allocated once per run from chunks mapped and touched up front,
+ * so iterations never pay for allocation and first page faults. Memory is released all at once.
+ */
+typedef struct arena {
+    arena_chunk *chunks;
+    size_t mapped;          // Total size of chunks.
+    size_t used;            // Total size of allocations.
+    int backing;            // Worst backing of chunks (ARENA_SMALL_PAGES if any chunk has small pages).
+    uint64_t setup_ns;      // Time of mapping and first touch of all chunks.
+} arena;
+
+/**
+ * Work buffer of codec. Taken from arena if one is given, otherwise allocated with malloc() and grown on demand.
+ * In both cases memory is kept between calls.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    int owned;              // Allocated with malloc() (not from arena).
+} work_buffer;
+
+/**
+ * @brief Initializes empty arena.
+ * @param a arena
+ */
+void arena_init(arena *a);
+
+/**
+ * @brief Allocates page aligned memory from arena. New chunk is mapped (huge pages if available) and touched
+ * if there is no space left.
+ * @param a arena
+ * @param size size of memory
+ * @return Returns pointer to memory or NULL if something go wrong.
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * @brief Unmaps all arena chunks.
+ * @param a arena
+ */
+void arena_destroy(arena *a);
+
+/**
+ * @brief Prints arena size, backing and setup (allocation and first touch) time.
+ * @param a arena
+ */
+void print_arena(const arena *a);
+
+/**
+ * @brief Gets name of arena backing.
+ * @param a arena
+ * @return Returns "hugetlb", "thp", "small" or "none" if nothing is mapped.
+ */
+const char *arena_backing(const arena *a);
+
+/**
+ * @brief Makes sure work buffer has at least size bytes. Contents are not preserved.
+ * @param b work buffer
+ * @param size needed size
+ * @param a arena to take memory from, NULL - malloc()
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int work_buffer_reserve(work_buffer *b, size_t size, arena *a);
+
+/**
+ * @brief Releases work buffer memory allocated with malloc() (arena memory is released with arena).
+ * @param b work buffer
+ */
+void work_buffer_free(work_buffer *b);
+
+#endif // ARENA_H
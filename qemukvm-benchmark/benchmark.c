@@ -0,0 +1,807 @@
+#include "benchmark.h"
+#include "report.h"
+#include "input.h"
+#include "arena.h"
+#include "checksum.h"
+#include "steal.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// State of benchmark iterations, shared by compression and decompression steps.
+typedef struct {
+    const codec *c;
+    void *ctx;
+    arena mem;                  // Buffers and codec work memory, allocated once per run.
+    const sink_options *sink;   // Destination of archive and output of end-to-end measurement.
+    // End-to-end measurement.
+    FILE *source;
+    FILE *archfile;
+    FILE *outputfile;
+    input_view in;              // read()/mmap() input, codec gets pointer to file content.
+    unsigned long touched;      // Sum of touched bytes of input measurement.
+    int drop_cache;             // Drop page cache of input before every compression (--drop-cache).
+    // In-memory measurement.
+    const unsigned char *source_buf;
+    unsigned char *arch;
+    unsigned char *output;
+    size_t source_len;
+    size_t arch_size;
+    size_t arch_len;
+    size_t output_len;
+    // Verification (--verify).
+    uint32_t source_crc;
+} bench_state;
+
+// Times and counters of one iteration.
+typedef struct {
+    uint64_t wall;              // Measured (BENCH_CLOCK) time in ns.
+    uint64_t cpu;               // CPU time of calling thread in ns.
+    uint64_t steal;             // Steal time in ns.
+    uint64_t counts[PERF_EVENTS];   // Counter values (--perf).
+} iteration_times;
+
+/**
+ * @brief Runs and times one iteration of step.
+ * Steal time is read outside of timed region, as reading /proc/stat is expensive.
+ * @param step step
+ * @param perf counters enabled around timed region, may be NULL
+ * @param times measured times and counters
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int timed_iteration(const bench_step *step, const perf_counters *perf, iteration_times *times)
+{
+    struct timespec start_ts, stop_ts, cpu_start_ts, cpu_stop_ts;
+    steal_sample steal_start, steal_stop;
+    int ret;
+
+    if (step->before) {
+        step->before(step->arg);
+    }
+
+    steal_read(&steal_start);
+    if (perf) {
+        perf_start(perf);
+    }
+    get_cpu_time(&cpu_start_ts);
+    get_time(&start_ts);
+    ret = step->run(step->arg);
+    get_time(&stop_ts);
+    get_cpu_time(&cpu_stop_ts);
+    if (perf) {
+        perf_stop(perf, times->counts);
+    }
+    steal_read(&steal_stop);
+
+    if (step->after) {
+        step->after(step->arg);
+    }
+
+    if (ret == CODEC_SUCCESS && step->verify) {
+        ret = step->verify(step->arg);
+    }
+
+    times->wall = elapsed_ns(start_ts, stop_ts);
+    times->cpu = elapsed_ns(cpu_start_ts, cpu_stop_ts);
+    times->steal = steal_elapsed_ns(&steal_start, &steal_stop);
+    return ret;
+}
+
+/**
+ * @brief Checks if calibration mode needs more iterations.
+ * @param options benchmark options
+ * @param count measured iterations count
+ * @param total total measured time in ns
+ * @param mean mean time in ns
+ * @param m2 sum of squared differences from the mean (Welford's algorithm)
+ * @return Returns non-zero if more iterations are needed.
+ */
+static int needs_more_iterations(bench_options options, int count, uint64_t total, double mean, double m2)
+{
+    if (count >= CALIBRATION_MAX_ITERATIONS) {
+        return 0;
+    }
+
+    if (options.time_budget > 0.0 && total / 1e6 >= options.time_budget) {
+        return 0;
+    }
+
+    // At least three samples are needed for meaningful confidence interval.
+    if (options.rel_error > 0.0 && count >= 3 && mean > 0.0) {
+        double ci95 = t_quantile95(count - 1) * sqrt(m2 / (count - 1)) / sqrt(count);
+        if (ci95 / mean * 100.0 <= options.rel_error) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int run_measurement(const bench_step *step, bench_options options, measurement *m)
+{
+    int calibration = options.time_budget > 0.0 || options.rel_error > 0.0;
+    double mean = 0.0, m2 = 0.0;
+    iteration_times times;
+    int ret;
+
+    m->cold = 0;
+    m->peak_memory = 0;
+    m->checksum = 0;
+    m->stolen = 0;
+    m->discarded = 0;
+    m->threaded = 0;
+    samples_init(&m->warm, options.iterations);
+    samples_init(&m->cpu, options.iterations);
+    samples_init(&m->steal, options.iterations);
+    perf_samples_init(&m->perf, options.perf, options.iterations);
+
+    ret = timed_iteration(step, options.perf, &times);
+    m->cold = times.wall;
+    if (ret == CODEC_SUCCESS && step->measured) {
+        step->measured(step->arg, 0);
+    }
+
+    for (int i = 0; i < options.warmup && ret == CODEC_SUCCESS; ++i) {
+        ret = timed_iteration(step, options.perf, &times);
+        if (ret == CODEC_SUCCESS && step->measured) {
+            step->measured(step->arg, 0);
+        }
+    }
+
+    for (int i = 0; ret == CODEC_SUCCESS; ) {
+        if (i >= options.iterations &&
+                (!calibration || !needs_more_iterations(options, i, m->warm.total, mean, m2))) {
+            break;
+        }
+
+        ret = timed_iteration(step, options.perf, &times);
+        if (ret == CODEC_SUCCESS) {
+            uint64_t ns = times.wall;
+            double delta = ns - mean;
+
+            // Vcpu was descheduled by host for a part of iteration, so its time isn't codec's time.
+            if (times.steal > ns * (options.max_steal / 100.0)) {
+                if (options.discard_steal && m->discarded < STEAL_DISCARD_MAX) {
+                    ++m->discarded;
+                    if (step->measured) {
+                        step->measured(step->arg, 0);
+                    }
+                    continue;
+                }
+                ++m->stolen;
+            }
+
+            if (step->measured) {
+                step->measured(step->arg, 1);
+            }
+
+            samples_add(&m->warm, ns);
+            samples_add(&m->cpu, times.cpu);
+            samples_add(&m->steal, times.steal);
+            if (options.perf) {
+                perf_samples_add(&m->perf, times.counts);
+            }
+            mean += delta / (i + 1);
+            m2 += delta * (ns - mean);
+            ++i;
+        }
+    }
+
+    return ret;
+}
+
+void measurement_free(measurement *m)
+{
+    samples_free(&m->warm);
+    samples_free(&m->cpu);
+    samples_free(&m->steal);
+    perf_samples_free(&m->perf);
+}
+
+void print_measurement(const char *label, const measurement *m, size_t bytes)
+{
+    char name[64];
+
+    printf("Cold %s time: %.3f ms\n", label, m->cold / 1e6);
+    print_time_stats(label, &m->warm, bytes);
+    if (m->peak_memory) {
+        printf("Peak %s memory of library: %.1f KB\n", label, m->peak_memory / 1024.0);
+    }
+    if (m->checksum && m->warm.total) {
+        printf("Mean %s checksum time: %.3f ms (%.1f%% of wall time, CRC32C %s)\n", label, m->checksum / 1e6,
+               m->checksum * 100.0 * m->warm.count / m->warm.total, crc32c_implementation());
+    }
+
+    snprintf(name, sizeof(name), "%s", label);
+    name[0] = toupper((unsigned char)name[0]);
+    if (m->warm.count) {
+        if (m->threaded) {
+            printf("%s CPU time: not applicable (work on other threads)", name);
+        } else {
+            printf("%s CPU time: mean %.3f ms (%.1f%% of wall time)", name, m->cpu.total / 1e6 / m->cpu.count,
+                   m->warm.total ? m->cpu.total * 100.0 / m->warm.total : 0.0);
+        }
+        printf(", steal time %.3f ms", m->steal.total / 1e6);
+        if (m->discarded) {
+            printf(", %d iterations discarded", m->discarded);
+        }
+        putchar('\n');
+    }
+    if (m->stolen) {
+        printf("Warning: %d of %d %s iterations had steal time above threshold, host was overcommitted.\n",
+               m->stolen, m->warm.count, label);
+    }
+
+    print_perf_samples(label, &m->perf);
+}
+
+/**
+ * @brief Prints benchmark stats and writes them to result file.
+ * @param c codec
+ * @param options benchmark options
+ * @param mode benchmark mode name
+ * @param source_len uncompressed data size
+ * @param arch_len compressed data size
+ * @param compression compression measurement
+ * @param decompression decompression measurement
+ * @param mem arena of run
+ */
+static void print_stats(const codec *c, bench_options options, const char *mode, size_t source_len, size_t arch_len,
+                        const measurement *compression, const measurement *decompression, const arena *mem)
+{
+    printf("Mean compression ratio: %.2f%%\n", source_len ? (arch_len / (double)source_len) * 100.0 : 0.0);
+    print_measurement("compression", compression, source_len);
+    print_measurement("decompression", decompression, source_len);
+    report_measurements(c, options, mode, source_len, arch_len, compression, decompression, mem);
+}
+
+/**
+ * @brief Fills summary of run with mean steady state times.
+ * @param result summary of run, may be NULL
+ * @param source_len input size
+ * @param arch_len archive size
+ * @param compression compression measurement
+ * @param decompression decompression measurement
+ */
+static void fill_result(bench_result *result, size_t source_len, size_t arch_len, const measurement *compression,
+                        const measurement *decompression)
+{
+    time_summary summary;
+
+    if (!result) {
+        return;
+    }
+
+    result->source_len = source_len;
+    result->arch_len = arch_len;
+    samples_summary(&compression->warm, &summary);
+    result->compression_time = summary.mean;
+    samples_summary(&decompression->warm, &summary);
+    result->decompression_time = summary.mean;
+}
+
+/**
+ * @brief Runs measurement of codec operation and gets peak memory allocated by library and checksum time
+ * in its iterations.
+ * @param step measured operation
+ * @param options benchmark options
+ * @param state benchmark state with codec and context set
+ * @param m measurement
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_codec_measurement(const bench_step *step, bench_options options, bench_state *state, measurement *m)
+{
+    int ret;
+
+    // Starts a new peak and count, previous operations are not counted.
+    if (state->c->peak_memory) {
+        state->c->peak_memory(state->ctx);
+    }
+    if (state->c->checksum_time) {
+        state->c->checksum_time(state->ctx);
+    }
+
+    ret = run_measurement(step, options, m);
+    if (state->c->peak_memory) {
+        m->peak_memory = state->c->peak_memory(state->ctx);
+    }
+    // Every iteration (cold, warm-up, discarded and measured) does the same work.
+    if (state->c->checksum_time) {
+        m->checksum = state->c->checksum_time(state->ctx) / (1 + options.warmup + m->warm.count + m->discarded);
+    }
+    return ret;
+}
+
+/**
+ * @brief Preallocates codec work memory from arena of state and prints allocation and first touch cost
+ * of all buffers of run, which is paid before measured iterations.
+ * @param state benchmark state with codec, context and source_len set
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int reserve_memory(bench_state *state)
+{
+    if (state->c->reserve && state->c->reserve(state->ctx, &state->mem, state->source_len) != CODEC_SUCCESS) {
+        printf("%s error: problem with allocating work memory.\n", state->c->name);
+        return CODEC_FAILURE;
+    }
+
+    print_arena(&state->mem);
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Flushes archive or output at the end of timed iteration.
+ * @param state benchmark state
+ * @param f archive or output file
+ * @param name "archive" or "output"
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int flush_sink(const bench_state *state, FILE *f, const char *name)
+{
+    if (sink_flush(state->sink, f) != 0) {
+        printf("Error: problem with writing %s file.\n", name);
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+// Input is read from the device in every iteration, not from page cache filled by the previous one.
+static void file_compress_before(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    if (state->drop_cache) {
+        input_drop_cache(fileno(state->source));
+    }
+}
+
+static int file_compress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    if (state->c->compress_file(state->ctx, state->source, state->archfile) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    return flush_sink(state, state->archfile, "archive");
+}
+
+static void file_compress_after(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    state->arch_len = ftell(state->archfile);
+    rewind(state->source);
+    rewind(state->archfile);
+}
+
+static int file_decompress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    if (state->c->decompress_file(state->ctx, state->archfile, state->outputfile, state->source_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    return flush_sink(state, state->outputfile, "output");
+}
+
+// Every iteration overwrites output of the previous one, so output file does not grow.
+static void file_decompress_after(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    state->output_len = ftell(state->outputfile);
+    rewind(state->archfile);
+    rewind(state->outputfile);
+}
+
+static int file_decompress_verify(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+    uint32_t crc;
+
+    if (crc32c_file(state->outputfile, 0, state->output_len, &crc) != 0) {
+        printf("%s verification error: problem with reading output file.\n", state->c->name);
+        return CODEC_FAILURE;
+    }
+
+    return verify_checksum(state->c->name, state->source_len, state->source_crc, state->output_len, crc) ?
+                CODEC_FAILURE : CODEC_SUCCESS;
+}
+
+static void memory_compress_before(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    state->arch_len = state->arch_size;
+}
+
+static void memory_decompress_before(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    state->output_len = state->source_len;
+}
+
+// Verifies output buffer of in-memory and read()/mmap() decompression.
+static int memory_decompress_verify(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+    uint32_t crc = crc32c(0, state->output, state->output_len);
+
+    return verify_checksum(state->c->name, state->source_len, state->source_crc, state->output_len, crc) ?
+                CODEC_FAILURE : CODEC_SUCCESS;
+}
+
+/**
+ * @brief Calculates CRC32C of source file for verification of decompressed data.
+ * @param state benchmark state with source file set
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int source_file_checksum(bench_state *state)
+{
+    if (crc32c_file(state->source, 0, state->source_len, &state->source_crc) != 0) {
+        puts("Error: problem with reading input file.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Prints that all decompressed outputs were verified.
+ * @param state benchmark state
+ */
+static void print_verification(const bench_state *state)
+{
+    printf("Verification: every decompressed output matches source (CRC32C %08x, %s)\n",
+           state->source_crc, crc32c_implementation());
+}
+
+static void view_input_before(void *arg)
+{
+    file_compress_before(arg);
+}
+
+static void view_compress_before(void *arg)
+{
+    file_compress_before(arg);
+    memory_compress_before(arg);
+}
+
+static int view_input_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    if (input_acquire(&state->in, fileno(state->source), state->source_len) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    state->touched += input_touch(&state->in);
+    return CODEC_SUCCESS;
+}
+
+static void view_input_after(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    input_release(&state->in);
+}
+
+static int view_compress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+    int ret;
+
+    if (input_acquire(&state->in, fileno(state->source), state->source_len) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    ret = state->c->compress(state->ctx, state->in.data, state->source_len, state->arch, &state->arch_len);
+    if (ret == CODEC_SUCCESS && fwrite(state->arch, 1, state->arch_len, state->archfile) != state->arch_len) {
+        puts("Error: problem with writing archive file.");
+        ret = CODEC_FAILURE;
+    }
+
+    return ret == CODEC_SUCCESS ? flush_sink(state, state->archfile, "archive") : ret;
+}
+
+static void view_compress_after(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    input_release(&state->in);
+    rewind(state->archfile);
+}
+
+static int view_decompress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+    int ret;
+
+    if (input_acquire(&state->in, fileno(state->archfile), state->arch_len) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    ret = state->c->decompress(state->ctx, state->in.data, state->arch_len, state->output, &state->output_len);
+    if (ret == CODEC_SUCCESS && fwrite(state->output, 1, state->output_len, state->outputfile) != state->output_len) {
+        puts("Error: problem with writing output file.");
+        ret = CODEC_FAILURE;
+    }
+
+    return ret == CODEC_SUCCESS ? flush_sink(state, state->outputfile, "output") : ret;
+}
+
+static void view_decompress_after(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    input_release(&state->in);
+    rewind(state->outputfile);
+}
+
+/**
+ * @brief Runs end-to-end benchmark with read()/mmap() input: file content is passed to codec's buffer functions,
+ * result is written with fwrite(). Time of input alone (read, or map and touch of every page) is measured too.
+ * @param state benchmark state with codec, context and files set
+ * @param options benchmark options
+ * @param result summary of run, may be NULL
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_view_benchmark(bench_state *state, bench_options options, bench_result *result)
+{
+    measurement input, compression, decompression;
+    bench_step input_step = { view_input_before, view_input_run, view_input_after, state };
+    bench_step compress_step = { view_compress_before, view_compress_run, view_compress_after, state };
+    bench_step decompress_step = { memory_decompress_before, view_decompress_run, view_decompress_after, state,
+                                   options.verify ? memory_decompress_verify : NULL };
+    const char *method = options.input == INPUT_MMAP ? "mmap" : "read";
+    char label[32];
+    int ret;
+
+    if (state->source_len == 0) {
+        puts("Error: empty input file.");
+        return CODEC_FAILURE;
+    }
+
+    state->arch_size = state->c->compress_bound(state->source_len);
+    state->arch = (unsigned char*)arena_alloc(&state->mem, state->arch_size);
+    state->output = (unsigned char*)arena_alloc(&state->mem, state->source_len);
+    state->in.method = options.input;
+    state->in.populate = options.populate;
+    state->in.advice = options.advice;
+    // The same read buffer is used for input file and archive.
+    if (options.input == INPUT_READ) {
+        state->in.buf = (unsigned char*)arena_alloc(&state->mem, state->arch_size > state->source_len ?
+                                                    state->arch_size : state->source_len);
+    }
+    if (!state->arch || !state->output || (options.input == INPUT_READ && !state->in.buf)) {
+        printf("%s error: problem with allocating memory for buffers.\n", state->c->name);
+        return CODEC_FAILURE;
+    }
+
+    if (reserve_memory(state) != CODEC_SUCCESS || (options.verify && source_file_checksum(state) != CODEC_SUCCESS)) {
+        return CODEC_FAILURE;
+    }
+
+    ret = run_measurement(&input_step, options, &input);
+    if (ret == CODEC_SUCCESS) {
+        snprintf(label, sizeof(label), "%s input", method);
+        print_measurement(label, &input, state->source_len);
+        report_input(state->c, options, method, state->source_len, &input);
+    }
+    measurement_free(&input);
+
+    if (ret == CODEC_SUCCESS) {
+        ret = run_codec_measurement(&compress_step, options, state, &compression);
+        if (ret == CODEC_SUCCESS) {
+            ret = run_codec_measurement(&decompress_step, options, state, &decompression);
+            if (ret == CODEC_SUCCESS) {
+                snprintf(label, sizeof(label), "end-to-end-%s", method);
+                print_stats(state->c, options, label, state->source_len, state->arch_len, &compression, &decompression,
+                            &state->mem);
+                fill_result(result, state->source_len, state->arch_len, &compression, &decompression);
+                if (options.verify) {
+                    print_verification(state);
+                }
+            }
+            measurement_free(&decompression);
+        }
+        measurement_free(&compression);
+    }
+
+    return ret;
+}
+
+int run_file_benchmark(const codec *c, FILE *source, const char *file_name, bench_options options,
+                       bench_result *result)
+{
+    measurement compression, decompression;
+    bench_state state;
+    bench_step compress_step = { file_compress_before, file_compress_run, file_compress_after, &state };
+    bench_step decompress_step = { NULL, file_decompress_run, file_decompress_after, &state,
+                                   options.verify ? file_decompress_verify : NULL };
+    char arch_file_name[FILENAME_MAX];
+    char output_file_name[FILENAME_MAX];
+    off_t file_size = get_file_size(source);
+    int ret;
+    int level = codec_level(c, options.level);
+
+    if (file_size < 0) {
+        puts("Error: problem with getting input file size.");
+        return CODEC_FAILURE;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.c = c;
+    state.source = source;
+    state.sink = &options.sink;
+    state.source_len = file_size;
+    state.drop_cache = options.drop_cache;
+
+    if (options.drop_cache && input_drop_cache(fileno(source)) != 0) {
+        puts("Error: problem with dropping page cache of input file.");
+        return CODEC_FAILURE;
+    }
+
+    if (make_file_names(file_name, c->extension, arch_file_name, output_file_name) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    // Memory sink buffers come from arena, so their pages are touched before the first iteration.
+    arena_init(&state.mem);
+    state.archfile = sink_open(&options.sink, arch_file_name, c->compress_bound(state.source_len), 0, &state.mem);
+    if (!state.archfile) {
+        puts("Error: problem with opening archive file.");
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    state.outputfile = sink_open(&options.sink, output_file_name, state.source_len, 1, &state.mem);
+    if (!state.outputfile) {
+        puts("Error: problem with opening output file.");
+        fclose(state.archfile);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&state.ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        fclose(state.archfile);
+        fclose(state.outputfile);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: compression level set on %d\n", c->name, level);
+
+    if (options.input != INPUT_STDIO) {
+        ret = run_view_benchmark(&state, options, result);
+        c->teardown(state.ctx);
+        fclose(state.archfile);
+        fclose(state.outputfile);
+        arena_destroy(&state.mem);
+        return ret;
+    }
+
+    ret = reserve_memory(&state);
+    if (ret == CODEC_SUCCESS && options.verify) {
+        ret = source_file_checksum(&state);
+    }
+    if (ret != CODEC_SUCCESS) {
+        c->teardown(state.ctx);
+        fclose(state.archfile);
+        fclose(state.outputfile);
+        arena_destroy(&state.mem);
+        return ret;
+    }
+
+    ret = run_codec_measurement(&compress_step, options, &state, &compression);
+    if (ret == CODEC_SUCCESS) {
+        ret = run_codec_measurement(&decompress_step, options, &state, &decompression);
+        if (ret == CODEC_SUCCESS) {
+            print_stats(c, options, "end-to-end", state.source_len, state.arch_len, &compression, &decompression,
+                        &state.mem);
+            fill_result(result, state.source_len, state.arch_len, &compression, &decompression);
+            if (options.verify) {
+                print_verification(&state);
+            }
+        }
+        measurement_free(&decompression);
+    }
+    measurement_free(&compression);
+
+    c->teardown(state.ctx);
+    fclose(state.archfile);
+    fclose(state.outputfile);
+    arena_destroy(&state.mem);
+    return ret;
+}
+
+static int memory_compress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    return state->c->compress(state->ctx, state->source_buf, state->source_len, state->arch, &state->arch_len);
+}
+
+static int memory_decompress_run(void *arg)
+{
+    bench_state *state = (bench_state*)arg;
+
+    if (state->c->decompress(state->ctx, state->arch, state->arch_len, state->output, &state->output_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    if (state->output_len != state->source_len) {
+        printf("%s decompression error: decompressed data size mismatch.\n", state->c->name);
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+int run_in_memory_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options,
+                            bench_result *result)
+{
+    measurement compression, decompression;
+    bench_state state;
+    bench_step compress_step = { memory_compress_before, memory_compress_run, NULL, &state };
+    bench_step decompress_step = { memory_decompress_before, memory_decompress_run, NULL, &state,
+                                   options.verify ? memory_decompress_verify : NULL };
+    int ret;
+    int level = codec_level(c, options.level);
+
+    memset(&state, 0, sizeof(state));
+    state.c = c;
+    state.source_buf = source;
+    state.source_len = source_len;
+    state.arch_size = c->compress_bound(source_len);
+    if (options.verify) {
+        state.source_crc = crc32c(0, source, source_len);
+    }
+
+    arena_init(&state.mem);
+    state.arch = (unsigned char*)arena_alloc(&state.mem, state.arch_size);
+    state.output = (unsigned char*)arena_alloc(&state.mem, source_len);
+    if (!state.arch || !state.output) {
+        printf("%s error: problem with allocating memory for buffers.\n", c->name);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&state.ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: in-memory mode, compression level set on %d\n", c->name, level);
+    if (reserve_memory(&state) != CODEC_SUCCESS) {
+        c->teardown(state.ctx);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    ret = run_codec_measurement(&compress_step, options, &state, &compression);
+    if (ret == CODEC_SUCCESS) {
+        ret = run_codec_measurement(&decompress_step, options, &state, &decompression);
+        if (ret == CODEC_SUCCESS) {
+            print_stats(c, options, "in-memory", source_len, state.arch_len, &compression, &decompression,
+                        &state.mem);
+            fill_result(result, source_len, state.arch_len, &compression, &decompression);
+            if (options.verify) {
+                print_verification(&state);
+            }
+        }
+        measurement_free(&decompression);
+    }
+    measurement_free(&compression);
+
+    c->teardown(state.ctx);
+    arena_destroy(&state.mem);
+    return ret;
+}
@@ -0,0 +1,112 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "codec.h"
+#include "stats.h"
+#include "util.h"
+
+// Upper limit of measured iterations in calibration mode.
+#define CALIBRATION_MAX_ITERATIONS 100000
+
+// Upper limit of iterations discarded for steal time in one measurement, later ones are only flagged.
+#define STEAL_DISCARD_MAX 1000
+
+/**
+ * One step of benchmark, e.g. compression of input.
+ * Only run is inside timed region.
+ */
+typedef struct {
+    void (*before)(void *arg);  // Preparation of iteration, may be NULL.
+    int (*run)(void *arg);      // Measured operation, returns CODEC_SUCCESS or CODEC_FAILURE.
+    void (*after)(void *arg);   // Clean-up after iteration (e.g. rewinding files), may be NULL.
+    void *arg;
+    int (*verify)(void *arg);   // Check of iteration result (--verify) after clean-up, may be NULL.
+    void (*measured)(void *arg, int kept);  // Called after every successful iteration with kept 1 if it is
+                                            // measured, 0 if it is cold, warm-up or discarded, may be NULL.
+} bench_step;
+
+/**
+ * Result of measurement. The first iteration pays for cold caches, page faults and
+ * (under TCG) translation of codec code, so it is reported separately from steady state.
+ */
+typedef struct {
+    uint64_t cold;          // Time of the first iteration in ns.
+    time_samples warm;      // Times of measured iterations after warm-up.
+    time_samples cpu;       // CPU time of calling thread in measured iterations.
+    int threaded;           // Non-zero if step runs on other threads too, so CPU time of calling thread
+                            // doesn't apply (set by caller after measurement).
+    time_samples steal;     // Steal time in measured iterations.
+    int stolen;             // Measured iterations flagged with steal time above options.max_steal.
+    int discarded;          // Iterations discarded for steal time and repeated (options.discard_steal).
+    perf_samples perf;      // Counters of measured iterations (--perf).
+    size_t peak_memory;     // Peak memory allocated by codec library in all iterations, 0 - not tracked.
+    uint64_t checksum;      // Mean checksum time of codec per iteration in ns, 0 - not measured.
+} measurement;
+
+/**
+ * Summary of one benchmark run, used for aggregation over corpus and level sweeps.
+ */
+typedef struct {
+    size_t source_len;
+    size_t arch_len;
+    double compression_time;    // Mean steady state times in ms.
+    double decompression_time;
+} bench_result;
+
+/**
+ * @brief Runs measurement of step: one cold iteration, options.warmup discarded iterations and
+ * options.iterations measured ones. Measured iterations with steal time above options.max_steal percent
+ * of their time are flagged, or with options.discard_steal discarded and repeated. In calibration mode (options.time_budget or options.rel_error set)
+ * options.iterations is the minimum and iterations continue until total measured time reaches time budget
+ * or relative error of the mean (95% CI half-width / mean) drops below threshold.
+ * @param step measured step
+ * @param options benchmark options
+ * @param m measurement result (release with measurement_free())
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_measurement(const bench_step *step, bench_options options, measurement *m);
+
+/**
+ * @brief Releases measurement.
+ * @param m measurement
+ */
+void measurement_free(measurement *m);
+
+/**
+ * @brief Prints cold and warm (steady state) stats of measurement and its counters.
+ * @param label name of measurement, e.g. "compression"
+ * @param m measurement
+ * @param bytes amount of data processed in one iteration
+ */
+void print_measurement(const char *label, const measurement *m, size_t bytes);
+
+/**
+ * @brief Runs end-to-end (file to file) benchmark of codec.
+ * Archive is written to <file_name><extension>, decompressed data to <file_name><extension>_dec.
+ * @param c codec
+ * @param source input file
+ * @param file_name input file name
+ * @param options benchmark options
+ * @param result summary of run, may be NULL
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_file_benchmark(const codec *c, FILE *source, const char *file_name, bench_options options,
+                       bench_result *result);
+
+/**
+ * @brief Runs codec-only benchmark. Data is compressed buffer-to-buffer,
+ * no file I/O is done inside the timed region.
+ * @param c codec
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param options benchmark options
+ * @param result summary of run, may be NULL
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_in_memory_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options,
+                            bench_result *result);
+
+#endif // BENCHMARK_H
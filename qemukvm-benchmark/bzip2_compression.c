@@ -1,176 +1,439 @@
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <bzlib.h>
 #include "bzip2_compression.h"
 #include "util.h"
+#include "arena.h"
+
+// Library blocks kept by context: stream state and block sorting arrays of compression (4 blocks),
+// stream state and block tables of decompression (up to 3 blocks).
+#define BZIP2_BLOCKS 8
+
+// Memory block of library, kept between streams.
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    int used;               // Taken by stream at the moment.
+    int owned;              // Allocated with malloc() (not from arena).
+} bzip2_block;
+
+typedef struct {
+    int level;              // blockSize100k: 1 to 9.
+    int work_factor;        // 0 - library default (30).
+    int small;              // Decompression with less memory (--small).
+    size_t chunk_size;      // Size of streaming buffers.
+    work_buffer in;         // Streaming input and output buffers (chunk_size bytes each).
+    work_buffer out;
+    bzip2_block blocks[BZIP2_BLOCKS];
+    arena *mem;             // Arena for new library blocks while reserving, NULL - malloc().
+    size_t allocated;       // Memory allocated by library at the moment.
+    size_t peak;            // Peak of allocated since the last bzip2_peak_memory().
+} bzip2_context;
 
-static float mean_compression_time;
-static float mean_compression_ratio;
-static float mean_decompression_time;
+/**
+ * Library allocations are served from blocks of context: a freed block is kept and given to the next request
+ * of the same size, so BZ2_bzCompressInit()/BZ2_bzDecompressInit() of every call (library has no stream reset)
+ * neither allocate nor fault in memory after the first call or bzip2_reserve().
+ */
+static void *bzip2_alloc(void *opaque, int items, int size)
+{
+    bzip2_context *context = (bzip2_context*)opaque;
+    size_t len = (size_t)items * size;
+    bzip2_block *block = NULL;
+    unsigned char *data;
+
+    for (int i = 0; i < BZIP2_BLOCKS; ++i) {
+        bzip2_block *b = &context->blocks[i];
+        if (!b->used && b->data && b->size == len) {
+            block = b;
+            break;
+        }
+        if (!b->used && (!block || !b->data)) {
+            block = b;
+        }
+    }
+    if (!block) {
+        return NULL;
+    }
+
+    if (!block->data || block->size != len) {
+        data = context->mem ? (unsigned char*)arena_alloc(context->mem, len) : (unsigned char*)malloc(len);
+        if (!data) {
+            return NULL;
+        }
+        if (block->owned) {
+            free(block->data);
+        }
+        block->data = data;
+        block->size = len;
+        block->owned = !context->mem;
+    }
+
+    block->used = 1;
+    context->allocated += len;
+    if (context->allocated > context->peak) {
+        context->peak = context->allocated;
+    }
+    return block->data;
+}
+
+static void bzip2_free(void *opaque, void *address)
+{
+    bzip2_context *context = (bzip2_context*)opaque;
+
+    for (int i = 0; i < BZIP2_BLOCKS; ++i) {
+        bzip2_block *b = &context->blocks[i];
+        if (b->used && b->data == address) {
+            b->used = 0;
+            context->allocated -= b->size;
+            return;
+        }
+    }
+}
 
 /**
- * @brief Compresses source file to archive file. Measures compression stats. Function saves source data size.
- * @param source source file
- * @param arch archive file
- * @param level compression level
- * @param source_len source data size
- * @return Returns BZIP2_SUCCESS on success or BZIP2_FAILURE if something go wrong.
+ * @brief Prepares stream, which allocates its memory through context (to track peak memory).
+ * @param context bzip2 context
+ * @param stream stream to initialize
  */
-static int compress(FILE *source, FILE *arch, int level, unsigned int *source_len)
+static void stream_init(bzip2_context *context, bz_stream *stream)
 {
-    char *buf;
-    char *output;
-    int buf_size;
-    unsigned int output_size;
-    int bz_error;
-    struct timespec start_ts, stop_ts;
+    memset(stream, 0, sizeof(*stream));
+    stream->bzalloc = bzip2_alloc;
+    stream->bzfree = bzip2_free;
+    stream->opaque = context;
+}
+
+/**
+ * @brief Gets next part of buffer for stream, whose counters are 32-bit.
+ * @param left bytes left in buffer
+ * @return Returns size of part.
+ */
+static unsigned int next_part(size_t *left)
+{
+    unsigned int part = *left > UINT_MAX ? UINT_MAX : (unsigned int)*left;
 
-    buf_size = get_file_size(source);
-    *source_len = buf_size; // Save input size.
+    *left -= part;
+    return part;
+}
+
+/**
+ * @brief Gets total output size of stream.
+ */
+static size_t total_out(const bz_stream *stream)
+{
+    return ((size_t)stream->total_out_hi32 << 32) | stream->total_out_lo32;
+}
 
-    buf = (char*)malloc(sizeof(char) * buf_size);
-    if (!buf) {
-        puts("bzip2 compression error: problem with allocating memory for buffer.");
-        return BZIP2_FAILURE;
+static int bzip2_init(void **ctx, int level, const codec_params *params)
+{
+    bzip2_context *context = (bzip2_context*)calloc(1, sizeof(bzip2_context));
+    if (!context) {
+        return CODEC_FAILURE;
     }
 
+    context->level = level;
+    context->work_factor = params ? params->work_factor : 0;
+    context->small = params ? params->small : 0;
+    context->chunk_size = params && params->chunk_size ? params->chunk_size : CHUNK;
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t bzip2_compress_bound(size_t source_len)
+{
     // To guarantee that the compressed data will fit in its buffer,
     // allocate an output buffer of size 1% larger than the uncompressed data, plus six hundred extra bytes.
-    output_size = buf_size + (1/100 * buf_size) + 600;
-    output = (char*)malloc(sizeof(char) * output_size);
-
-    if (!output) {
-        puts("bzip2 compression error: problem with allocating memory for archive buffer.");
-        if (buf) {
-            free(buf);
-            buf = NULL;
+    return source_len + source_len / 100 + 600;
+}
+
+static int bzip2_compress(void *ctx, const unsigned char *source, size_t source_len,
+                          unsigned char *dest, size_t *dest_len)
+{
+    bzip2_context *context = (bzip2_context*)ctx;
+    bz_stream stream;
+    size_t in_left = source_len;
+    size_t out_left = *dest_len;
+    int ret;
+
+    stream_init(context, &stream);
+    if (BZ2_bzCompressInit(&stream, context->level, 0, context->work_factor) != BZ_OK) {
+        puts("bzip2 error: problem with compression initialization.");
+        return CODEC_FAILURE;
+    }
+
+    stream.next_in = (char*)source;
+    stream.next_out = (char*)dest;
+    do {
+        if (!stream.avail_in) {
+            stream.avail_in = next_part(&in_left);
+        }
+        if (!stream.avail_out) {
+            stream.avail_out = next_part(&out_left);
         }
+        ret = BZ2_bzCompress(&stream, stream.avail_in || in_left ? BZ_RUN : BZ_FINISH);
+    } while ((ret == BZ_RUN_OK || ret == BZ_FINISH_OK) && (stream.avail_out || out_left));
 
-        return BZIP2_FAILURE;
+    *dest_len = total_out(&stream);
+    BZ2_bzCompressEnd(&stream);
+    if (ret != BZ_STREAM_END) {
+        puts("bzip2 error: problems with compression.");
+        return CODEC_FAILURE;
     }
 
-    // Start measure time.
-    clock_gettime(CLOCK_REALTIME, &start_ts);
+    return CODEC_SUCCESS;
+}
 
-    fread(buf, 1, buf_size, source);
+static int bzip2_decompress(void *ctx, const unsigned char *source, size_t source_len,
+                            unsigned char *dest, size_t *dest_len)
+{
+    bzip2_context *context = (bzip2_context*)ctx;
+    bz_stream stream;
+    size_t in_left = source_len;
+    size_t out_left = *dest_len;
+    int ret;
+
+    stream_init(context, &stream);
+    if (BZ2_bzDecompressInit(&stream, 0, context->small) != BZ_OK) {
+        puts("bzip2 decompression error: problem with decompression initialization.");
+        return CODEC_FAILURE;
+    }
 
-    bz_error = BZ2_bzBuffToBuffCompress(output, &output_size, buf, buf_size, level, 0, 0);
+    stream.next_in = (char*)source;
+    stream.next_out = (char*)dest;
+    do {
+        if (!stream.avail_in) {
+            stream.avail_in = next_part(&in_left);
+        }
+        if (!stream.avail_out) {
+            stream.avail_out = next_part(&out_left);
+        }
+        ret = BZ2_bzDecompress(&stream);
+        // Stops on truncated input (nothing left to read, output not full) and on full output.
+    } while (ret == BZ_OK && (stream.avail_in || in_left || !stream.avail_out) && (stream.avail_out || out_left));
 
-    if (bz_error != BZ_OK) {
-        puts("bzip2 error: problems with compression.");
-        return BZIP2_FAILURE;
+    *dest_len = total_out(&stream);
+    BZ2_bzDecompressEnd(&stream);
+    if (ret != BZ_STREAM_END) {
+        puts("bzip2 decompression error: problems with decompression.");
+        return CODEC_FAILURE;
     }
 
-    fwrite(output, 1, output_size, arch);
+    return CODEC_SUCCESS;
+}
 
-    // Print/measure stats.
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_compression_time += result_ts.tv_nsec / 1000000.0f;
-    mean_compression_ratio += (output_size / (float)buf_size) * 100.0f;
+/**
+ * @brief Gets streaming buffers of context, allocated on first use.
+ * @param context bzip2 context
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if memory could not be allocated.
+ */
+static int streaming_buffers(bzip2_context *context)
+{
+    if (work_buffer_reserve(&context->in, context->chunk_size, NULL) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, NULL) != 0) {
+        return CODEC_FAILURE;
+    }
 
-    return BZIP2_SUCCESS;
+    return CODEC_SUCCESS;
 }
 
 /**
- * @brief Decompresses archive file and measures decompression stats.
+ * @brief Compresses source file to archive file, chunk by chunk, so memory use doesn't depend on file size.
+ * @param ctx codec context
+ * @param source source file
  * @param arch archive file
- * @param output_file output, decompressed file
- * @param source_len source (uncompressed) data size. It is calculated in compress function.
- * @return Returns BZIP2_SUCCESS on success or BZIP2_FAILURE if something go wrong.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
  */
-static int decompress(FILE *arch, FILE *output_file, unsigned int source_len)
+static int bzip2_compress_file(void *ctx, FILE *source, FILE *arch)
 {
-    int bz_error;
-    struct timespec start_ts, stop_ts;
-    int arch_size = get_file_size(arch);
-    char *input = (char*)malloc(sizeof(char) * arch_size);
-    char *output = (char*)malloc(sizeof(char) * source_len);
-
-    if (!input) {
-        puts("bzip2 error: problem with allocating input buffer.");
-        if (output) {
-            free(output);
-            output = NULL;
-            return BZIP2_FAILURE;
-        }
+    bzip2_context *context = (bzip2_context*)ctx;
+    size_t chunk = context->chunk_size;
+    bz_stream stream;
+    unsigned int have;
+    int action, ret;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS) {
+        puts("bzip2 compression error: problem with allocating memory for buffers.");
+        return CODEC_FAILURE;
     }
 
-    if (!output) {
-        puts("bzip2 error: problem with allocating output buffer.");
-        if (input) {
-            free(input);
-            input = NULL;
-            return BZIP2_FAILURE;
-        }
+    stream_init(context, &stream);
+    if (BZ2_bzCompressInit(&stream, context->level, 0, context->work_factor) != BZ_OK) {
+        puts("bzip2 error: problem with compression initialization.");
+        return CODEC_FAILURE;
     }
 
-    // Start measure time.
-    clock_gettime(CLOCK_REALTIME, &start_ts);
-    fread(input, 1, arch_size, arch);
-    bz_error = BZ2_bzBuffToBuffDecompress(output, &source_len, input, arch_size, 0, 0);
+    do {
+        stream.avail_in = fread(context->in.data, 1, chunk, source);
+        if (ferror(source)) {
+            puts("bzip2 compression error: problem with reading input file.");
+            BZ2_bzCompressEnd(&stream);
+            return CODEC_FAILURE;
+        }
+        action = feof(source) ? BZ_FINISH : BZ_RUN;
+        stream.next_in = (char*)context->in.data;
+
+        // Run compression until whole chunk is consumed (until the end of stream for the last one).
+        do {
+            stream.avail_out = chunk;
+            stream.next_out = (char*)context->out.data;
+            ret = BZ2_bzCompress(&stream, action);
+            if (ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END) {
+                puts("bzip2 error: problems with compression.");
+                BZ2_bzCompressEnd(&stream);
+                return CODEC_FAILURE;
+            }
+
+            have = chunk - stream.avail_out;
+            if (fwrite(context->out.data, 1, have, arch) != have || ferror(arch)) {
+                puts("bzip2 compression error: problem with writing to archive file");
+                BZ2_bzCompressEnd(&stream);
+                return CODEC_FAILURE;
+            }
+        } while (action == BZ_FINISH ? ret != BZ_STREAM_END : stream.avail_in != 0);
+
+    } while (action != BZ_FINISH);
+
+    BZ2_bzCompressEnd(&stream);
+    return CODEC_SUCCESS;
+}
 
-    if (bz_error != BZ_OK) {
-        puts("bzip2 decompression error: problems with decompression.");
-        return BZIP2_FAILURE;
+/**
+ * @brief Decompresses archive file to output file, chunk by chunk.
+ * @param ctx codec context
+ * @param arch archive file
+ * @param output_file output, decompressed file
+ * @param source_len source (uncompressed) data size.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int bzip2_decompress_file(void *ctx, FILE *arch, FILE *output_file, size_t source_len)
+{
+    bzip2_context *context = (bzip2_context*)ctx;
+    size_t chunk = context->chunk_size;
+    bz_stream stream;
+    unsigned int have;
+    int ret = BZ_OK;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS) {
+        puts("bzip2 error: problem with allocating buffers.");
+        return CODEC_FAILURE;
     }
 
-    if (fwrite(output, 1, source_len, output_file) != source_len || ferror(output_file)) {
-        puts("bzip2 decompression error: problem with writing to output file");
-        return BZIP2_FAILURE;
+    stream_init(context, &stream);
+    if (BZ2_bzDecompressInit(&stream, 0, context->small) != BZ_OK) {
+        puts("bzip2 decompression error: problem with decompression initialization.");
+        return CODEC_FAILURE;
     }
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
 
-    if (input) {
-        free(input);
-        input = NULL;
-    }
-    if (output) {
-        free(output);
-        output = NULL;
+    do {
+        stream.avail_in = fread(context->in.data, 1, chunk, arch);
+        if (ferror(arch)) {
+            puts("bzip2 decompression error: problem with reading archive file.");
+            BZ2_bzDecompressEnd(&stream);
+            return CODEC_FAILURE;
+        }
+        if (stream.avail_in == 0) {
+            break;
+        }
+        stream.next_in = (char*)context->in.data;
+
+        // Run decompression until output buffer is not full.
+        do {
+            stream.avail_out = chunk;
+            stream.next_out = (char*)context->out.data;
+            ret = BZ2_bzDecompress(&stream);
+            if (ret != BZ_OK && ret != BZ_STREAM_END) {
+                puts("bzip2 decompression error: problems with decompression.");
+                BZ2_bzDecompressEnd(&stream);
+                return CODEC_FAILURE;
+            }
+
+            have = chunk - stream.avail_out;
+            if (fwrite(context->out.data, 1, have, output_file) != have || ferror(output_file)) {
+                puts("bzip2 decompression error: problem with writing to output file");
+                BZ2_bzDecompressEnd(&stream);
+                return CODEC_FAILURE;
+            }
+        } while (stream.avail_out == 0 && ret != BZ_STREAM_END);
+
+    } while (ret != BZ_STREAM_END);
+
+    BZ2_bzDecompressEnd(&stream);
+    if (ret != BZ_STREAM_END || total_out(&stream) != source_len) {
+        puts("bzip2 decompression error: archive is truncated.");
+        return CODEC_FAILURE;
     }
 
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_decompression_time += result_ts.tv_nsec / 1000000.0f;
-
-    return BZIP2_SUCCESS;
+    return CODEC_SUCCESS;
 }
 
-int run_bzip2(FILE *source, FILE *arch, FILE *output, int compression_level, int iterations)
+static int bzip2_reserve(void *ctx, arena *a, size_t source_len)
 {
-    unsigned int source_len;
-    int level, ret;
-    if (compression_level == LOW_COMPRESSION) {
-        level = 1;
-    } else {
-        level = 9;
-    }
+    bzip2_context *context = (bzip2_context*)ctx;
 
-    printf("bzip2: compression level set on %d\n", level);
+    const unsigned char probe = 0;
+    size_t arch_len, probe_len = 1;
+    int ret;
 
-    for (int i = 0; i < iterations; ++i) {
-        ret = compress(source, arch, level, &source_len);
-        if (ret == BZIP2_FAILURE) {
-            return ret;
-        }
+    // File functions stream through two chunks, whatever the file size.
+    if (work_buffer_reserve(&context->in, context->chunk_size, a) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, a) != 0) {
+        return CODEC_FAILURE;
+    }
 
-        rewind(source);
-        rewind(arch);
+    // Round trip of one byte takes library blocks of both directions from arena, at the same sizes as any data.
+    context->mem = a;
+    arch_len = context->chunk_size;
+    ret = bzip2_compress(context, &probe, 1, context->out.data, &arch_len);
+    if (ret == CODEC_SUCCESS) {
+        ret = bzip2_decompress(context, context->out.data, arch_len, context->in.data, &probe_len);
     }
+    context->mem = NULL;
 
-    printf("Mean compression ratio: %.2f%%\n", mean_compression_ratio / iterations);
-    printf("Mean compression time: %.3f ms\n", mean_compression_time / iterations);
+    return ret;
+}
 
-    rewind(arch);
-    for (int i = 0; i < iterations; ++i) {
-        ret = decompress(arch, output, source_len);
-        if (ret == BZIP2_FAILURE) {
-            return ret;
-        }
+static size_t bzip2_peak_memory(void *ctx)
+{
+    bzip2_context *context = (bzip2_context*)ctx;
+    size_t peak = context->peak;
 
-        rewind(arch);
-    }
+    context->peak = context->allocated;
+    return peak;
+}
 
-    printf("Mean decompression time: %.3f ms\n", mean_decompression_time / iterations);
+static void bzip2_teardown(void *ctx)
+{
+    bzip2_context *context = (bzip2_context*)ctx;
 
-    return BZIP2_SUCCESS;
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    for (int i = 0; i < BZIP2_BLOCKS; ++i) {
+        if (context->blocks[i].owned) {
+            free(context->blocks[i].data);
+        }
+    }
+    free(context);
 }
+
+// Compression level is blockSize100k parameter: 1 to 9.
+const codec bzip2_codec = {
+    .name = "bzip2",
+    .extension = ".bz2",
+    .min_level = 1,
+    .max_level = 9,
+    .low_level = 1,
+    .high_level = 9,
+    .work_factor = 1,
+    .small_decompress = 1,
+    .init = bzip2_init,
+    .compress_bound = bzip2_compress_bound,
+    .compress = bzip2_compress,
+    .decompress = bzip2_decompress,
+    .compress_file = bzip2_compress_file,
+    .decompress_file = bzip2_decompress_file,
+    .reserve = bzip2_reserve,
+    .peak_memory = bzip2_peak_memory,
+    .teardown = bzip2_teardown
+};
@@ -1,22 +1,12 @@
 #ifndef BZIP2_COMPRESSION_H
 #define BZIP2_COMPRESSION_H
 
-#include <stdio.h>
+#include "codec.h"
 
-enum {
-    BZIP2_SUCCESS,
-    BZIP2_FAILURE
-};
+// Maximum workFactor: amount of effort on repetitive data before fallback sorting algorithm is used.
+#define BZIP2_WORK_FACTOR_MAX 250
 
-/**
- * @brief Start benchmark with bzip2.
- * @param source input file
- * @param arch archive file after compression
- * @param output output file after decompression
- * @param compression_level compression level
- * @param iterations iterations count
- * @return Returns BZIP2_SUCCESS on success or BZIP2_FAILURE if something go wrong.
- */
-int run_bzip2(FILE *source, FILE *arch, FILE *output, int compression_level, int iterations);
+// bzip2 backend.
+extern const codec bzip2_codec;
 
 #endif // BZIP2_COMPRESSION_H
@@ -0,0 +1,135 @@
+#include "checksum.h"
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Reflected Castagnoli polynomial.
+#define CRC32C_POLY 0x82f63b78
+
+// Size of buffer used for reading files.
+#define CHECKSUM_BUFFER_SIZE 65536
+
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void init_table(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc32c_table[i] = c;
+    }
+}
+
+/**
+ * @brief Software CRC32C, one byte at a time.
+ */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    pthread_once(&crc32c_table_once, init_table);
+
+    while (len--) {
+        crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief CRC32C with SSE4.2 crc32 instruction, 8 bytes at a time.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+
+    for (; len && ((uintptr_t)p & 7); --len) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    for (; len; --len) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+
+    return (uint32_t)c;
+}
+
+static int has_sse42(void)
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (has_sse42()) {
+        return ~crc32c_hw(crc, (const unsigned char*)data, len);
+    }
+#endif
+    return ~crc32c_sw(crc, (const unsigned char*)data, len);
+}
+
+const char *crc32c_implementation(void)
+{
+#if defined(__x86_64__)
+    if (has_sse42()) {
+        return "sse4.2";
+    }
+#endif
+    return "table";
+}
+
+int crc32c_file(FILE *f, long start, size_t len, uint32_t *crc)
+{
+    unsigned char buf[CHECKSUM_BUFFER_SIZE];
+    long pos = ftell(f);
+    int ret = 0;
+
+    *crc = 0;
+    if (pos < 0 || fseek(f, start, SEEK_SET) != 0) {
+        return 1;
+    }
+
+    while (len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (fread(buf, 1, n, f) != n) {
+            ret = 1;
+            break;
+        }
+        *crc = crc32c(*crc, buf, n);
+        len -= n;
+    }
+
+    if (fseek(f, pos, SEEK_SET) != 0) {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+int verify_checksum(const char *name, size_t source_len, uint32_t source_crc, size_t len, uint32_t crc)
+{
+    if (len != source_len) {
+        printf("%s verification error: decompressed %zu bytes, source has %zu bytes.\n", name, len, source_len);
+        return 1;
+    }
+
+    if (crc != source_crc) {
+        printf("%s verification error: CRC32C of decompressed data %08x differs from source %08x.\n",
+               name, crc, source_crc);
+        return 1;
+    }
+
+    return 0;
+}
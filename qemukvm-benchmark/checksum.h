@@ -0,0 +1,45 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Updates CRC32C (Castagnoli) of data. Uses SSE4.2 crc32 instruction when CPU has it,
+ * table otherwise.
+ * @param crc CRC32C of preceding data, 0 for the first call
+ * @param data data
+ * @param len data size
+ * @return Returns CRC32C of preceding data and data.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Gets name of CRC32C implementation used on this CPU.
+ * @return Returns "sse4.2" or "table".
+ */
+const char *crc32c_implementation(void);
+
+/**
+ * @brief Calculates CRC32C of file region. File position is restored.
+ * @param f file
+ * @param start region offset
+ * @param len region size
+ * @param crc calculated CRC32C
+ * @return Returns 0 on success or 1 if region could not be read.
+ */
+int crc32c_file(FILE *f, long start, size_t len, uint32_t *crc);
+
+/**
+ * @brief Checks decompressed data against size and CRC32C of source, prints error on mismatch.
+ * @param name codec name
+ * @param source_len source size
+ * @param source_crc source CRC32C
+ * @param len decompressed data size
+ * @param crc decompressed data CRC32C
+ * @return Returns 0 if data matches source or 1 if it doesn't.
+ */
+int verify_checksum(const char *name, size_t source_len, uint32_t source_crc, size_t len, uint32_t crc);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,88 @@
+#include "codec.h"
+#include "util.h"
+#include "zlib_compression.h"
+#include "bzip2_compression.h"
+#include "snappy_compression.h"
+#include "lzo_compression.h"
+#include "zstd_compression.h"
+#include "lz4_compression.h"
+#include <string.h>
+
+const codec *codecs[CODECS_MAX + 1] = {
+    &zlib_codec,
+    &bzip2_codec,
+    &snappy_codec,
+    &lzo_codec,
+    &zstd_codec,
+    &lz4_codec,
+    NULL
+};
+
+const codec *find_codec(const char *name)
+{
+    for (int i = 0; codecs[i]; ++i) {
+        if (!strcmp(codecs[i]->name, name)) {
+            return codecs[i];
+        }
+    }
+
+    return NULL;
+}
+
+int codec_level(const codec *c, int level)
+{
+    if (level == LOW_COMPRESSION) {
+        return c->low_level;
+    }
+    if (level < 0) {
+        return c->high_level;
+    }
+
+    return level;
+}
+
+int codec_has_level(const codec *c, int level)
+{
+    if (level < c->min_level || level > c->max_level) {
+        return 0;
+    }
+
+    if (c->levels) {
+        for (int i = 0; c->levels[i] >= 0; ++i) {
+            if (c->levels[i] == level) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    return 1;
+}
+
+int codec_accepts(const codec *c, size_t source_len)
+{
+    return !c->max_source_len || source_len <= c->max_source_len;
+}
+
+void print_skipped(const codec *c, const char *file_name)
+{
+    printf("%s: skipped %s: input exceeds %s block limit (%zu bytes)\n", c->name, file_name, c->name,
+           c->max_source_len);
+}
+
+int codec_has_method(const codec *c, const char *name)
+{
+    const char *method;
+
+    if (!c->method_name) {
+        return 0;
+    }
+
+    for (int i = 0; (method = c->method_name(i)); ++i) {
+        if (!strcmp(method, name)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct arena;
+
+enum {
+    CODEC_SUCCESS,
+    CODEC_FAILURE
+};
+
+/**
+ * Codec tuning parameters given on command line. Zero means codec default.
+ */
+typedef struct codec_params {
+    size_t chunk_size;      // Buffer size of streaming (file) functions.
+    const char *method;     // Algorithm variant (--method), NULL - chosen by level.
+    int unsafe;             // Decompression without checks of input (--unsafe).
+    const unsigned char *dict;  // Dictionary (--dictionary), NULL - no dictionary.
+    size_t dict_len;
+    int workers;            // Codec's own compression threads (--workers), 0 - compression on calling thread.
+    int work_factor;        // Threshold of fallback block sorting algorithm (--work-factor), 0 - library default.
+    int small;              // Decompression with less memory, at lower speed (--small).
+} codec_params;
+
+/**
+ * Optional interface of codecs which can compress independent blocks of data
+ * and join them into a single archive (used by parallel engine, see parallel.h).
+ * Archive is: header, compressed blocks in order, trailer. Every function gets
+ * its own codec context, so blocks can be compressed on many threads at once.
+ */
+typedef struct block_codec {
+    size_t min_block_size;  // Block sizes supported by archive format.
+    size_t max_block_size;
+
+    /**
+     * @brief Gets maximum size of compressed block.
+     * @param block_len uncompressed block size
+     * @return Returns size of buffer which is big enough for compressed block.
+     */
+    size_t (*block_bound)(size_t block_len);
+
+    /**
+     * @brief Creates archive header.
+     * @param ctx codec context
+     * @param block_size block size
+     * @param dest output buffer (at least BLOCK_HEADER_MAX bytes)
+     * @return Returns header size.
+     */
+    size_t (*header)(void *ctx, size_t block_size, unsigned char *dest);
+
+    /**
+     * @brief Compresses one block.
+     * @param ctx codec context
+     * @param dict data preceding the block (may be used as dictionary), NULL for the first block
+     * @param dict_len dictionary size
+     * @param block input block
+     * @param block_len input block size
+     * @param last non-zero for the last block
+     * @param dest output buffer
+     * @param dest_len output buffer size on input, compressed block size on output
+     * @param check block checksum, joined with combine_check
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*compress_block)(void *ctx, const unsigned char *dict, size_t dict_len,
+                          const unsigned char *block, size_t block_len, int last,
+                          unsigned char *dest, size_t *dest_len, unsigned long *check);
+
+    /**
+     * @brief Joins checksum of data with checksum of block following it.
+     * @param check checksum of preceding data
+     * @param block_check block checksum
+     * @param block_len block size
+     * @return Returns checksum of joined data.
+     */
+    unsigned long (*combine_check)(unsigned long check, unsigned long block_check, size_t block_len);
+
+    /**
+     * @brief Creates archive trailer.
+     * @param ctx codec context
+     * @param check checksum of all data
+     * @param dest output buffer (at least BLOCK_TRAILER_MAX bytes)
+     * @return Returns trailer size.
+     */
+    size_t (*trailer)(void *ctx, unsigned long check, unsigned char *dest);
+} block_codec;
+
+// Maximum archive header and trailer size of block codecs.
+#define BLOCK_HEADER_MAX 64
+#define BLOCK_TRAILER_MAX 64
+
+/**
+ * Compression library backend. Every *_compression.c file defines one codec,
+ * registered in codecs table (codec.c). Benchmark harness drives timing and
+ * statistics for each of them the same way.
+ *
+ * Codec context is created by init for given compression level and passed to all
+ * other functions, so codecs don't keep any global state.
+ */
+typedef struct codec {
+    const char *name;       // Library name, also used as command line option (--name).
+    const char *extension;  // Archive file extension.
+    int min_level;          // Supported compression levels range.
+    int max_level;
+    int low_level;          // Level used for LOW_COMPRESSION (-l).
+    int high_level;         // Level used for HIGH_COMPRESSION (-h).
+    const int *levels;      // Distinct levels (terminated with -1), NULL - every level from min_level to max_level.
+    int unsafe_decompress;  // Non-zero if codec can decompress without checks of input (--unsafe).
+    int dictionary;         // Non-zero if codec uses dictionary (--dictionary).
+    int multithreaded;      // Non-zero if codec can compress on its own threads (--workers).
+    int work_factor;        // Non-zero if codec has work factor (--work-factor).
+    int small_decompress;   // Non-zero if codec can decompress with less memory (--small).
+    size_t max_source_len;  // Largest input of whole buffer and file functions (single block formats), 0 - no limit.
+
+    /**
+     * @brief Creates codec context.
+     * @param ctx created context
+     * @param level compression level (in the range of min_level to max_level)
+     * @param params tuning parameters
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*init)(void **ctx, int level, const codec_params *params);
+
+    /**
+     * @brief Gets maximum compressed data size.
+     * @param source_len uncompressed data size
+     * @return Returns size of buffer which is big enough for compressed data.
+     */
+    size_t (*compress_bound)(size_t source_len);
+
+    /**
+     * @brief Compresses buffer to buffer.
+     * @param ctx codec context
+     * @param source input buffer
+     * @param source_len input buffer size
+     * @param dest output buffer
+     * @param dest_len output buffer size on input, compressed data size on output
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*compress)(void *ctx, const unsigned char *source, size_t source_len,
+                    unsigned char *dest, size_t *dest_len);
+
+    /**
+     * @brief Decompresses buffer to buffer.
+     * @param ctx codec context
+     * @param source compressed data
+     * @param source_len compressed data size
+     * @param dest output buffer
+     * @param dest_len output buffer size on input, decompressed data size on output
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*decompress)(void *ctx, const unsigned char *source, size_t source_len,
+                      unsigned char *dest, size_t *dest_len);
+
+    /**
+     * @brief Compresses source file to archive file (end-to-end measurement).
+     * @param ctx codec context
+     * @param source input file
+     * @param arch archive file
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*compress_file)(void *ctx, FILE *source, FILE *arch);
+
+    /**
+     * @brief Decompresses archive file to output file (end-to-end measurement).
+     * @param ctx codec context
+     * @param arch archive file
+     * @param output output, decompressed file
+     * @param source_len uncompressed data size
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*decompress_file)(void *ctx, FILE *arch, FILE *output, size_t source_len);
+
+    /**
+     * @brief Preallocates work memory of all functions for data up to source_len bytes from arena,
+     * so measured iterations don't allocate and don't pay first page faults. Without it work memory
+     * is allocated on first use and kept in context.
+     * @param ctx codec context
+     * @param a arena (released after teardown)
+     * @param source_len uncompressed data size
+     * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+     */
+    int (*reserve)(void *ctx, struct arena *a, size_t source_len);
+
+    /**
+     * @brief Gets name of algorithm variant selectable with --method, may be NULL if codec has no variants.
+     * @param i variant index
+     * @return Returns name or NULL if i is out of range.
+     */
+    const char *(*method_name)(int i);
+
+    /**
+     * @brief Gets peak size of memory allocated by library since the previous call (or context creation)
+     * and starts a new peak. NULL if codec doesn't track allocations of library.
+     * @param ctx codec context
+     * @return Returns peak memory in bytes.
+     */
+    size_t (*peak_memory)(void *ctx);
+
+    /**
+     * @brief Gets time spent on checksums (CRC32C) of data since the previous call (or context creation)
+     * and starts a new count. NULL if codec doesn't checksum data or doesn't measure it.
+     * @param ctx codec context
+     * @return Returns checksum time in nanoseconds.
+     */
+    uint64_t (*checksum_time)(void *ctx);
+
+    /**
+     * @brief Releases codec context.
+     * @param ctx codec context
+     */
+    void (*teardown)(void *ctx);
+
+    // Parallel block compression, NULL if codec doesn't support it.
+    const block_codec *block;
+} codec;
+
+// Default buffer size of streaming (file) functions of zlib, bzip2 and zstd (--chunk).
+#define CHUNK 262144    // 256 KB
+
+// Range of buffer sizes accepted by --chunk.
+#define CHUNK_MIN 4096
+#define CHUNK_MAX (16 * 1024 * 1024)
+
+// Upper limit of registered codecs.
+#define CODECS_MAX 16
+
+// Registered codecs, NULL terminated.
+extern const codec *codecs[CODECS_MAX + 1];
+
+/**
+ * @brief Finds registered codec.
+ * @param name codec name
+ * @return Returns codec or NULL if there is no codec with given name.
+ */
+const codec *find_codec(const char *name);
+
+/**
+ * @brief Maps LOW_COMPRESSION/HIGH_COMPRESSION option to codec's compression level.
+ * @param c codec
+ * @param level LOW_COMPRESSION, HIGH_COMPRESSION (or DEFAULT_COMPRESSION) or codec's own level
+ * @return Returns compression level.
+ */
+int codec_level(const codec *c, int level);
+
+/**
+ * @brief Checks if codec supports compression level (and it differs from other levels).
+ * @param c codec
+ * @param level codec's own level
+ * @return Returns non-zero if level is supported.
+ */
+int codec_has_level(const codec *c, int level);
+
+/**
+ * @brief Checks if codec can compress input of given size as a whole (see max_source_len).
+ * @param c codec
+ * @param source_len uncompressed data size
+ * @return Returns non-zero if input is accepted.
+ */
+int codec_accepts(const codec *c, size_t source_len);
+
+/**
+ * @brief Prints that codec is skipped, because input exceeds its limit.
+ * @param c codec
+ * @param file_name input name
+ */
+void print_skipped(const codec *c, const char *file_name);
+
+/**
+ * @brief Checks if codec has algorithm variant.
+ * @param c codec
+ * @param name variant name
+ * @return Returns non-zero if codec has variant.
+ */
+int codec_has_method(const codec *c, const char *name);
+
+#endif // CODEC_H
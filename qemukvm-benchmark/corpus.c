@@ -0,0 +1,416 @@
+#include "corpus.h"
+#include "codec.h"
+#include "benchmark.h"
+#include "report.h"
+#include "sweep.h"
+#include "migration.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Checks if file is an artifact of end-to-end benchmark (archive or decompressed output).
+ * @param name file name
+ * @return Returns 1 if file should be skipped, 0 otherwise.
+ */
+static int is_artifact(const char *name)
+{
+    size_t len = strlen(name);
+
+    if (len >= 4 && !strcmp(name + len - 4, "_dec")) {
+        return 1;
+    }
+
+    for (int i = 0; codecs[i]; ++i) {
+        size_t ext_len = strlen(codecs[i]->extension);
+        if (len > ext_len && !strcmp(name + len - ext_len, codecs[i]->extension)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Loads file and appends it to corpus. Empty files are skipped.
+ * @param corp corpus
+ * @param path file path
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+static int corpus_add(corpus *corp, const char *path)
+{
+    corpus_file *file;
+    FILE *f;
+    off_t size;
+
+    if (corp->count == corp->capacity) {
+        int capacity = corp->capacity ? corp->capacity * 2 : 64;
+        corpus_file *files = (corpus_file*)realloc(corp->files, capacity * sizeof(corpus_file));
+        if (!files) {
+            puts("Error: problem with allocating memory for corpus.");
+            return 1;
+        }
+        corp->files = files;
+        corp->capacity = capacity;
+    }
+
+    f = fopen(path, "r");
+    if (!f) {
+        printf("Error: problem with opening input file %s.\n", path);
+        return 1;
+    }
+
+    size = get_file_size(f);
+    if (size < 0) {
+        printf("Error: problem with getting size of input file %s.\n", path);
+        fclose(f);
+        return 1;
+    }
+    if (size == 0) {
+        printf("Warning: skipping empty file %s.\n", path);
+        fclose(f);
+        return 0;
+    }
+
+    file = &corp->files[corp->count];
+    file->data = load_file_aligned(f, &file->len);
+    fclose(f);
+    if (!file->data) {
+        return 1;
+    }
+
+    file->name = strdup(path);
+    if (!file->name) {
+        puts("Error: problem with allocating memory for corpus.");
+        free(file->data);
+        return 1;
+    }
+
+    corp->count++;
+    corp->total_len += file->len;
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * @brief Recursively loads directory files in name order.
+ * @param corp corpus
+ * @param path directory path
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+static int load_directory(corpus *corp, const char *path)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char **names = NULL;
+    int count = 0, capacity = 0;
+    int ret = 0;
+
+    dir = opendir(path);
+    if (!dir) {
+        printf("Error: problem with opening directory %s.\n", path);
+        return 1;
+    }
+
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (count == capacity) {
+            char **tmp;
+            capacity = capacity ? capacity * 2 : 64;
+            tmp = (char**)realloc(names, capacity * sizeof(char*));
+            if (!tmp) {
+                ret = 1;
+                break;
+            }
+            names = tmp;
+        }
+        names[count] = strdup(entry->d_name);
+        if (!names[count]) {
+            ret = 1;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    if (ret) {
+        puts("Error: problem with allocating memory for corpus.");
+    } else {
+        qsort(names, count, sizeof(char*), compare_names);
+    }
+
+    for (int i = 0; i < count && !ret; ++i) {
+        char file_path[FILENAME_MAX];
+        struct stat st;
+
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, names[i]);
+        if (stat(file_path, &st) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            ret = load_directory(corp, file_path);
+        } else if (S_ISREG(st.st_mode) && !is_artifact(names[i])) {
+            ret = corpus_add(corp, file_path);
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        free(names[i]);
+    }
+    free(names);
+    return ret;
+}
+
+int corpus_load_directory(corpus *corp, const char *path)
+{
+    size_t len = strlen(path);
+    char dir_path[FILENAME_MAX];
+
+    memset(corp, 0, sizeof(*corp));
+    corp->name = path;
+
+    // "testdata/" and "testdata" give the same file names.
+    snprintf(dir_path, sizeof(dir_path), "%s", path);
+    while (len > 1 && dir_path[len - 1] == '/') {
+        dir_path[--len] = '\0';
+    }
+
+    if (load_directory(corp, dir_path) != 0) {
+        corpus_free(corp);
+        return 1;
+    }
+
+    return 0;
+}
+
+int corpus_load_manifest(corpus *corp, const char *path)
+{
+    char line[FILENAME_MAX];
+    char dir_path[FILENAME_MAX];
+    const char *slash = strrchr(path, '/');
+    FILE *manifest;
+
+    memset(corp, 0, sizeof(*corp));
+    corp->name = path;
+
+    manifest = fopen(path, "r");
+    if (!manifest) {
+        puts("Error: problem with opening manifest file.");
+        return 1;
+    }
+
+    // Manifest directory, relative paths are resolved against it.
+    snprintf(dir_path, sizeof(dir_path), "%.*s", slash ? (int)(slash - path) : 1, slash ? path : ".");
+
+    while (fgets(line, sizeof(line), manifest)) {
+        char file_path[FILENAME_MAX * 2];
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        if (line[0] == '/' || !slash) {
+            snprintf(file_path, sizeof(file_path), "%s", line);
+        } else {
+            snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, line);
+        }
+
+        if (corpus_add(corp, file_path) != 0) {
+            fclose(manifest);
+            corpus_free(corp);
+            return 1;
+        }
+    }
+
+    fclose(manifest);
+    return 0;
+}
+
+void corpus_free(corpus *corp)
+{
+    for (int i = 0; i < corp->count; ++i) {
+        free(corp->files[i].name);
+        free(corp->files[i].data);
+    }
+    free(corp->files);
+    corp->files = NULL;
+    corp->count = 0;
+    corp->capacity = 0;
+    corp->total_len = 0;
+}
+
+/**
+ * @brief Runs benchmark of one corpus file: codec-only or migration workload on its loaded data,
+ * or end-to-end (file to file) on the file itself unless options.in_memory is set.
+ * @param c codec
+ * @param file corpus file
+ * @param options benchmark options
+ * @param result summary of run
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_corpus_file(const codec *c, const corpus_file *file, bench_options options, bench_result *result)
+{
+    FILE *source;
+    int ret;
+
+    if (options.page_size) {
+        return run_migration_benchmark(c, file->data, file->len, options, result);
+    } else if (options.in_memory) {
+        return run_in_memory_benchmark(c, file->data, file->len, options, result);
+    }
+
+    source = fopen(file->name, "r");
+    if (!source) {
+        printf("Error: problem with opening input file %s.\n", file->name);
+        return CODEC_FAILURE;
+    }
+
+    ret = run_file_benchmark(c, source, file->name, options, result);
+    fclose(source);
+    return ret;
+}
+
+/**
+ * @brief Prints and reports corpus aggregate of one codec and level.
+ * @param c codec
+ * @param level compression level
+ * @param corp corpus
+ * @param total sums of per-file results
+ * @param files number of successfully measured files
+ * @param mode benchmark mode name of result records
+ */
+static void print_aggregate(const codec *c, int level, const corpus *corp, const bench_result *total, int files,
+                            const char *mode)
+{
+    result_record r;
+    double compression = total->compression_time > 0.0 ? total->source_len / 1000.0 / total->compression_time : 0.0;
+    double decompression = total->decompression_time > 0.0 ? total->source_len / 1000.0 / total->decompression_time : 0.0;
+
+    printf("Corpus %s (%s, level %d): %d files, %zu bytes\n", corp->name, c->name, level, files, total->source_len);
+    printf("Corpus compression ratio: %.2f%%\n",
+           total->source_len ? (total->arch_len / (double)total->source_len) * 100.0 : 0.0);
+    printf("Corpus compression time: %.3f ms\n", total->compression_time);
+    printf("Corpus decompression time: %.3f ms\n", total->decompression_time);
+    printf("Corpus compression throughput: %.2f MB/s\n", compression);
+    printf("Corpus decompression throughput: %.2f MB/s\n", decompression);
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = level;
+    r.mode = mode;
+    r.setup_ms = -1.0;
+    r.file = corp->name;
+    r.input_size = total->source_len;
+    r.output_size = total->arch_len;
+    r.threads = 1;
+    r.scaling_efficiency = -1.0;
+
+    r.operation = "compression";
+    r.throughput = compression;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.throughput = decompression;
+    report_result(&r);
+}
+
+int run_corpus_benchmark(const corpus *corp, bench_options options, int all_levels)
+{
+    int levels[CODECS_MAX][LEVELS_MAX];
+    int levels_count[CODECS_MAX];
+    int slots = 0;
+    const char *mode = options.in_memory || options.page_size ? "corpus" : "corpus-end-to-end";
+    level_sweep *sweeps = NULL;    // Per-file sweeps, the last one is the corpus aggregate.
+    int ret = 0;
+
+    printf("Corpus %s: %d files, %zu bytes\n", corp->name, corp->count, corp->total_len);
+
+    for (int i = 0; codecs[i]; ++i) {
+        levels_count[i] = plan_levels(codecs[i], options, all_levels, levels[i]);
+        if (levels_count[i] > slots) {
+            slots = levels_count[i];
+        }
+    }
+
+    if (options.levels_count) {
+        sweeps = (level_sweep*)malloc((corp->count + 1) * sizeof(level_sweep));
+        if (!sweeps) {
+            puts("Error: problem with allocating memory for level sweep.");
+            return 1;
+        }
+        for (int j = 0; j < corp->count; ++j) {
+            sweep_init(&sweeps[j], corp->files[j].name);
+        }
+        sweep_init(&sweeps[corp->count], corp->name);
+    }
+
+    // Level by level, so every codec is run on its n-th level before any codec goes on to the next one.
+    for (int l = 0; l < slots; ++l) {
+        for (int i = 0; codecs[i]; ++i) {
+            const codec *c = codecs[i];
+            bench_result total;
+            int files = 0;
+
+            if ((options.library && options.library != c) || l >= levels_count[i]) {
+                continue;
+            }
+
+            options.level = levels[i][l];
+            memset(&total, 0, sizeof(total));
+            for (int j = 0; j < corp->count; ++j) {
+                bench_result result;
+
+                // Migration workload compresses pages, other modes pass the whole file to codec.
+                if (!options.page_size && !codec_accepts(c, corp->files[j].len)) {
+                    print_skipped(c, corp->files[j].name);
+                    continue;
+                }
+
+                // Same format as output of run.sh, so results can be processed with create_stats.py.
+                printf("file: %s\n", corp->files[j].name);
+                options.input_name = corp->files[j].name;
+                if (run_corpus_file(c, &corp->files[j], options, &result) != CODEC_SUCCESS) {
+                    ret = 1;
+                    continue;
+                }
+                printf("\n********************************\n\n");
+
+                if (sweeps) {
+                    ret |= sweep_add(&sweeps[j], c, codec_level(c, options.level), &result);
+                }
+
+                total.source_len += result.source_len;
+                total.arch_len += result.arch_len;
+                total.compression_time += result.compression_time;
+                total.decompression_time += result.decompression_time;
+                files++;
+            }
+
+            print_aggregate(c, codec_level(c, options.level), corp, &total, files, mode);
+            printf("\n********************************\n\n");
+
+            if (sweeps && files == corp->count) {
+                ret |= sweep_add(&sweeps[corp->count], c, codec_level(c, options.level), &total);
+            }
+        }
+    }
+
+    if (sweeps) {
+        for (int j = 0; j <= corp->count; ++j) {
+            print_sweep(&sweeps[j]);
+            sweep_free(&sweeps[j]);
+        }
+        free(sweeps);
+    }
+
+    return ret;
+}
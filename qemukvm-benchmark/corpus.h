@@ -0,0 +1,63 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+#include "util.h"
+
+/**
+ * Input file loaded into memory.
+ */
+typedef struct {
+    char *name;
+    unsigned char *data;    // Page aligned buffer.
+    size_t len;
+} corpus_file;
+
+/**
+ * Set of input files, loaded once and benchmarked in a single process.
+ */
+typedef struct {
+    const char *name;       // Directory or manifest path.
+    corpus_file *files;
+    int count;
+    int capacity;
+    size_t total_len;
+} corpus;
+
+/**
+ * @brief Loads all files of directory (recursively, in name order). Archives and decompressed
+ * files left by end-to-end benchmark (<file><extension>, <file><extension>_dec) are skipped.
+ * @param corp corpus (release with corpus_free())
+ * @param path directory path
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int corpus_load_directory(corpus *corp, const char *path);
+
+/**
+ * @brief Loads files listed in manifest - one path per line, empty lines and lines starting with '#'
+ * are ignored. Relative paths are relative to the manifest directory.
+ * @param corp corpus (release with corpus_free())
+ * @param path manifest path
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int corpus_load_manifest(corpus *corp, const char *path);
+
+/**
+ * @brief Releases corpus.
+ * @param corp corpus
+ */
+void corpus_free(corpus *corp);
+
+/**
+ * @brief Runs benchmark of every selected codec and level on every corpus file - end-to-end (file to file)
+ * by default, codec-only with options.in_memory, migration workload with options.page_size - prints per-file
+ * results and corpus aggregate: total size divided by total mean time (weighted MB/s).
+ * With options.levels every listed level is run and level sweep of every file and of whole corpus is printed.
+ * @param corp corpus
+ * @param options benchmark options
+ * @param all_levels run both low and high compression level instead of options.level
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int run_corpus_benchmark(const corpus *corp, bench_options options, int all_levels);
+
+#endif // CORPUS_H
@@ -0,0 +1,99 @@
+#include "histogram.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief Gets bucket of value. Values below 2 * HISTOGRAM_SUB_BUCKETS have own buckets, larger ones
+ * share bucket with values which have the same HISTOGRAM_SUB_BITS + 1 most significant bits.
+ */
+static int bucket_index(uint64_t value)
+{
+    int shift;
+
+    if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (int)((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+/**
+ * @brief Gets the highest value of bucket.
+ */
+static uint64_t bucket_high(int index)
+{
+    int shift;
+    uint64_t top;
+
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+
+    shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    top = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void histogram_reset(histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void histogram_add(histogram *h, uint64_t value)
+{
+    ++h->counts[bucket_index(value)];
+    ++h->count;
+    h->total += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void histogram_merge(histogram *h, const histogram *other)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        h->counts[i] += other->counts[i];
+    }
+    h->count += other->count;
+    h->total += other->total;
+    if (other->min < h->min) {
+        h->min = other->min;
+    }
+    if (other->max > h->max) {
+        h->max = other->max;
+    }
+}
+
+uint64_t histogram_percentile(const histogram *h, double percentile)
+{
+    uint64_t rank, seen = 0;
+
+    if (!h->count) {
+        return 0;
+    }
+
+    rank = (uint64_t)ceil(percentile / 100.0 * h->count);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_high(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+double histogram_mean(const histogram *h)
+{
+    return h->count ? h->total / h->count : 0.0;
+}
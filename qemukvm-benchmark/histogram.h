@@ -0,0 +1,61 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// Sub-buckets of every power of two: values are kept with relative error below 1/32 (~3%).
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+// Buckets of all 64-bit values.
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Log-bucketed histogram (in the style of HdrHistogram) of latencies in nanoseconds.
+ * Recording is constant time and memory doesn't grow with number of values, so it can
+ * record every call of long runs.
+ */
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double total;
+} histogram;
+
+/**
+ * @brief Clears histogram.
+ * @param h histogram
+ */
+void histogram_reset(histogram *h);
+
+/**
+ * @brief Records value.
+ * @param h histogram
+ * @param value value
+ */
+void histogram_add(histogram *h, uint64_t value);
+
+/**
+ * @brief Adds all values recorded in other histogram.
+ * @param h histogram
+ * @param other histogram to add
+ */
+void histogram_merge(histogram *h, const histogram *other);
+
+/**
+ * @brief Gets percentile: the highest value equivalent (within bucket) to value at percentile.
+ * @param h histogram
+ * @param percentile percentile, 0 to 100
+ * @return Returns value at percentile or 0 if histogram is empty.
+ */
+uint64_t histogram_percentile(const histogram *h, double percentile);
+
+/**
+ * @brief Gets mean of recorded values.
+ * @param h histogram
+ * @return Returns mean or 0 if histogram is empty.
+ */
+double histogram_mean(const histogram *h);
+
+#endif // HISTOGRAM_H
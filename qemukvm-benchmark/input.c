@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include "input.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "util.h"
+
+/**
+ * @brief Reads whole file from the beginning.
+ * @param fd file descriptor
+ * @param buf buffer of at least len bytes
+ * @param len file size
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+static int read_whole(int fd, unsigned char *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, done);
+        if (n <= 0) {
+            return 1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+int input_acquire(input_view *in, int fd, size_t len)
+{
+    void *map;
+    int flags = MAP_PRIVATE;
+    int advice = -1;
+
+    in->len = len;
+
+    if (in->method == INPUT_READ) {
+        if (read_whole(fd, in->buf, len) != 0) {
+            puts("Error: problem with reading input file.");
+            return 1;
+        }
+        in->data = in->buf;
+        return 0;
+    }
+
+    if (in->populate) {
+        flags |= MAP_POPULATE;
+    }
+
+    map = mmap(NULL, len, PROT_READ, flags, fd, 0);
+    if (map == MAP_FAILED) {
+        puts("Error: problem with mapping input file.");
+        return 1;
+    }
+
+    switch (in->advice) {
+    case ADVICE_SEQUENTIAL:
+        advice = MADV_SEQUENTIAL;
+        break;
+    case ADVICE_WILLNEED:
+        advice = MADV_WILLNEED;
+        break;
+    case ADVICE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+        advice = MADV_HUGEPAGE;
+#endif
+        break;
+    }
+
+    // Advice is only a hint, mapping is usable even if it is rejected.
+    if (advice >= 0) {
+        madvise(map, len, advice);
+    }
+
+    in->data = (const unsigned char*)map;
+    return 0;
+}
+
+void input_release(input_view *in)
+{
+    if (in->method == INPUT_MMAP && in->data) {
+        munmap((void*)in->data, in->len);
+    }
+    in->data = NULL;
+}
+
+unsigned long input_touch(const input_view *in)
+{
+    unsigned long sum = 0;
+
+    for (size_t i = 0; i < in->len; i += BUFFER_ALIGNMENT) {
+        sum += in->data[i];
+    }
+
+    return sum;
+}
+
+int input_drop_cache(int fd)
+{
+    return posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0;
+}
+
+int input_method(const char *name)
+{
+    if (!strcmp(name, "stdio")) {
+        return INPUT_STDIO;
+    }
+    if (!strcmp(name, "read")) {
+        return INPUT_READ;
+    }
+    if (!strcmp(name, "mmap")) {
+        return INPUT_MMAP;
+    }
+
+    return -1;
+}
+
+int input_advice(const char *name)
+{
+    if (!strcmp(name, "none")) {
+        return ADVICE_NONE;
+    }
+    if (!strcmp(name, "sequential")) {
+        return ADVICE_SEQUENTIAL;
+    }
+    if (!strcmp(name, "willneed")) {
+        return ADVICE_WILLNEED;
+    }
+    if (!strcmp(name, "hugepage")) {
+        return ADVICE_HUGEPAGE;
+    }
+
+    return -1;
+}
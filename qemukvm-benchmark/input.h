@@ -0,0 +1,77 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+// Input path of end-to-end benchmark.
+enum {
+    INPUT_STDIO,    // Codec reads FILE itself (compress_file/decompress_file).
+    INPUT_READ,     // Whole file is read() into preallocated buffer, codec gets the buffer.
+    INPUT_MMAP      // File is mapped, codec gets the mapped pointer (no copy).
+};
+
+// Advice given to kernel for mapped input.
+enum {
+    ADVICE_NONE,
+    ADVICE_SEQUENTIAL,
+    ADVICE_WILLNEED,
+    ADVICE_HUGEPAGE
+};
+
+/**
+ * Input data of one iteration. Depending on method, data points to the mapping or to the read buffer.
+ */
+typedef struct {
+    int method;             // INPUT_READ or INPUT_MMAP.
+    int populate;           // MAP_POPULATE - prefault mapping in mmap().
+    int advice;             // madvise() advice, ADVICE_NONE - no madvise() call.
+    unsigned char *buf;     // Preallocated buffer for INPUT_READ.
+    const unsigned char *data;
+    size_t len;
+} input_view;
+
+/**
+ * @brief Gets whole file content: maps it or reads it into view buffer.
+ * @param in view with method, populate, advice (and buf for INPUT_READ) set
+ * @param fd file descriptor
+ * @param len file size (greater than 0)
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int input_acquire(input_view *in, int fd, size_t len);
+
+/**
+ * @brief Releases file content (unmaps file).
+ * @param in view
+ */
+void input_release(input_view *in);
+
+/**
+ * @brief Touches one byte per page of view, so all page faults are paid.
+ * @param in view
+ * @return Returns sum of touched bytes (to keep reads from being optimized out).
+ */
+unsigned long input_touch(const input_view *in);
+
+/**
+ * @brief Drops cached pages of file (POSIX_FADV_DONTNEED), so the next read goes to the device.
+ * Called outside of timed region. Dirty pages are not dropped, input files are not written.
+ * @param fd file descriptor
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int input_drop_cache(int fd);
+
+/**
+ * @brief Parses input method name.
+ * @param name "stdio", "read" or "mmap"
+ * @return Returns input method or -1 if name is invalid.
+ */
+int input_method(const char *name);
+
+/**
+ * @brief Parses madvise() advice name.
+ * @param name "none", "sequential", "willneed" or "hugepage"
+ * @return Returns advice or -1 if name is invalid.
+ */
+int input_advice(const char *name);
+
+#endif // INPUT_H
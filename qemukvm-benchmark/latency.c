@@ -0,0 +1,210 @@
+#include "latency.h"
+#include "histogram.h"
+#include "timer.h"
+#include "report.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const codec *c;
+    void *ctx;
+    const unsigned char *source;
+    size_t size;                // Call size.
+    size_t buffers;             // Number of calls in one pass.
+    size_t bound;               // Maximum compressed size of one buffer.
+    unsigned char *arch;        // Compressed buffers, bound bytes each.
+    size_t *arch_lens;
+    unsigned char *output;      // Decompressed buffer (LATENCY_SIZE_MAX bytes).
+    int verify;
+} latency_state;
+
+/**
+ * @brief Compresses every buffer once.
+ * @param state benchmark state
+ * @param h histogram of call latency, NULL if pass is not recorded
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int compress_pass(latency_state *state, histogram *h)
+{
+    for (size_t i = 0; i < state->buffers; ++i) {
+        uint64_t start, stop;
+        int ret;
+
+        state->arch_lens[i] = state->bound;
+        start = timer_now();
+        ret = state->c->compress(state->ctx, state->source + i * state->size, state->size,
+                                 state->arch + i * state->bound, &state->arch_lens[i]);
+        stop = timer_now();
+
+        if (ret != CODEC_SUCCESS) {
+            return CODEC_FAILURE;
+        }
+        if (h) {
+            histogram_add(h, timer_ns(stop - start));
+        }
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Decompresses every buffer once.
+ * @param state benchmark state
+ * @param h histogram of call latency, NULL if pass is not recorded
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int decompress_pass(latency_state *state, histogram *h)
+{
+    for (size_t i = 0; i < state->buffers; ++i) {
+        uint64_t start, stop;
+        size_t output_len = state->size;
+        int ret;
+
+        start = timer_now();
+        ret = state->c->decompress(state->ctx, state->arch + i * state->bound, state->arch_lens[i],
+                                   state->output, &output_len);
+        stop = timer_now();
+
+        if (ret != CODEC_SUCCESS) {
+            return CODEC_FAILURE;
+        }
+        if (output_len != state->size ||
+                (state->verify && memcmp(state->output, state->source + i * state->size, state->size))) {
+            printf("%s verification error: decompressed buffer %zu of %zu bytes doesn't match source.\n",
+                   state->c->name, i, state->size);
+            return CODEC_FAILURE;
+        }
+        if (h) {
+            histogram_add(h, timer_ns(stop - start));
+        }
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Runs cold pass, warm-up passes and measured passes.
+ * @param state benchmark state
+ * @param pass compression or decompression pass
+ * @param options benchmark options
+ * @param h histogram of call latency of measured passes
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_passes(latency_state *state, int (*pass)(latency_state*, histogram*), bench_options options,
+                      histogram *h)
+{
+    histogram_reset(h);
+
+    for (int i = 0; i < 1 + options.warmup + options.iterations; ++i) {
+        if (pass(state, i > options.warmup ? h : NULL) != CODEC_SUCCESS) {
+            return CODEC_FAILURE;
+        }
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Prints latency percentiles of histogram in microseconds.
+ */
+static void print_percentiles(const histogram *h)
+{
+    printf("  %9.3f %9.3f %9.3f %10.3f", histogram_percentile(h, 50.0) / 1e3, histogram_percentile(h, 99.0) / 1e3,
+           histogram_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+int run_latency_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options)
+{
+    latency_state state;
+    histogram *compression, *decompression;
+    arena mem;
+    size_t arch_size = 0;
+    int ret = CODEC_SUCCESS;
+    int level = codec_level(c, options.level);
+
+    memset(&state, 0, sizeof(state));
+    state.c = c;
+    state.source = source;
+    state.verify = options.verify;
+
+    if (source_len < LATENCY_SIZE_MIN) {
+        printf("%s error: input is smaller than %d bytes.\n", c->name, LATENCY_SIZE_MIN);
+        return CODEC_FAILURE;
+    }
+
+    // Buffers are shared by all call sizes, so they are as big as the largest size needs.
+    for (size_t size = LATENCY_SIZE_MIN; size <= LATENCY_SIZE_MAX; size *= 2) {
+        size_t needed = source_len / size * c->compress_bound(size);
+        arch_size = needed > arch_size ? needed : arch_size;
+    }
+
+    arena_init(&mem);
+    state.arch = (unsigned char*)arena_alloc(&mem, arch_size);
+    state.arch_lens = (size_t*)arena_alloc(&mem, sizeof(size_t) * (source_len / LATENCY_SIZE_MIN));
+    state.output = (unsigned char*)arena_alloc(&mem, LATENCY_SIZE_MAX);
+    compression = (histogram*)arena_alloc(&mem, sizeof(histogram));
+    decompression = (histogram*)arena_alloc(&mem, sizeof(histogram));
+    if (!state.arch || !state.arch_lens || !state.output || !compression || !decompression) {
+        printf("%s error: problem with allocating memory for buffers.\n", c->name);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&state.ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->reserve && c->reserve(state.ctx, &mem, LATENCY_SIZE_MAX) != CODEC_SUCCESS) {
+        printf("%s error: problem with allocating work memory.\n", c->name);
+        c->teardown(state.ctx);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: latency mode, compression level set on %d, timer %s\n", c->name, level, timer_source());
+    print_arena(&mem);
+    printf("Call latency in us:          compression                                 decompression\n");
+    printf("    size    calls   ratio  %9s %9s %9s %10s  %9s %9s %9s %10s\n",
+           "p50", "p99", "p99.9", "max", "p50", "p99", "p99.9", "max");
+
+    for (size_t size = LATENCY_SIZE_MIN; size <= LATENCY_SIZE_MAX && ret == CODEC_SUCCESS; size *= 2) {
+        size_t arch_len = 0;
+
+        state.size = size;
+        state.buffers = source_len / size;
+        state.bound = c->compress_bound(size);
+        if (!state.buffers) {
+            break;
+        }
+
+        ret = run_passes(&state, compress_pass, options, compression);
+        if (ret == CODEC_SUCCESS) {
+            ret = run_passes(&state, decompress_pass, options, decompression);
+        }
+        if (ret != CODEC_SUCCESS) {
+            printf("%s error: latency benchmark of %zu byte calls failed.\n", c->name, size);
+            break;
+        }
+
+        for (size_t i = 0; i < state.buffers; ++i) {
+            arch_len += state.arch_lens[i];
+        }
+
+        printf("%8zu %8zu %6.2f%%", size, state.buffers, arch_len * 100.0 / (state.buffers * size));
+        print_percentiles(compression);
+        print_percentiles(decompression);
+        putchar('\n');
+        report_latency(c, options, size, state.buffers, arch_len, compression, decompression);
+    }
+
+    if (ret == CODEC_SUCCESS && options.verify) {
+        puts("Verification: every decompressed buffer matches source");
+    }
+
+    c->teardown(state.ctx);
+    arena_destroy(&mem);
+    return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stddef.h>
+#include "codec.h"
+#include "util.h"
+
+// Range of call sizes of latency benchmark (powers of two).
+#define LATENCY_SIZE_MIN 512
+#define LATENCY_SIZE_MAX (64 * 1024)
+
+/**
+ * @brief Runs call latency benchmark: for every call size from LATENCY_SIZE_MIN to LATENCY_SIZE_MAX input is
+ * sliced into buffers of that size and every buffer is compressed (and decompressed) with a single codec call,
+ * timed with timer_now() (timer_init() must be called before). Latency of every call of options.iterations passes
+ * (after a cold pass and options.warmup passes) is recorded in histogram and p50/p99/p99.9/max are reported.
+ * @param c codec
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param options benchmark options
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_latency_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options);
+
+#endif // LATENCY_H
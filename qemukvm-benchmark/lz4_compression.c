@@ -0,0 +1,313 @@
+#include "lz4_compression.h"
+#include "util.h"
+#include "arena.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <lz4.h>
+#include <lz4hc.h>
+
+// LZ4 uses at most 64 KB of dictionary.
+#define LZ4_DICT_MAX 65536
+
+// Archive header of file functions: uncompressed size.
+#define LZ4_HEADER_SIZE 4
+
+typedef struct {
+    int level;
+    work_buffer state;          // LZ4_stream_t or LZ4_streamHC_t, so compression doesn't allocate.
+    int state_ready;
+    const char *dict;           // The last LZ4_DICT_MAX bytes of dictionary (--dictionary), NULL - no dictionary.
+    int dict_len;
+    work_buffer in;             // Whole file buffers of file functions.
+    work_buffer out;
+} lz4_context;
+
+/**
+ * @brief Checks if level is LZ4HC level.
+ * @param context lz4 context
+ * @return Returns non-zero for LZ4HC.
+ */
+static int is_hc(const lz4_context *context)
+{
+    return context->level >= LZ4HC_CLEVEL_MIN;
+}
+
+/**
+ * @brief Gets compression state, allocated on first use.
+ * @param context lz4 context
+ * @param a arena or NULL
+ * @return Returns state or NULL if something go wrong.
+ */
+static void *get_state(lz4_context *context, arena *a)
+{
+    size_t size = is_hc(context) ? sizeof(LZ4_streamHC_t) : sizeof(LZ4_stream_t);
+
+    if (work_buffer_reserve(&context->state, size, a) != 0) {
+        puts("lz4 error: problem with allocating memory for compression state.");
+        return NULL;
+    }
+
+    if (!context->state_ready) {
+        if (is_hc(context)) {
+            LZ4_initStreamHC(context->state.data, size);
+        } else {
+            LZ4_initStream(context->state.data, size);
+        }
+        context->state_ready = 1;
+    }
+
+    return context->state.data;
+}
+
+static int lz4_init(void **ctx, int level, const codec_params *params)
+{
+    lz4_context *context = (lz4_context*)calloc(1, sizeof(lz4_context));
+    if (!context) {
+        return CODEC_FAILURE;
+    }
+
+    context->level = level;
+    if (params->dict) {
+        size_t len = params->dict_len < LZ4_DICT_MAX ? params->dict_len : LZ4_DICT_MAX;
+
+        context->dict = (const char*)params->dict + params->dict_len - len;
+        context->dict_len = (int)len;
+    }
+
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t lz4_compress_bound(size_t source_len)
+{
+    return source_len > LZ4_MAX_INPUT_SIZE ? 0 : (size_t)LZ4_compressBound((int)source_len);
+}
+
+static int lz4_compress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                               unsigned char *dest, size_t *dest_len)
+{
+    lz4_context *context = (lz4_context*)ctx;
+    void *state = get_state(context, NULL);
+    int capacity = *dest_len > INT_MAX ? INT_MAX : (int)*dest_len;
+    int ret;
+
+    if (!state || source_len > LZ4_MAX_INPUT_SIZE) {
+        puts("lz4 compression error.");
+        return CODEC_FAILURE;
+    }
+
+    // Dictionary is loaded into stream before every call, without it state is reset by *_extState functions.
+    if (is_hc(context)) {
+        if (context->dict) {
+            LZ4_resetStreamHC_fast((LZ4_streamHC_t*)state, context->level);
+            LZ4_loadDictHC((LZ4_streamHC_t*)state, context->dict, context->dict_len);
+            ret = LZ4_compress_HC_continue((LZ4_streamHC_t*)state, (const char*)source, (char*)dest,
+                                           (int)source_len, capacity);
+        } else {
+            ret = LZ4_compress_HC_extStateHC(state, (const char*)source, (char*)dest, (int)source_len, capacity,
+                                             context->level);
+        }
+    } else {
+        if (context->dict) {
+            LZ4_resetStream_fast((LZ4_stream_t*)state);
+            LZ4_loadDict((LZ4_stream_t*)state, context->dict, context->dict_len);
+            ret = LZ4_compress_fast_continue((LZ4_stream_t*)state, (const char*)source, (char*)dest,
+                                             (int)source_len, capacity, 1);
+        } else {
+            ret = LZ4_compress_fast_extState(state, (const char*)source, (char*)dest, (int)source_len, capacity, 1);
+        }
+    }
+
+    if (ret <= 0) {
+        puts("lz4 compression error.");
+        return CODEC_FAILURE;
+    }
+
+    *dest_len = ret;
+    return CODEC_SUCCESS;
+}
+
+static int lz4_decompress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                 unsigned char *dest, size_t *dest_len)
+{
+    lz4_context *context = (lz4_context*)ctx;
+    int capacity = *dest_len > INT_MAX ? INT_MAX : (int)*dest_len;
+    int ret;
+
+    if (source_len > INT_MAX) {
+        puts("lz4 decompression error.");
+        return CODEC_FAILURE;
+    }
+
+    if (context->dict) {
+        ret = LZ4_decompress_safe_usingDict((const char*)source, (char*)dest, (int)source_len, capacity,
+                                            context->dict, context->dict_len);
+    } else {
+        ret = LZ4_decompress_safe((const char*)source, (char*)dest, (int)source_len, capacity);
+    }
+
+    if (ret < 0) {
+        puts("lz4 decompression error: compressed data violation");
+        return CODEC_FAILURE;
+    }
+
+    *dest_len = ret;
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Compresses source file to archive file: uncompressed size followed by one LZ4 block.
+ * @param ctx codec context
+ * @param source source file
+ * @param arch archive file
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int lz4_compress_file(void *ctx, FILE *source, FILE *arch)
+{
+    lz4_context *context = (lz4_context*)ctx;
+    off_t file_size = get_file_size(source);
+    size_t buf_len, compressed_len;
+    unsigned char *header;
+
+    // Header holds 32-bit size, the library limit (LZ4_MAX_INPUT_SIZE) is lower anyway.
+    if (file_size < 0 || (uint64_t)file_size > LZ4_MAX_INPUT_SIZE) {
+        puts("lz4 compression error: input file is too large for single block archive.");
+        return CODEC_FAILURE;
+    }
+
+    buf_len = file_size;
+    compressed_len = lz4_compress_bound(buf_len);
+    if (compressed_len == 0 || work_buffer_reserve(&context->in, buf_len, NULL) != 0 ||
+            work_buffer_reserve(&context->out, LZ4_HEADER_SIZE + compressed_len, NULL) != 0) {
+        puts("lz4 compression error: problem with allocating memory for buffers.");
+        return CODEC_FAILURE;
+    }
+
+    if (fread(context->in.data, 1, buf_len, source) != buf_len) {
+        puts("lz4 compression error: problem with reading input file.");
+        return CODEC_FAILURE;
+    }
+
+    if (lz4_compress_buffer(ctx, context->in.data, buf_len, context->out.data + LZ4_HEADER_SIZE,
+                            &compressed_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    // Portable 32-bit size, the same byte order as in LZO archives.
+    header = context->out.data;
+    header[0] = (unsigned char)((buf_len >> 24) & 0xff);
+    header[1] = (unsigned char)((buf_len >> 16) & 0xff);
+    header[2] = (unsigned char)((buf_len >> 8) & 0xff);
+    header[3] = (unsigned char)(buf_len & 0xff);
+
+    compressed_len += LZ4_HEADER_SIZE;
+    if (fwrite(context->out.data, 1, compressed_len, arch) != compressed_len || ferror(arch)) {
+        puts("lz4 compression error: problem with writing to archive file");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Decompresses archive file to output file.
+ * @param ctx codec context
+ * @param arch archive file
+ * @param output_file output, decompressed file
+ * @param source_len source (uncompressed) data size, checked against archive header and output.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int lz4_decompress_file(void *ctx, FILE *arch, FILE *output_file, size_t source_len)
+{
+    lz4_context *context = (lz4_context*)ctx;
+    off_t file_size = get_file_size(arch);
+    size_t arch_len = file_size < 0 ? 0 : (size_t)file_size;
+    size_t header_len, uncompressed_len;
+    const unsigned char *header;
+
+    if (arch_len < LZ4_HEADER_SIZE || work_buffer_reserve(&context->in, arch_len, NULL) != 0) {
+        puts("lz4 decompression error: problem with allocating memory for archive buffer.");
+        return CODEC_FAILURE;
+    }
+
+    if (fread(context->in.data, 1, arch_len, arch) != arch_len) {
+        puts("lz4 decompression error: problem with reading archive file.");
+        return CODEC_FAILURE;
+    }
+
+    header = context->in.data;
+    header_len = (size_t)header[0] << 24 | (size_t)header[1] << 16 | (size_t)header[2] << 8 | header[3];
+    if (header_len != source_len) {
+        puts("lz4 decompression error: archive header doesn't match source size.");
+        return CODEC_FAILURE;
+    }
+
+    uncompressed_len = header_len;
+    if (work_buffer_reserve(&context->out, uncompressed_len, NULL) != 0) {
+        puts("lz4 decompression error: problem with allocating memory for output buffer.");
+        return CODEC_FAILURE;
+    }
+
+    if (lz4_decompress_buffer(ctx, context->in.data + LZ4_HEADER_SIZE, arch_len - LZ4_HEADER_SIZE,
+                              context->out.data, &uncompressed_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+    if (uncompressed_len != header_len) {
+        puts("lz4 decompression error: archive is truncated.");
+        return CODEC_FAILURE;
+    }
+
+    if (fwrite(context->out.data, 1, uncompressed_len, output_file) != uncompressed_len || ferror(output_file)) {
+        puts("lz4 decompression error: problem with writing to output file");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int lz4_reserve(void *ctx, arena *a, size_t source_len)
+{
+    lz4_context *context = (lz4_context*)ctx;
+    size_t buf_len = LZ4_HEADER_SIZE + lz4_compress_bound(source_len);
+
+    // Input buffer holds source file or archive, output buffer archive or decompressed data.
+    if (!get_state(context, a) || work_buffer_reserve(&context->in, buf_len, a) != 0 ||
+            work_buffer_reserve(&context->out, buf_len, a) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static void lz4_teardown(void *ctx)
+{
+    lz4_context *context = (lz4_context*)ctx;
+
+    work_buffer_free(&context->state);
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    free(context);
+}
+
+// Level 1 - LZ4, levels 3 to 12 - LZ4HC (lower LZ4HC levels are the same as 3).
+static const int lz4_levels[] = { 1, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, -1 };
+
+const codec lz4_codec = {
+    .name = "lz4",
+    .extension = ".lz4",
+    .min_level = 1,
+    .max_level = LZ4HC_CLEVEL_MAX,
+    .low_level = 1,
+    .high_level = LZ4HC_CLEVEL_MAX,
+    .levels = lz4_levels,
+    .dictionary = 1,
+    .max_source_len = LZ4_MAX_INPUT_SIZE,
+    .init = lz4_init,
+    .compress_bound = lz4_compress_bound,
+    .compress = lz4_compress_buffer,
+    .decompress = lz4_decompress_buffer,
+    .compress_file = lz4_compress_file,
+    .decompress_file = lz4_decompress_file,
+    .reserve = lz4_reserve,
+    .teardown = lz4_teardown
+};
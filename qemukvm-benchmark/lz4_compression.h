@@ -0,0 +1,11 @@
+// Compression levels: 1 - LZ4 (fast), 3 to 12 - LZ4HC.
+
+#ifndef LZ4_COMPRESSION_H
+#define LZ4_COMPRESSION_H
+
+#include "codec.h"
+
+// lz4 backend.
+extern const codec lz4_codec;
+
+#endif // LZ4_COMPRESSION_H
@@ -2,18 +2,111 @@
 
 #include "lzo_compression.h"
 #include "util.h"
+#include "arena.h"
 #include <lzo/lzoconf.h>
 #include <lzo/lzoutil.h>
 #include <lzo/lzo1x.h>
+#include <lzo/lzo1y.h>
+#include <lzo/lzo1f.h>
+#include <lzo/lzo2a.h>
 #include <stdlib.h>
 #include <string.h>
 
-static float mean_compression_time;
-static float mean_compression_ratio;
-static float mean_decompression_time;
+// Block size of archive file.
+#define LZO_BLOCK_SIZE (256 * 1024L)
 
-static unsigned long total_in;
-static unsigned long total_out;
+// Worst case expansion of incompressible data (LZO2A, other algorithms expand less).
+#define LZO_BOUND(len) ((len) + (len) / 8 + 128 + 3)
+
+// Size of compressed block buffer of file functions.
+#define LZO_BLOCK_BUFFER_SIZE LZO_BOUND(LZO_BLOCK_SIZE)
+
+/**
+ * LZO algorithm and its compression level. Method id is stored in archive header,
+ * so decompressor knows the algorithm.
+ */
+typedef struct {
+    const char *name;
+    int id;                 // Method byte of archive header.
+    int level;              // Level byte of archive header.
+    lzo_uint32 wrkmem_size; // Work memory size of compressor.
+    lzo_compress_t compress;
+    lzo_decompress_t decompress;        // Without checks of input, faster.
+    lzo_decompress_t decompress_safe;   // Checks input and output bounds.
+} lzo_method;
+
+// Methods 1-3 are the same as in lzop.
+static const lzo_method lzo_methods[] = {
+    { "lzo1x_1", 1, 1, LZO1X_1_MEM_COMPRESS, lzo1x_1_compress, lzo1x_decompress, lzo1x_decompress_safe },
+    { "lzo1x_1_15", 2, 1, LZO1X_1_15_MEM_COMPRESS, lzo1x_1_15_compress, lzo1x_decompress, lzo1x_decompress_safe },
+    { "lzo1x_999", 3, 9, LZO1X_999_MEM_COMPRESS, lzo1x_999_compress, lzo1x_decompress, lzo1x_decompress_safe },
+    { "lzo1x_1_11", 4, 1, LZO1X_1_11_MEM_COMPRESS, lzo1x_1_11_compress, lzo1x_decompress, lzo1x_decompress_safe },
+    { "lzo1x_1_12", 5, 1, LZO1X_1_12_MEM_COMPRESS, lzo1x_1_12_compress, lzo1x_decompress, lzo1x_decompress_safe },
+    { "lzo1y_1", 6, 1, LZO1Y_MEM_COMPRESS, lzo1y_1_compress, lzo1y_decompress, lzo1y_decompress_safe },
+    { "lzo1y_999", 7, 9, LZO1Y_999_MEM_COMPRESS, lzo1y_999_compress, lzo1y_decompress, lzo1y_decompress_safe },
+    { "lzo1f_1", 8, 1, LZO1F_MEM_COMPRESS, lzo1f_1_compress, lzo1f_decompress, lzo1f_decompress_safe },
+    { "lzo1f_999", 9, 9, LZO1F_999_MEM_COMPRESS, lzo1f_999_compress, lzo1f_decompress, lzo1f_decompress_safe },
+    { "lzo2a_999", 10, 9, LZO2A_999_MEM_COMPRESS, lzo2a_999_compress, lzo2a_decompress, lzo2a_decompress_safe },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+typedef struct {
+    const lzo_method *method;
+    int unsafe;         // Decompression with lzo*_decompress instead of lzo*_decompress_safe.
+    work_buffer wrkmem; // Work memory for compression.
+    work_buffer in;     // Block buffers of file functions.
+    work_buffer out;
+} lzo_context;
+
+/**
+ * @brief Finds method by name or archive header id.
+ * @param name method name, NULL to find by id
+ * @param id method id
+ * @return Returns method or NULL if there is no such method.
+ */
+static const lzo_method *find_method(const char *name, int id)
+{
+    for (int i = 0; lzo_methods[i].name; ++i) {
+        if (name ? !strcmp(lzo_methods[i].name, name) : lzo_methods[i].id == id) {
+            return &lzo_methods[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Decompresses block or buffer with algorithm of method.
+ * @param context LZO context
+ * @param method method of compressed data
+ * @param source compressed data
+ * @param source_len compressed data size
+ * @param dest output buffer
+ * @param dest_len output buffer size on input, decompressed data size on output
+ * @return Returns LZO_E_OK on success or LZO error code.
+ */
+static int decompress_method(const lzo_context *context, const lzo_method *method, const unsigned char *source,
+                             lzo_uint source_len, unsigned char *dest, lzo_uint *dest_len)
+{
+    lzo_decompress_t decompress = context->unsafe ? method->decompress : method->decompress_safe;
+
+    return decompress((lzo_bytep)source, source_len, dest, dest_len, NULL);
+}
+
+/**
+ * @brief Gets work memory for compression, allocated on first use.
+ * @param context LZO context
+ * @return Returns work memory or NULL if something go wrong.
+ */
+static lzo_voidp get_wrkmem(lzo_context *context)
+{
+    if (work_buffer_reserve(&context->wrkmem, context->method->wrkmem_size, NULL) != 0) {
+        puts("LZO error: problem with allocations.");
+        return NULL;
+    }
+
+    return context->wrkmem.data;
+}
 
 static const unsigned char lzo_header[7] =
     { 0x00, 0xe9, 0x4c, 0x5a, 0x4f, 0xff, 0x1a };
@@ -25,20 +118,19 @@ static const unsigned char lzo_header[7] =
  * @param buf data buffer
  * @param len buffer size
  * @param allow_eof flag - allows end of file
- * @return Returns number of read elements.
+ * @return Returns number of read elements or -1 on read error or short read (without allow_eof).
  */
-static int xread(FILE *fp, lzo_voidp buf, lzo_uint32 len, lzo_bool allow_eof)
+static long xread(FILE *fp, lzo_voidp buf, lzo_uint32 len, lzo_bool allow_eof)
 {
     lzo_uint32 l;
 
     l = (lzo_uint32)lzo_fread(fp, buf, len);
 
-    if (l > len || (l != len && !allow_eof)) {
+    if (l > len || (l != len && !allow_eof) || ferror(fp)) {
         puts("LZO error: problem with reading.");
-        return LZO_FAILURE;
+        return -1;
     }
 
-    total_in += l;
     return l;
 }
 
@@ -53,27 +145,27 @@ static void xwrite(FILE *fp, const lzo_voidp buf, lzo_uint32 len)
     if (fp != NULL && lzo_fwrite(fp, buf, len) != len){
         puts("LZO error: problem with writing.");
     }
-
-    total_out += (unsigned long) len;
 }
 
 /**
  * @brief Reads portable 32-bit integer from file.
  * @param fp input file
- * @return Returns 32-bit integer.
+ * @param v read 32-bit integer
+ * @return Returns 0 on success or -1 on read error or end of file.
  */
-static lzo_uint32 xread32(FILE *fp)
+static int xread32(FILE *fp, lzo_uint32 *v)
 {
     unsigned char b[4];
-    lzo_uint32 v;
 
-    xread(fp, b, 4, 0);
-    v = (lzo_uint32) b[3] << 0;
-    v |= (lzo_uint32) b[2] << 8;
-    v |= (lzo_uint32) b[1] << 16;
-    v |= (lzo_uint32) b[0] << 24;
+    if (xread(fp, b, 4, 0) < 0) {
+        return -1;
+    }
+    *v = (lzo_uint32) b[3] << 0;
+    *v |= (lzo_uint32) b[2] << 8;
+    *v |= (lzo_uint32) b[1] << 16;
+    *v |= (lzo_uint32) b[0] << 24;
 
-    return v;
+    return 0;
 }
 
 /**
@@ -95,12 +187,15 @@ static void xwrite32(FILE *fp, lzo_xint v)
 /**
  * @brief Gets character from file
  * @param fp file
- * @return Returns character from given file.
+ * @return Returns character from given file or -1 on read error or end of file.
  */
-int xgetc(FILE *fp)
+static int xgetc(FILE *fp)
 {
     unsigned char c;
-    xread(fp, (lzo_voidp) &c, 1, 0);
+
+    if (xread(fp, (lzo_voidp) &c, 1, 0) < 0) {
+        return -1;
+    }
     return c;
 }
 
@@ -109,7 +204,7 @@ int xgetc(FILE *fp)
  * @param fp file
  * @param c character to put
  */
-void xputc(FILE *fp, int c)
+static void xputc(FILE *fp, int c)
 {
     unsigned char cc = (unsigned char)(c & 0xff);
     xwrite(fp, (const lzo_voidp) &cc, 1);
@@ -117,70 +212,59 @@ void xputc(FILE *fp, int c)
 
 /**
  * @brief Compresses source file into archive file.
+ * @param ctx codec context
  * @param source source file
  * @param arch archive file
- * @param level compression level
- * @param block_size block size
- * @return Returns LZO_SUCCESS on success or LZO_FAILURE if something go wrong.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
  */
-static int compress(FILE *source, FILE *arch, int level, lzo_uint32 block_size)
+static int lzo_compress_file(void *ctx, FILE *source, FILE *arch)
 {
-    struct timespec start_ts, stop_ts;
+    lzo_context *context = (lzo_context*)ctx;
+    const lzo_method *method = context->method;
     int ret;
+    lzo_uint32 block_size = LZO_BLOCK_SIZE;
     lzo_bytep in = NULL;
     lzo_bytep out = NULL;
-    lzo_voidp wrkmem = NULL;
+    long read_len;
     lzo_uint in_len, out_len;
     lzo_uint32 flags = 1;
-    int method = 1;
-    lzo_uint32 wrk_len;
-
-    // Write LZO header, flags, compression level, block size
-    xwrite(arch, lzo_header, sizeof(lzo_header));
-    xwrite32(arch, flags);
-    xputc(arch, method);
-    xputc(arch, level);
-    xwrite32(arch, block_size);
+    lzo_voidp wrkmem = get_wrkmem(context);
 
     // Allocations
-    in = (lzo_bytep)malloc(sizeof(lzo_byte) * block_size);
-    out = (lzo_bytep)malloc(sizeof(lzo_byte) * (block_size + block_size / 8 + 64 +3));
-    if (level == 9) {
-        wrk_len = LZO1X_999_MEM_COMPRESS;
-    } else {
-        wrk_len = LZO1X_1_MEM_COMPRESS;
-    }
-
-    wrkmem = (lzo_voidp)malloc(wrk_len);
-    if (!in || !out || !wrkmem) {
+    if (!wrkmem || work_buffer_reserve(&context->in, block_size, NULL) != 0 ||
+            work_buffer_reserve(&context->out, LZO_BLOCK_BUFFER_SIZE, NULL) != 0) {
         puts("LZO error: problem with allocations.");
+        return CODEC_FAILURE;
+    }
+    in = context->in.data;
+    out = context->out.data;
 
-        lzo_free(in);
-        lzo_free(out);
-        lzo_free(wrkmem);
-        return LZO_FAILURE;
+    // Write LZO header, flags, compression level, block size
+    xwrite(arch, (const lzo_voidp) lzo_header, sizeof(lzo_header));
+    xwrite32(arch, flags);
+    xputc(arch, method->id);
+    xputc(arch, method->level);
+    xwrite32(arch, block_size);
+    if (ferror(arch)) {
+        puts("LZO error: problem with writing to archive file.");
+        return CODEC_FAILURE;
     }
 
     // Compression
-    clock_gettime(CLOCK_REALTIME, &start_ts);
     while(1) {
-        in_len = xread(source, in, block_size, 1);
-        if (in_len == 0) {
-            break;
+        read_len = xread(source, in, block_size, 1);
+        if (read_len < 0) {
+            return CODEC_FAILURE;
         }
-
-        if (level == 9) {
-            ret = lzo1x_999_compress(in, in_len, out, &out_len, wrkmem);
-        } else {
-            ret = lzo1x_1_compress(in, in_len, out, &out_len, wrkmem);
+        if (read_len == 0) {
+            break;
         }
+        in_len = read_len;
 
-        if (ret != LZO_E_OK || out_len > in_len + in_len / 16 + 64 +3) {
+        ret = method->compress(in, in_len, out, &out_len, wrkmem);
+        if (ret != LZO_E_OK || out_len > LZO_BOUND(in_len)) {
             puts("LZO error: problem with compression.");
-            lzo_free(in);
-            lzo_free(out);
-            lzo_free(wrkmem);
-            return LZO_FAILURE;
+            return CODEC_FAILURE;
         }
 
         xwrite32(arch, in_len);
@@ -195,164 +279,346 @@ static int compress(FILE *source, FILE *arch, int level, lzo_uint32 block_size)
             xwrite32(arch, in_len);
             xwrite(arch, in, in_len);
         }
+
+        // Short write (full disk, full memory sink) fails the iteration instead of measuring a short archive.
+        if (ferror(arch)) {
+            puts("LZO error: problem with writing to archive file.");
+            return CODEC_FAILURE;
+        }
     }
 
     // Write EOF marker.
     xwrite32(arch, 0);
+    if (ferror(arch)) {
+        puts("LZO error: problem with writing to archive file.");
+        return CODEC_FAILURE;
+    }
 
-    // Print/measure stats.
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_compression_time += result_ts.tv_nsec / 1000000.0f;
-    mean_compression_ratio += (total_out / (float)total_in) * 100.0f;
-    total_out = 0;
-    total_in = 0;
-
-    lzo_free(in);
-    lzo_free(out);
-    lzo_free(wrkmem);
-
-    return LZO_SUCCESS;
+    return CODEC_SUCCESS;
 }
 
 /**
- * @brief Decompresses data from file and measures stats.
+ * @brief Decompresses data from archive file.
+ * @param ctx codec context
  * @param arch archive file
  * @param output output, decompressed file
- * @return Returns LZO_SUCCESS on success or LZO_FAILURE if something go wrong.
+ * @param source_len source (uncompressed) data size, checked against total size of decompressed blocks.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
  */
-static int decompress(FILE *arch, FILE *output)
+static int lzo_decompress_file(void *ctx, FILE *arch, FILE *output, size_t source_len)
 {
-    struct timespec start_ts, stop_ts;
+    lzo_context *context = (lzo_context*)ctx;
     int ret;
     unsigned char m[sizeof(lzo_header)];
     lzo_uint32 flags;
-    int method;
+    const lzo_method *method;
+    int method_id;
     int compression_level;
     lzo_uint32 block_size;
-    lzo_bytep buf = NULL;
-    lzo_uint32 buf_len;
+    size_t total_len = 0;
 
     // Check LZO header, read flags and block size
     if (xread(arch, m, sizeof(lzo_header), 1) != sizeof(lzo_header) ||
             memcmp(m, lzo_header, sizeof(lzo_header)) != 0) {
         puts("LZO decompression error: problem with reading LZO header.");
-        return LZO_FAILURE;
+        return CODEC_FAILURE;
     }
 
-    flags = xread32(arch);
-    method = xgetc(arch);
-    compression_level = xgetc(arch);
-    if (method != 1) {
+    if (xread32(arch, &flags) != 0 || (method_id = xgetc(arch)) < 0 || (compression_level = xgetc(arch)) < 0) {
+        puts("LZO decompression error: problem with reading LZO header.");
+        return CODEC_FAILURE;
+    }
+    (void)flags;
+    (void)compression_level;
+    method = find_method(NULL, method_id);
+    if (!method) {
         puts("LZO decompression error: invalid method");
-        return LZO_FAILURE;
+        return CODEC_FAILURE;
+    }
+    if (xread32(arch, &block_size) != 0) {
+        puts("LZO decompression error: problem with reading LZO header.");
+        return CODEC_FAILURE;
     }
-    block_size = xread32(arch);
     if (block_size < 1024 || block_size > 8*1024*1024L) {
         puts("LZO decompression error: invalid block size");
-        return LZO_FAILURE;
+        return CODEC_FAILURE;
     }
 
-    // Allocations.
-    buf_len = block_size + block_size / 16 + 64 +3;
-    buf = (lzo_bytep)malloc(sizeof(lzo_byte)*buf_len);
-    if (!buf) {
+    // Allocations. Compressed block is read into separate buffer, in-place decompression
+    // (as in lzopack) is safe only for LZO1X.
+    if (work_buffer_reserve(&context->in, block_size, NULL) != 0 ||
+            work_buffer_reserve(&context->out, block_size, NULL) != 0) {
         puts("LZO decompression error: problem with allocation");
-        return LZO_FAILURE;
+        return CODEC_FAILURE;
     }
 
     // Decompression
-    clock_gettime(CLOCK_REALTIME, &start_ts);
     while(1)
     {
-        lzo_bytep in;
-        lzo_bytep out;
-        lzo_uint in_len, out_len;
-
-        out_len = xread32(arch);
+        lzo_bytep in = context->in.data;
+        lzo_bytep out = context->out.data;
+        lzo_uint32 in_len, out_len;
+
+        // Truncated archive fails instead of passing stale buffer contents on to decompression or output.
+        if (xread32(arch, &out_len) != 0) {
+            puts("LZO decompression error: archive is truncated.");
+            return CODEC_FAILURE;
+        }
         // Exit on last block
         if (out_len == 0) {
             break;
         }
 
-        in_len = xread32(arch);
+        if (xread32(arch, &in_len) != 0) {
+            puts("LZO decompression error: archive is truncated.");
+            return CODEC_FAILURE;
+        }
         if (in_len > block_size || out_len > block_size || in_len == 0 || in_len > out_len) {
             puts("LZO decompression error: problem with block size - data corrupted");
-            lzo_free(buf);
-            return LZO_FAILURE;
+            return CODEC_FAILURE;
         }
 
-        // Place compressed block at the top of the buffer.
-        in = buf + buf_len - in_len;
-        out = buf;
-
-        xread(arch, in, in_len, 0);
+        if (xread(arch, in, in_len, 0) < 0) {
+            puts("LZO decompression error: archive is truncated.");
+            return CODEC_FAILURE;
+        }
 
         if (in_len < out_len) {
             lzo_uint new_len = out_len;
-            ret = lzo1x_decompress_safe(in, in_len, out, &new_len, NULL);
+            ret = decompress_method(context, method, in, in_len, out, &new_len);
             if (ret != LZO_E_OK || new_len != out_len) {
                 puts("LZO decompression error: compressed data violation");
-                lzo_free(buf);
-                return LZO_FAILURE;
+                return CODEC_FAILURE;
             }
             xwrite(output, out, out_len);
         }
         else {
             xwrite(output, in, in_len);
         }
+
+        if (ferror(output)) {
+            puts("LZO decompression error: problem with writing to output file.");
+            return CODEC_FAILURE;
+        }
+        total_len += out_len;
     }
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
 
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_decompression_time += result_ts.tv_nsec / 1000000.0f;
+    if (total_len != source_len) {
+        puts("LZO decompression error: decompressed data size mismatch.");
+        return CODEC_FAILURE;
+    }
 
-    lzo_free(buf);
-    return LZO_SUCCESS;
+    return CODEC_SUCCESS;
 }
 
-int run_lzo(FILE *source, FILE *arch, FILE *output, int compression_level, int iterations)
+static int lzo_init_context(void **ctx, int level, const codec_params *params)
 {
-    int ret, opt_compression_level;
-    lzo_uint32 opt_block_size = 256 * 1024L;
-
-    if (compression_level == HIGH_COMPRESSION) {
-        opt_compression_level = 9;
-    } else {
-        opt_compression_level = 1;
-    }
+    lzo_context *context;
 
     if (lzo_init() != LZO_E_OK) {
         puts("LZO error: lzo_init() failed.");
-        return LZO_FAILURE;
+        return CODEC_FAILURE;
     }
 
-    printf("LZO: compression level set on %d\n", opt_compression_level);
+    // Work memory is allocated on first use or by lzo_reserve().
+    context = (lzo_context*)calloc(1, sizeof(lzo_context));
+    if (!context) {
+        return CODEC_FAILURE;
+    }
 
-    for (int i = 0; i < iterations; ++i) {
-        ret = compress(source, arch, opt_compression_level, opt_block_size);
-        if (ret == LZO_FAILURE) {
-            return ret;
-        }
+    // Method given on command line overrides level: 1 - lzo1x_1, 9 - lzo1x_999.
+    context->method = params->method ? find_method(params->method, 0) : NULL;
+    if (!context->method) {
+        context->method = find_method(level == 9 ? "lzo1x_999" : "lzo1x_1", 0);
+    }
+    context->unsafe = params->unsafe;
+
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t lzo_compress_bound(size_t source_len)
+{
+    return LZO_BOUND(source_len);
+}
+
+static int lzo_compress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                               unsigned char *dest, size_t *dest_len)
+{
+    lzo_context *context = (lzo_context*)ctx;
+    lzo_uint len = *dest_len;
+    lzo_voidp wrkmem = get_wrkmem(context);
+    int ret;
 
-        rewind(source);
-        rewind(arch);
+    if (!wrkmem) {
+        return CODEC_FAILURE;
     }
 
-    printf("Mean compression ratio: %.2f%%\n", mean_compression_ratio / iterations);
-    printf("Mean compression time: %.3f ms\n", mean_compression_time / iterations);
+    // Whole buffer is compressed in one call.
+    ret = context->method->compress((lzo_bytep)source, source_len, dest, &len, wrkmem);
+    if (ret != LZO_E_OK) {
+        puts("LZO error: problem with compression.");
+        return CODEC_FAILURE;
+    }
 
-    rewind(arch);
-    for (int i = 0; i < iterations; ++i) {
-        ret = decompress(arch, output);
-        if (ret == LZO_FAILURE) {
-            return ret;
-        }
+    *dest_len = len;
+    return CODEC_SUCCESS;
+}
+
+static int lzo_decompress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                 unsigned char *dest, size_t *dest_len)
+{
+    lzo_context *context = (lzo_context*)ctx;
+    lzo_uint len = *dest_len;
+
+    if (decompress_method(context, context->method, source, source_len, dest, &len) != LZO_E_OK) {
+        puts("LZO decompression error: compressed data violation");
+        return CODEC_FAILURE;
+    }
+
+    *dest_len = len;
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Stores portable 32-bit integer in buffer.
+ * @param buf output buffer
+ * @param v 32-bit integer
+ */
+static void put32(unsigned char *buf, lzo_uint32 v)
+{
+    buf[0] = (unsigned char) ((v >> 24) & 0xff);
+    buf[1] = (unsigned char) ((v >> 16) & 0xff);
+    buf[2] = (unsigned char) ((v >> 8) & 0xff);
+    buf[3] = (unsigned char) ((v >> 0) & 0xff);
+}
+
+static size_t lzo_block_bound(size_t block_len)
+{
+    // Uncompressed and compressed block size followed by block data.
+    return 8 + lzo_compress_bound(block_len);
+}
+
+static size_t lzo_block_header(void *ctx, size_t block_size, unsigned char *dest)
+{
+    lzo_context *context = (lzo_context*)ctx;
+    lzo_uint32 flags = 1;
 
-        rewind(arch);
+    // The same header as in lzo_compress_file.
+    memcpy(dest, lzo_header, sizeof(lzo_header));
+    put32(dest + sizeof(lzo_header), flags);
+    dest[sizeof(lzo_header) + 4] = context->method->id;
+    dest[sizeof(lzo_header) + 5] = context->method->level;
+    put32(dest + sizeof(lzo_header) + 6, block_size);
+    return sizeof(lzo_header) + 10;
+}
+
+/**
+ * @brief Compresses block into the same block record as lzo_compress_file writes.
+ * LZO blocks are independent, dictionary and checksum are not used.
+ */
+static int lzo_compress_block(void *ctx, const unsigned char *dict, size_t dict_len,
+                              const unsigned char *block, size_t block_len, int last,
+                              unsigned char *dest, size_t *dest_len, unsigned long *check)
+{
+    size_t out_len = *dest_len - 8;
+
+    *check = 0;
+
+    // Empty block would be read as EOF marker.
+    if (block_len == 0) {
+        *dest_len = 0;
+        return CODEC_SUCCESS;
+    }
+
+    if (lzo_compress_buffer(ctx, block, block_len, dest + 8, &out_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    put32(dest, block_len);
+
+    // Not compressible - store uncompressed block.
+    if (out_len >= block_len) {
+        out_len = block_len;
+        memcpy(dest + 8, block, block_len);
     }
+    put32(dest + 4, out_len);
 
-    printf("Mean decompression time: %.3f ms\n", mean_decompression_time / iterations);
+    *dest_len = 8 + out_len;
+    return CODEC_SUCCESS;
+}
 
-    return LZO_SUCCESS;
+static unsigned long lzo_combine_check(unsigned long check, unsigned long block_check, size_t block_len)
+{
+    return 0;
 }
+
+static size_t lzo_block_trailer(void *ctx, unsigned long check, unsigned char *dest)
+{
+    // EOF marker.
+    put32(dest, 0);
+    return 4;
+}
+
+static const block_codec lzo_block_codec = {
+    .min_block_size = 1024,
+    .max_block_size = 8 * 1024 * 1024L,   // Limit checked by lzo_decompress_file.
+    .block_bound = lzo_block_bound,
+    .header = lzo_block_header,
+    .compress_block = lzo_compress_block,
+    .combine_check = lzo_combine_check,
+    .trailer = lzo_block_trailer
+};
+
+static int lzo_reserve(void *ctx, arena *a, size_t source_len)
+{
+    lzo_context *context = (lzo_context*)ctx;
+
+    // File functions work on blocks, so their buffers don't depend on source size.
+    if (work_buffer_reserve(&context->wrkmem, context->method->wrkmem_size, a) != 0 ||
+            work_buffer_reserve(&context->in, LZO_BLOCK_SIZE, a) != 0 ||
+            work_buffer_reserve(&context->out, LZO_BLOCK_BUFFER_SIZE, a) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static const char *lzo_method_name(int i)
+{
+    return i >= 0 && i < (int)(sizeof(lzo_methods) / sizeof(lzo_methods[0])) ? lzo_methods[i].name : NULL;
+}
+
+static void lzo_teardown(void *ctx)
+{
+    lzo_context *context = (lzo_context*)ctx;
+
+    work_buffer_free(&context->wrkmem);
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    free(context);
+}
+
+// Level 1 - lzo1x_1, level 9 - lzo1x_999, other algorithms are selected with --method.
+static const int lzo_levels[] = { 1, 9, -1 };
+
+const codec lzo_codec = {
+    .name = "lzo",
+    .extension = ".lzo",
+    .min_level = 1,
+    .max_level = 9,
+    .low_level = 1,
+    .high_level = 9,
+    .levels = lzo_levels,
+    .method_name = lzo_method_name,
+    .unsafe_decompress = 1,
+    .init = lzo_init_context,
+    .compress_bound = lzo_compress_bound,
+    .compress = lzo_compress_buffer,
+    .decompress = lzo_decompress_buffer,
+    .compress_file = lzo_compress_file,
+    .decompress_file = lzo_decompress_file,
+    .reserve = lzo_reserve,
+    .teardown = lzo_teardown,
+    .block = &lzo_block_codec
+};
@@ -1,56 +1,200 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "util.h"
-#include "zlib_compression.h"
+#include "codec.h"
+#include "benchmark.h"
+#include "threads.h"
+#include "parallel.h"
+#include "report.h"
+#include "corpus.h"
+#include "input.h"
+#include "sink.h"
+#include "sweep.h"
+#include "steal.h"
+#include "synthetic.h"
+#include "migration.h"
+#include "latency.h"
+#include "streams.h"
+#include "pipeline.h"
+#include "timer.h"
 #include "bzip2_compression.h"
-#include "snappy_compression.h"
-#include "lzo_compression.h"
 
 void usage(void)
 {
-    printf("Usage:\n\tqemukvm-benchmark [options] source_path\noptions:\n");
+    printf("Usage:\n\tqemukvm-benchmark [options] source_path\n");
+    printf("source_path can be a file or a directory (corpus, all files are benchmarked in one process)\noptions:\n");
     printf("-l - low compression\n-h - high compression\n");
-    printf("-t number - iterations\n");
-    printf("--zlib - ZLIB compression\n");
-    printf("--bzip2 - BZIP2 compression\n");
-    printf("--snappy - Snappy compression\n");
-    printf("--lzo - LZO compression\n\n");
+    printf("--levels list - sweep of codec's own levels, e.g. 1-9 or 1,3,6-9 (codecs run levels they support)\n");
+    printf("-t number - iterations (minimum iterations in calibration mode)\n");
+    printf("--warmup number - discarded iterations after the first (cold) one\n");
+    printf("--time-budget ms - calibration: iterate until total measured time reaches budget\n");
+    printf("--rel-error percent - calibration: iterate until relative error of the mean drops below threshold\n"
+           "    (calibration is not supported with --threads, --latency and --streams)\n");
+    for (int i = 0; codecs[i]; ++i) {
+        printf("--%s - %s compression\n", codecs[i]->name, codecs[i]->name);
+    }
+    printf("(no library option - all libraries)\n");
+    printf("--in-memory - codec-only benchmark, buffer-to-buffer without file I/O in timed region\n");
+    printf("--threads number - codec-only benchmark on given number of threads pinned to distinct CPUs\n");
+    printf("--parallel number - parallel block compression on given number of threads (zlib, lzo)\n");
+    printf("--block-size size - block size of parallel compression, e.g. 256K (default)\n");
+    printf("--pages size - migration workload: every page (4K or 2M) compressed on its own, zero pages skipped\n");
+    printf("--latency - latency histogram of single compress/decompress calls of 512 B to 64 KB buffers\n");
+    printf("--streams number - multi-stream mode: producer queues (file, library, level) jobs for given number of workers\n");
+    printf("--pipeline auto|uring|threads - pipelined end-to-end mode: reads and writes of blocks (--block-size)\n"
+           "    overlap compression, I/O with io_uring or reader and writer threads (zlib, lzo)\n");
+    printf("--input stdio|read|mmap - input path of end-to-end benchmark: codec reads file (default),\n"
+           "    whole file is read() into buffer or mapped and passed to codec\n");
+    printf("--populate - prefault mapped input (MAP_POPULATE)\n");
+    printf("--drop-cache - drop page cache of input file before every iteration, so input is read from device\n"
+           "    (end-to-end and pipelined modes)\n");
+    printf("--madvise none|sequential|willneed|hugepage - advice for mapped input\n");
+    printf("--sink file|tmpfs|memory|null - destination of archive and decompressed output: files next to input\n"
+           "    (default), files in tmpfs directory, memory buffers, or archive in memory and output discarded\n");
+    printf("--sink-dir dir - directory of tmpfs sink (default %s)\n", SINK_TMPFS_DIR);
+    printf("--fsync - fsync() archive and output at the end of every iteration, inside timed region\n");
+    printf("--direct - archive and output opened with O_DIRECT (bypass page cache)\n");
+    printf("--chunk size - streaming buffer size of zlib and bzip2 file functions, 4K to 16M (default 256K)\n");
+    for (int i = 0; codecs[i]; ++i) {
+        const char *method;
+
+        if (!codecs[i]->method_name) {
+            continue;
+        }
+        printf("--method name - %s algorithm instead of level:", codecs[i]->name);
+        for (int j = 0; (method = codecs[i]->method_name(j)); ++j) {
+            printf(" %s", method);
+        }
+        printf("\n");
+    }
+    printf("--unsafe - decompression without checks of input (lzo)\n");
+    printf("--work-factor number - effort on repetitive data before fallback sorting, 0 to %d (bzip2,\n"
+           "    0 - library default of 30)\n", BZIP2_WORK_FACTOR_MAX);
+    printf("--small - decompression with less memory, at lower speed (bzip2)\n");
+    printf("--dictionary file - compression dictionary (zstd, lz4 - last 64 KB)\n");
+    printf("--workers number - codec's own compression threads (zstd, needs multithreaded libzstd)\n");
+    printf("--verify - check every decompressed output against CRC32C of source (outside timed region)\n");
+    printf("--perf - count cycles, instructions, cache, branch and dTLB misses, context switches and page faults\n"
+           "    of every timed region (software events only if hardware counters are not available),\n"
+           "    single-threaded modes only\n");
+    printf("--max-steal percent - flag iterations with steal time above percent of their time (default %.0f)\n",
+           STEAL_THRESHOLD);
+    printf("--discard-steal - discard and repeat flagged iterations\n"
+           "    (steal options are not supported with --threads, --latency and --streams)\n");
+    printf("--manifest file - corpus of files listed in manifest (one path per line)\n");
+    printf("--synthetic spec - generated in-memory input instead of file, comma separated key=value:\n"
+           "    size (default 16M), entropy (bits per byte, default 8), repeat-distance, repeat-fraction (default 0.5),\n"
+           "    zero-fraction, duplicate-fraction (of 4K pages), seed (default 1)\n");
+    printf("--format json|csv - write machine-readable results (default file results.json or results.csv)\n");
+    printf("--output file - result file, records are appended (format by extension if --format is not set)\n\n");
 }
 
 void print_configuration(bench_options options)
 {
     printf("Iterations set to %d\n", options.iterations);
-    if (options.level == LOW_COMPRESSION) {
+    printf("Warm-up iterations set to %d\n", options.warmup);
+    if (options.time_budget > 0.0 || options.rel_error > 0.0) {
+        printf("Calibration: time budget %.1f ms, relative error %.2f%%\n", options.time_budget, options.rel_error);
+    }
+    if (options.discard_steal) {
+        printf("Iterations with steal time above %.1f%% are discarded\n", options.max_steal);
+    }
+    if (options.drop_cache) {
+        puts("Page cache of input is dropped before every iteration.");
+    }
+    if (options.levels_count) {
+        printf("Compression levels set to sweep of %d levels.\n", options.levels_count);
+    } else if (options.level == LOW_COMPRESSION) {
         puts("Compression level set to low.");
     } else {
         puts("Compression level set to high.");
     }
 
-    switch(options.library) {
-    case LIB_ZLIB:
-        puts("Library set to zlib");
-        break;
-    case LIB_BZIP2:
-        puts("Library set to bzip2");
-        break;
-    case LIB_SNAPPY:
-        puts("Library set to snappy");
-        break;
-    case LIB_LZO:
-        puts("Library set to lzo");
-        break;
-    default:
-        break;
+    if (options.params.method) {
+        printf("Method set to %s\n", options.params.method);
+    }
+    if (options.params.unsafe) {
+        puts("Decompression set to unsafe (without checks of input).");
+    }
+    if (options.params.work_factor) {
+        printf("Work factor set to %d\n", options.params.work_factor);
+    }
+    if (options.params.small) {
+        puts("Decompression set to small (less memory).");
+    }
+
+    if (options.library) {
+        printf("Library set to %s\n", options.library->name);
+    } else {
+        puts("Library set to all");
+    }
+
+    if (options.threads) {
+        printf("Mode set to in-memory (codec only) on %d threads.\n", options.threads);
+    } else if (options.streams) {
+        printf("Mode set to multi-stream on %d workers.\n", options.streams);
+    } else if (options.parallel) {
+        printf("Mode set to parallel block compression on %d threads, block size %zu.\n",
+               options.parallel, options.block_size);
+    } else if (options.pipeline) {
+        printf("Mode set to pipelined end-to-end (%s), block size %zu.\n", pipeline_backend_name(options.pipeline),
+               options.block_size);
+    } else if (options.in_memory) {
+        puts("Mode set to in-memory (codec only).");
+    } else {
+        puts("Mode set to end-to-end (file to file).");
+    }
+
+    if (!options.in_memory && !options.page_size && !options.latency && !options.streams) {
+        char sink[32];
+
+        printf("Sink set to %s", sink_describe(&options.sink, sink, sizeof(sink)));
+        if (options.sink.type == SINK_TMPFS) {
+            printf(" in %s", options.sink.dir);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * @brief Gets value of option which requires an argument. Exits if there is no value.
+ * @param argc arguments count
+ * @param argv arguments
+ * @param i index of option, moved to its value
+ * @return Returns option value.
+ */
+static char *option_value(int argc, char **argv, int *i)
+{
+    if (*i + 1 >= argc) {
+        printf("Error: option %s requires an argument.\n", argv[*i]);
+        exit(1);
     }
+
+    return argv[++(*i)];
 }
 
-void get_options(int argc, char **argv, bench_options *options, char *input_file_name)
+void get_options(int argc, char **argv, bench_options *options, char *input_file_name, int *format,
+                 const char **output_file_name, const char **manifest_name, const char **dictionary_name, int *perf,
+                 const char **synthetic)
 {
+    static int levels[LEVELS_MAX];
+
     for (int i = 1; i < argc; ++i) {
         // Iterations
         if (!strcmp(argv[i], "-t")) {
-            options->iterations = atoi(argv[i+1]);
+            options->iterations = atoi(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--warmup")) {
+            options->warmup = atoi(option_value(argc, argv, &i));
+        }
+        // Calibration
+        else if (!strcmp(argv[i], "--time-budget")) {
+            options->time_budget = atof(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--rel-error")) {
+            options->rel_error = atof(option_value(argc, argv, &i));
         }
         // Compression
         else if (!strcmp(argv[i], "-l")) {
@@ -59,138 +203,366 @@ void get_options(int argc, char **argv, bench_options *options, char *input_file
         else if (!strcmp(argv[i], "-h")) {
             options->level = HIGH_COMPRESSION;
         }
-        // Libraries
-        else if (!strcmp(argv[i], "--zlib")) {
-            options->library = LIB_ZLIB;
+        else if (!strcmp(argv[i], "--levels")) {
+            options->levels_count = parse_levels(option_value(argc, argv, &i), levels);
+            if (options->levels_count <= 0) {
+                printf("Error: invalid levels %s.\n", argv[i]);
+                exit(1);
+            }
+            options->levels = levels;
+        }
+        // Mode
+        else if (!strcmp(argv[i], "--in-memory")) {
+            options->in_memory = 1;
+        }
+        else if (!strcmp(argv[i], "--threads")) {
+            options->threads = atoi(option_value(argc, argv, &i));
+            options->in_memory = 1;
+        }
+        else if (!strcmp(argv[i], "--parallel")) {
+            options->parallel = atoi(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--block-size")) {
+            options->block_size = parse_size(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--latency")) {
+            options->latency = 1;
+        }
+        else if (!strcmp(argv[i], "--streams")) {
+            options->streams = atoi(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--pipeline")) {
+            options->pipeline = pipeline_backend(option_value(argc, argv, &i));
+            if (options->pipeline < 0) {
+                printf("Error: unknown pipeline backend %s.\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--pages")) {
+            options->page_size = parse_size(option_value(argc, argv, &i));
+            if (options->page_size < MIGRATION_PAGE_MIN || options->page_size > MIGRATION_PAGE_MAX ||
+                    (options->page_size & (options->page_size - 1))) {
+                puts("Error: page size must be a power of two in the range of 4K to 2M.");
+                exit(1);
+            }
+        }
+        // Input
+        else if (!strcmp(argv[i], "--input")) {
+            options->input = input_method(option_value(argc, argv, &i));
+            if (options->input < 0) {
+                printf("Error: unknown input method %s.\n", argv[i]);
+                exit(1);
+            }
         }
-        else if (!strcmp(argv[i], "--bzip2")) {
-            options->library = LIB_BZIP2;
+        else if (!strcmp(argv[i], "--populate")) {
+            options->populate = 1;
         }
-        else if (!strcmp(argv[i], "--snappy")) {
-            options->library = LIB_SNAPPY;
+        else if (!strcmp(argv[i], "--drop-cache")) {
+            options->drop_cache = 1;
         }
-        else if (!strcmp(argv[i], "--lzo")) {
-            options->library = LIB_LZO;
+        else if (!strcmp(argv[i], "--madvise")) {
+            options->advice = input_advice(option_value(argc, argv, &i));
+            if (options->advice < 0) {
+                printf("Error: unknown advice %s.\n", argv[i]);
+                exit(1);
+            }
+        }
+        // Sink
+        else if (!strcmp(argv[i], "--sink")) {
+            options->sink.type = sink_type(option_value(argc, argv, &i));
+            if (options->sink.type < 0) {
+                printf("Error: unknown sink %s.\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--sink-dir")) {
+            options->sink.dir = option_value(argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "--fsync")) {
+            options->sink.sync = 1;
+        }
+        else if (!strcmp(argv[i], "--direct")) {
+            options->sink.direct = 1;
+        }
+        else if (!strcmp(argv[i], "--chunk")) {
+            options->params.chunk_size = parse_size(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--method")) {
+            options->params.method = option_value(argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "--unsafe")) {
+            options->params.unsafe = 1;
+        }
+        else if (!strcmp(argv[i], "--work-factor")) {
+            options->params.work_factor = atoi(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--small")) {
+            options->params.small = 1;
+        }
+        else if (!strcmp(argv[i], "--dictionary")) {
+            *dictionary_name = option_value(argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "--workers")) {
+            options->params.workers = atoi(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--verify")) {
+            options->verify = 1;
+        }
+        else if (!strcmp(argv[i], "--perf")) {
+            *perf = 1;
+        }
+        else if (!strcmp(argv[i], "--max-steal")) {
+            options->max_steal = atof(option_value(argc, argv, &i));
+        }
+        else if (!strcmp(argv[i], "--discard-steal")) {
+            options->discard_steal = 1;
+        }
+        else if (!strcmp(argv[i], "--synthetic")) {
+            *synthetic = option_value(argc, argv, &i);
+        }
+        else if (!strcmp(argv[i], "--manifest")) {
+            *manifest_name = option_value(argc, argv, &i);
+        }
+        // Results
+        else if (!strcmp(argv[i], "--format")) {
+            *format = report_format(option_value(argc, argv, &i));
+            if (*format == REPORT_NONE) {
+                printf("Error: unknown format %s.\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--output")) {
+            *output_file_name = option_value(argc, argv, &i);
+        }
+        // Libraries
+        else if (!strncmp(argv[i], "--", 2) && find_codec(argv[i] + 2)) {
+            options->library = find_codec(argv[i] + 2);
         }
         else {
-            strcpy(input_file_name, argv[i]);
+            snprintf(input_file_name, FILENAME_MAX, "%s", argv[i]);
         }
     }
 }
 
-int run_benchmark(FILE *source, char *file_name, bench_options options)
+/**
+ * @brief Runs benchmark of corpus, of single input file or of synthetic data with all selected codecs and levels.
+ * @param options benchmark options
+ * @param format result file format
+ * @param output_file_name result file, NULL if format is REPORT_NONE
+ * @param manifest_name corpus manifest or NULL
+ * @param synthetic synthetic data specification or NULL
+ * @param all_levels run corpus on both low and high compression level
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+static int run_benchmark(bench_options options, int format, const char *output_file_name, const char *manifest_name,
+                         const synthetic_spec *synthetic, int all_levels)
 {
-    FILE *archfile, *outputfile;
-    char arch_file_name[100];
-    char output_file_name[100];
-    strcpy(arch_file_name, file_name);
-
-    switch(options.library) {
-    case LIB_ZLIB:
-        strcat(arch_file_name, ".zlib");
-        strcpy(output_file_name, arch_file_name);
-        strcat(output_file_name, "_dec");
-        archfile = fopen(arch_file_name, "w+");
-        if (!archfile) {
-            puts("Error: problem with opening archive file.");
-            return 1;
-        }
+    const char *input_name = options.input_name;
+    FILE *infile = NULL;
+    struct stat st;
+    corpus corp;
+    level_sweep sweep;
+    unsigned char *buf = NULL;
+    size_t source_len = 0;
+    int whole_input;
+    int ret = 0;
 
-        outputfile = fopen(output_file_name, "w+");
+    // Synthetic data is generated in memory, so it is benchmarked in-memory (or on threads).
+    if (synthetic) {
+        struct timespec start_ts, stop_ts;
 
-        if (!outputfile) {
-            puts("Error: problem with opening output file.");
-            fclose(archfile);
+        get_time(&start_ts);
+        buf = generate_synthetic(synthetic);
+        get_time(&stop_ts);
+        if (!buf) {
             return 1;
         }
+        source_len = synthetic->size;
+        printf("Synthetic input: %zu bytes generated in %.3f ms\n", source_len, elapsed_ns(start_ts, stop_ts) / 1e6);
 
-        run_zlib(source, archfile, outputfile, options.level, options.iterations);
-        fclose(archfile);
-        fclose(outputfile);
-        break;
-    case LIB_BZIP2:
-        strcat(arch_file_name, ".bz2");
-        strcpy(output_file_name, arch_file_name);
-        strcat(output_file_name, "_dec");
-        archfile = fopen(arch_file_name, "w+");
-        if (!archfile) {
-            puts("Error: problem with opening archive file.");
+        input_name = options.input_name = synthetic->name;
+        options.in_memory = 1;
+        if (format != REPORT_NONE && report_open(format, output_file_name) != 0) {
+            free(buf);
+            return 1;
+        }
+    }
+    // Corpus: all files loaded once and benchmarked in one process.
+    else if (manifest_name || (stat(input_name, &st) == 0 && S_ISDIR(st.st_mode))) {
+        if (options.threads || options.parallel || options.latency || options.pipeline) {
+            puts("Error: corpus is benchmarked file by file, --threads, --parallel, --latency and --pipeline "
+                 "are not supported.");
             return 1;
         }
 
-        outputfile = fopen(output_file_name, "w+");
-
-        if (!outputfile) {
-            puts("Error: problem with opening output file.");
-            fclose(archfile);
+        if ((manifest_name ? corpus_load_manifest(&corp, manifest_name) :
+                             corpus_load_directory(&corp, input_name)) != 0) {
             return 1;
         }
 
-        run_bzip2(source, archfile, outputfile, options.level, options.iterations);
-        fclose(archfile);
-        fclose(outputfile);
-        break;
-    case LIB_SNAPPY:
-        strcat(arch_file_name, ".snappy");
-        strcpy(output_file_name, arch_file_name);
-        strcat(output_file_name, "_dec");
-        archfile = fopen(arch_file_name, "w+");
-        if (!archfile) {
-            puts("Error: problem with openin archive file.");
+        if (format != REPORT_NONE && report_open(format, output_file_name) != 0) {
+            corpus_free(&corp);
             return 1;
         }
 
-        outputfile = fopen(output_file_name, "w+");
+        ret = options.streams ? run_streams_benchmark(&corp, options, all_levels) :
+                                run_corpus_benchmark(&corp, options, all_levels);
+        report_close();
+        corpus_free(&corp);
+        return ret;
+    }
 
-        if (!outputfile) {
-            puts("Error: problem with opening output file.");
-            fclose(archfile);
+    else {
+        // Open input file.
+        infile = fopen(input_name, "r");
+        if (!infile) {
+            puts("Error: problem with opening input file.");
             return 1;
         }
 
-        run_snappy(source, archfile, outputfile, options.iterations);
-        fclose(archfile);
-        fclose(outputfile);
-        break;
-    case LIB_LZO:
-        strcat(arch_file_name, ".lzo");
-        strcpy(output_file_name, arch_file_name);
-        strcat(output_file_name, "_dec");
-        archfile = fopen(arch_file_name, "w+");
-        if (!archfile) {
-            puts("Error: problem with openin archive file.");
+        if (format != REPORT_NONE && report_open(format, output_file_name) != 0) {
+            fclose(infile);
             return 1;
         }
 
-        outputfile = fopen(output_file_name, "w+");
+        // Codec-only, parallel and migration measurements work on input loaded once into aligned buffer.
+        if (options.in_memory || options.parallel || options.page_size || options.latency || options.streams) {
+            buf = load_file_aligned(infile, &source_len);
+            if (!buf) {
+                report_close();
+                fclose(infile);
+                return 1;
+            }
+        } else {
+            off_t file_size = get_file_size(infile);
+            source_len = file_size < 0 ? 0 : (size_t)file_size;
+        }
+    }
+
+    // Parallel, pipelined, latency and migration measurements pass blocks, buffers or pages to codec, not whole input.
+    whole_input = !options.parallel && !options.pipeline && !options.latency && !options.page_size;
 
-        if (!outputfile) {
-            puts("Error: problem with opening output file.");
-            fclose(archfile);
-            return 1;
+    // Input file or synthetic data is a corpus of one file.
+    if (options.streams) {
+        corpus_file file;
+
+        file.name = (char*)input_name;
+        file.data = buf;
+        file.len = source_len;
+        corp.name = input_name;
+        corp.files = &file;
+        corp.count = corp.capacity = 1;
+        corp.total_len = source_len;
+        ret = run_streams_benchmark(&corp, options, 0);
+    }
+
+    sweep_init(&sweep, input_name);
+    for (int i = 0; codecs[i] && !options.streams; ++i) {
+        int levels[LEVELS_MAX];
+        int levels_count;
+
+        if (options.library && options.library != codecs[i]) {
+            continue;
+        }
+        if (whole_input && !codec_accepts(codecs[i], source_len)) {
+            print_skipped(codecs[i], input_name);
+            continue;
         }
 
-        run_lzo(source, archfile, outputfile, options.level, options.iterations);
-        fclose(archfile);
-        fclose(outputfile);
-        break;
-    default:
-        return 1;
+        levels_count = plan_levels(codecs[i], options, 0, levels);
+        for (int l = 0; l < levels_count; ++l) {
+            bench_result result;
+            int failed;
+
+            options.level = levels[l];
+            if (options.threads) {
+                ret |= run_threaded_benchmark(codecs[i], buf, source_len, options) != CODEC_SUCCESS;
+                continue;
+            } else if (options.parallel) {
+                ret |= run_parallel_benchmark(codecs[i], buf, source_len, synthetic ? SYNTHETIC_FILE_STEM : input_name,
+                                              options) != CODEC_SUCCESS;
+                continue;
+            } else if (options.pipeline) {
+                ret |= run_pipeline_benchmark(codecs[i], infile, input_name, options) != CODEC_SUCCESS;
+                rewind(infile);
+                continue;
+            } else if (options.latency) {
+                ret |= run_latency_benchmark(codecs[i], buf, source_len, options) != CODEC_SUCCESS;
+                continue;
+            } else if (options.page_size) {
+                failed = run_migration_benchmark(codecs[i], buf, source_len, options, &result) != CODEC_SUCCESS;
+            } else if (options.in_memory) {
+                failed = run_in_memory_benchmark(codecs[i], buf, source_len, options, &result) != CODEC_SUCCESS;
+            } else {
+                // End-to-end (file to file) measurement.
+                failed = run_file_benchmark(codecs[i], infile, input_name, options, &result) != CODEC_SUCCESS;
+                rewind(infile);
+            }
+
+            ret |= failed;
+            if (!failed && options.levels_count) {
+                ret |= sweep_add(&sweep, codecs[i], codec_level(codecs[i], options.level), &result);
+            }
+        }
     }
 
-    return 0;
+    print_sweep(&sweep);
+    sweep_free(&sweep);
+    report_close();
+    free(buf);
+    if (infile) {
+        fclose(infile);
+    }
+    return ret;
 }
 
 int main(int argc, char **argv)
 {
     bench_options options;
-    FILE *infile;
-    char input_file_name[100];
+    char input_file_name[FILENAME_MAX] = "";
+    const char *output_file_name = NULL;
+    const char *manifest_name = NULL;
+    const char *dictionary_name = NULL;
+    const char *synthetic_name = NULL;
+    synthetic_spec synthetic;
+    unsigned char *dict = NULL;
+    perf_counters counters;
+    int perf = 0;
+    int all_levels;
+    int format = REPORT_NONE;
+    int ret;
 
     // Defaults.
     options.iterations = 1;
-    options.level = HIGH_COMPRESSION;
-    options.library = LIB_ZLIB;
+    options.warmup = 0;
+    options.time_budget = 0.0;
+    options.rel_error = 0.0;
+    options.level = DEFAULT_COMPRESSION;
+    options.levels = NULL;
+    options.levels_count = 0;
+    options.library = NULL;
+    options.in_memory = 0;
+    options.threads = 0;
+    options.parallel = 0;
+    options.block_size = PARALLEL_BLOCK_SIZE;
+    options.page_size = 0;
+    options.latency = 0;
+    options.streams = 0;
+    options.pipeline = PIPELINE_OFF;
+    options.input_name = input_file_name;
+    options.input = INPUT_STDIO;
+    options.populate = 0;
+    options.drop_cache = 0;
+    options.advice = ADVICE_NONE;
+    options.sink.type = SINK_FILE;
+    options.sink.dir = SINK_TMPFS_DIR;
+    options.sink.sync = 0;
+    options.sink.direct = 0;
+    options.verify = 0;
+    options.perf = NULL;
+    options.max_steal = STEAL_THRESHOLD;
+    options.discard_steal = 0;
+    memset(&options.params, 0, sizeof(options.params));
 
     if (argc < 2) {
         puts("Too few arguments");
@@ -198,35 +570,175 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    get_options(argc, argv, &options, input_file_name);
+    get_options(argc, argv, &options, input_file_name, &format, &output_file_name, &manifest_name,
+                &dictionary_name, &perf, &synthetic_name);
+
+    // Corpus is benchmarked on both levels, unless one is selected.
+    all_levels = options.level == DEFAULT_COMPRESSION;
+    if (all_levels) {
+        options.level = HIGH_COMPRESSION;
+    }
+
+    if (options.iterations < 1 || options.warmup < 0) {
+        puts("Error: invalid iterations count.");
+        return 1;
+    }
 
-    // Open input file.
-    infile = fopen(input_file_name, "r");
-    if (!infile) {
-        puts("Error: problem with opening input file.");
+    if (options.max_steal < 0.0) {
+        puts("Error: invalid steal time threshold.");
         return 1;
     }
 
-    switch(options.library) {
-    case LIB_ZLIB:
-        run_benchmark(infile, input_file_name, options);
-        rewind(infile);
-        break;
-    case LIB_BZIP2:
-        run_benchmark(infile, input_file_name, options);
-        rewind(infile);
-        break;
-    case LIB_SNAPPY:
-        run_benchmark(infile, input_file_name, options);
-        break;
-    case LIB_LZO:
-        run_benchmark(infile, input_file_name, options);
-        break;
-    default:
-        break;
+    if (options.params.chunk_size &&
+            (options.params.chunk_size < CHUNK_MIN || options.params.chunk_size > CHUNK_MAX)) {
+        puts("Error: chunk size must be in the range of 4K to 16M.");
+        return 1;
     }
 
-    fclose(infile);
-    return 0;
-}
+    if (options.params.work_factor < 0 || options.params.work_factor > BZIP2_WORK_FACTOR_MAX) {
+        printf("Error: work factor must be in the range of 0 to %d, 0 - library default.\n", BZIP2_WORK_FACTOR_MAX);
+        return 1;
+    }
+
+    if (options.params.method) {
+        int found = 0;
+
+        for (int i = 0; codecs[i]; ++i) {
+            if ((!options.library || options.library == codecs[i]) && codec_has_method(codecs[i], options.params.method)) {
+                found = 1;
+            }
+        }
+        if (!found) {
+            printf("Error: unknown method %s.\n", options.params.method);
+            return 1;
+        }
+    }
+
+    if (options.threads < 0 || options.parallel < 0 || options.streams < 0 || options.params.workers < 0) {
+        puts("Error: invalid threads count.");
+        return 1;
+    }
 
+    if (options.page_size && (options.threads || options.parallel)) {
+        puts("Error: migration workload (--pages) is single-threaded, --threads and --parallel are not supported.");
+        return 1;
+    }
+
+    if (options.latency && (options.threads || options.parallel || options.page_size)) {
+        puts("Error: latency benchmark (--latency) can't be combined with --threads, --parallel and --pages.");
+        return 1;
+    }
+
+    if (options.streams && (options.threads || options.parallel || options.page_size || options.latency)) {
+        puts("Error: multi-stream mode (--streams) can't be combined with --threads, --parallel, --pages and --latency.");
+        return 1;
+    }
+
+    // These modes run fixed iterations count, they don't use run_measurement().
+    if ((options.time_budget > 0.0 || options.rel_error > 0.0) &&
+            (options.threads || options.latency || options.streams)) {
+        puts("Error: calibration (--time-budget, --rel-error) can't be combined with --threads, --latency and --streams.");
+        return 1;
+    }
+
+    // Steal time is checked per iteration by run_measurement(), which these modes don't use either.
+    if ((options.discard_steal || options.max_steal != STEAL_THRESHOLD) &&
+            (options.threads || options.latency || options.streams)) {
+        puts("Error: --max-steal and --discard-steal can't be combined with --threads, --latency and --streams.");
+        return 1;
+    }
+
+    if ((options.sink.sync || options.sink.direct) && options.sink.type != SINK_FILE && options.sink.type != SINK_TMPFS) {
+        puts("Error: --fsync and --direct need file or tmpfs sink.");
+        return 1;
+    }
+
+    if (options.sink.type != SINK_FILE && options.sink.type != SINK_TMPFS && options.input != INPUT_STDIO) {
+        puts("Error: read()/mmap() input of archive needs file or tmpfs sink.");
+        return 1;
+    }
+
+    if (options.sink.direct && options.input == INPUT_READ) {
+        puts("Error: O_DIRECT archive can't be read() whole (unaligned size), use --input stdio or mmap.");
+        return 1;
+    }
+
+    if (options.sink.type == SINK_NULL && options.verify) {
+        puts("Error: null sink discards decompressed output, --verify is not supported.");
+        return 1;
+    }
+
+    if (options.sink.type == SINK_TMPFS && !sink_on_tmpfs(options.sink.dir)) {
+        printf("Warning: %s is not on tmpfs, archive and output are written back to its device.\n", options.sink.dir);
+    }
+
+    if (options.pipeline && (options.in_memory || options.parallel || options.page_size || options.latency ||
+                             options.streams || options.input != INPUT_STDIO || synthetic_name)) {
+        puts("Error: pipelined mode (--pipeline) reads input file itself, it can't be combined with --in-memory, "
+             "--threads, --parallel, --pages, --latency, --streams, --input and --synthetic.");
+        return 1;
+    }
+
+    // Synthetic data has no file, next to which archive and output would be written.
+    if (synthetic_name && options.parallel && options.sink.type == SINK_FILE) {
+        puts("Error: parallel compression of synthetic input needs --sink tmpfs, memory or null.");
+        return 1;
+    }
+
+    if (options.drop_cache && (options.in_memory || options.parallel || options.page_size || options.latency ||
+                               options.streams || synthetic_name)) {
+        puts("Error: --drop-cache needs end-to-end or pipelined mode, input of other modes is loaded once.");
+        return 1;
+    }
+
+    // Counters and CPU time follow the calling thread, workers of these modes would be missed.
+    if (perf && (options.parallel || options.pipeline || options.threads || options.streams)) {
+        puts("Error: --perf counts only the calling thread, it can't be combined with --parallel, --pipeline, "
+             "--threads and --streams.");
+        return 1;
+    }
+
+    if (synthetic_name && parse_synthetic(synthetic_name, &synthetic) != 0) {
+        return 1;
+    }
+
+    if (output_file_name && format == REPORT_NONE) {
+        size_t len = strlen(output_file_name);
+        format = len >= 4 && !strcmp(output_file_name + len - 4, ".csv") ? REPORT_CSV : REPORT_JSON;
+    } else if (!output_file_name && format != REPORT_NONE) {
+        output_file_name = format == REPORT_CSV ? "results.csv" : "results.json";
+    }
+
+    // Dictionary is loaded once and shared by all codec contexts.
+    if (dictionary_name) {
+        FILE *dict_file = fopen(dictionary_name, "r");
+
+        if (!dict_file) {
+            puts("Error: problem with opening dictionary file.");
+            return 1;
+        }
+        dict = load_file_aligned(dict_file, &options.params.dict_len);
+        fclose(dict_file);
+        if (!dict) {
+            return 1;
+        }
+        options.params.dict = dict;
+    }
+
+    if (options.latency || options.streams || options.pipeline) {
+        timer_init();
+    }
+
+    // Counters are opened once, benchmark goes on without them if none is available.
+    if (perf && !perf_open(&counters)) {
+        options.perf = &counters;
+    }
+
+    ret = run_benchmark(options, format, output_file_name, manifest_name, synthetic_name ? &synthetic : NULL,
+                        all_levels);
+    if (options.perf) {
+        perf_close(&counters);
+    }
+    free(dict);
+    return ret;
+}
@@ -0,0 +1,300 @@
+#include "migration.h"
+#include "report.h"
+#include "arena.h"
+#include "checksum.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// Page of migration stream.
+typedef struct {
+    size_t offset;          // Offset of page data in stream.
+    size_t len;             // Size of page data, 0 for zero page.
+    int raw;                // Page is sent as it is, compressed data wasn't smaller.
+} page_entry;
+
+typedef struct {
+    const codec *c;
+    void *ctx;
+    arena mem;
+    const unsigned char *source;
+    size_t source_len;
+    size_t page_size;
+    size_t pages;
+    page_entry *entries;
+    unsigned char *stream;      // Sent pages, one after another.
+    size_t stream_len;
+    size_t page_bound;          // Maximum size of compressed page.
+    unsigned char *output;      // Destination RAM.
+    size_t zero_pages;
+    size_t raw_pages;
+    time_samples compress_latency;      // Per-page latency of the last iteration.
+    time_samples decompress_latency;
+    uint32_t source_crc;
+} migration_state;
+
+/**
+ * @brief Checks if buffer is all zeros (like QEMU's buffer_is_zero()), 64 bytes at a time with SSE2.
+ * @param p buffer
+ * @param len buffer size
+ * @return Returns non-zero if buffer is all zeros.
+ */
+static int buffer_is_zero(const unsigned char *p, size_t len)
+{
+#if defined(__x86_64__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; len >= 64; len -= 64, p += 64) {
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((const __m128i*)p),
+                                              _mm_loadu_si128((const __m128i*)(p + 16))),
+                                 _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + 32)),
+                                              _mm_loadu_si128((const __m128i*)(p + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xffff) {
+            return 0;
+        }
+    }
+#endif
+
+    for (; len; --len) {
+        if (*p++) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Gets size of page, the last one may be partial.
+ */
+static size_t page_len(const migration_state *state, size_t page)
+{
+    size_t offset = page * state->page_size;
+
+    return state->source_len - offset < state->page_size ? state->source_len - offset : state->page_size;
+}
+
+static void migration_compress_before(void *arg)
+{
+    migration_state *state = (migration_state*)arg;
+
+    samples_clear(&state->compress_latency);
+}
+
+static int migration_compress_run(void *arg)
+{
+    migration_state *state = (migration_state*)arg;
+    struct timespec prev_ts, now_ts;
+    size_t pos = 0;
+
+    state->zero_pages = 0;
+    state->raw_pages = 0;
+    get_time(&prev_ts);
+
+    for (size_t i = 0; i < state->pages; ++i) {
+        const unsigned char *page = state->source + i * state->page_size;
+        size_t len = page_len(state, i);
+        page_entry *entry = &state->entries[i];
+
+        entry->offset = pos;
+        entry->raw = 0;
+        if (buffer_is_zero(page, len)) {
+            entry->len = 0;
+            ++state->zero_pages;
+        } else {
+            entry->len = state->page_bound;
+            if (state->c->compress(state->ctx, page, len, state->stream + pos, &entry->len) != CODEC_SUCCESS) {
+                return CODEC_FAILURE;
+            }
+            if (entry->len >= len) {
+                memcpy(state->stream + pos, page, len);
+                entry->len = len;
+                entry->raw = 1;
+                ++state->raw_pages;
+            }
+            pos += entry->len;
+        }
+
+        // Latency of page is time from the end of previous one, so clock is read once per page.
+        get_time(&now_ts);
+        samples_add(&state->compress_latency, elapsed_ns(prev_ts, now_ts));
+        prev_ts = now_ts;
+    }
+
+    state->stream_len = pos;
+    return CODEC_SUCCESS;
+}
+
+static void migration_decompress_before(void *arg)
+{
+    migration_state *state = (migration_state*)arg;
+
+    samples_clear(&state->decompress_latency);
+}
+
+static int migration_decompress_run(void *arg)
+{
+    migration_state *state = (migration_state*)arg;
+    struct timespec prev_ts, now_ts;
+
+    get_time(&prev_ts);
+
+    for (size_t i = 0; i < state->pages; ++i) {
+        unsigned char *page = state->output + i * state->page_size;
+        size_t len = page_len(state, i);
+        const page_entry *entry = &state->entries[i];
+
+        if (!entry->len) {
+            // Destination page is written only if it isn't zero already.
+            if (!buffer_is_zero(page, len)) {
+                memset(page, 0, len);
+            }
+        } else if (entry->raw) {
+            memcpy(page, state->stream + entry->offset, len);
+        } else {
+            size_t output_len = len;
+
+            if (state->c->decompress(state->ctx, state->stream + entry->offset, entry->len, page,
+                                     &output_len) != CODEC_SUCCESS) {
+                return CODEC_FAILURE;
+            }
+            if (output_len != len) {
+                printf("%s decompression error: decompressed page size mismatch.\n", state->c->name);
+                return CODEC_FAILURE;
+            }
+        }
+
+        get_time(&now_ts);
+        samples_add(&state->decompress_latency, elapsed_ns(prev_ts, now_ts));
+        prev_ts = now_ts;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int migration_decompress_verify(void *arg)
+{
+    migration_state *state = (migration_state*)arg;
+    uint32_t crc = crc32c(0, state->output, state->source_len);
+
+    return verify_checksum(state->c->name, state->source_len, state->source_crc, state->source_len, crc) ?
+                CODEC_FAILURE : CODEC_SUCCESS;
+}
+
+/**
+ * @brief Prints pages per second and percentiles of per-page latency.
+ * @param label name of measurement, e.g. "compression"
+ * @param m measurement
+ * @param latency per-page latency
+ * @param pages number of pages
+ */
+static void print_page_stats(const char *label, const measurement *m, const time_samples *latency, size_t pages)
+{
+    time_summary summary, page_summary;
+
+    samples_summary(&m->warm, &summary);
+    samples_summary(latency, &page_summary);
+    printf("Page %s: %.0f pages/s, latency p50 %.3f us, p90 %.3f us, p99 %.3f us, max %.3f us\n", label,
+           summary.mean > 0.0 ? pages * 1000.0 / summary.mean : 0.0, page_summary.median * 1000.0,
+           page_summary.p90 * 1000.0, page_summary.p99 * 1000.0, page_summary.max * 1000.0);
+}
+
+int run_migration_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options,
+                            bench_result *result)
+{
+    measurement compression, decompression;
+    migration_state state;
+    bench_step compress_step = { migration_compress_before, migration_compress_run, NULL, &state };
+    bench_step decompress_step = { migration_decompress_before, migration_decompress_run, NULL, &state,
+                                   options.verify ? migration_decompress_verify : NULL };
+    int ret;
+    int level = codec_level(c, options.level);
+
+    memset(&state, 0, sizeof(state));
+    state.c = c;
+    state.source = source;
+    state.source_len = source_len;
+    state.page_size = options.page_size;
+    state.pages = (source_len + options.page_size - 1) / options.page_size;
+    state.page_bound = c->compress_bound(options.page_size);
+    if (options.verify) {
+        state.source_crc = crc32c(0, source, source_len);
+    }
+
+    arena_init(&state.mem);
+    state.entries = (page_entry*)arena_alloc(&state.mem, sizeof(page_entry) * (state.pages ? state.pages : 1));
+    state.stream = (unsigned char*)arena_alloc(&state.mem, state.page_bound * (state.pages ? state.pages : 1));
+    state.output = (unsigned char*)arena_alloc(&state.mem, source_len);
+    if (!state.entries || !state.stream || !state.output ||
+            samples_init(&state.compress_latency, (int)state.pages) != 0 ||
+            samples_init(&state.decompress_latency, (int)state.pages) != 0) {
+        printf("%s error: problem with allocating memory for buffers.\n", c->name);
+        samples_free(&state.compress_latency);
+        samples_free(&state.decompress_latency);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&state.ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        samples_free(&state.compress_latency);
+        samples_free(&state.decompress_latency);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: migration mode, %zu pages of %zu bytes, compression level set on %d\n",
+           c->name, state.pages, state.page_size, level);
+    if (c->reserve && c->reserve(state.ctx, &state.mem, state.page_size) != CODEC_SUCCESS) {
+        printf("%s error: problem with allocating work memory.\n", c->name);
+        samples_free(&state.compress_latency);
+        samples_free(&state.decompress_latency);
+        c->teardown(state.ctx);
+        arena_destroy(&state.mem);
+        return CODEC_FAILURE;
+    }
+    print_arena(&state.mem);
+
+    ret = run_measurement(&compress_step, options, &compression);
+    if (ret == CODEC_SUCCESS) {
+        ret = run_measurement(&decompress_step, options, &decompression);
+        if (ret == CODEC_SUCCESS) {
+            time_summary summary;
+
+            printf("Mean compression ratio: %.2f%%\n",
+                   source_len ? (state.stream_len / (double)source_len) * 100.0 : 0.0);
+            printf("Zero pages: %zu (%.2f%%), pages sent as they are: %zu, bytes saved: %zu\n", state.zero_pages,
+                   state.pages ? state.zero_pages * 100.0 / state.pages : 0.0, state.raw_pages,
+                   source_len - state.stream_len);
+            print_measurement("compression", &compression, source_len);
+            print_page_stats("compression", &compression, &state.compress_latency, state.pages);
+            print_measurement("decompression", &decompression, source_len);
+            print_page_stats("decompression", &decompression, &state.decompress_latency, state.pages);
+            if (options.verify) {
+                printf("Verification: every decompressed output matches source (CRC32C %08x, %s)\n",
+                       state.source_crc, crc32c_implementation());
+            }
+            report_pages(c, options, source_len, state.stream_len, state.zero_pages, &compression,
+                         &state.compress_latency, &decompression, &state.decompress_latency, &state.mem);
+
+            if (result) {
+                result->source_len = source_len;
+                result->arch_len = state.stream_len;
+                samples_summary(&compression.warm, &summary);
+                result->compression_time = summary.mean;
+                samples_summary(&decompression.warm, &summary);
+                result->decompression_time = summary.mean;
+            }
+        }
+        measurement_free(&decompression);
+    }
+    measurement_free(&compression);
+
+    samples_free(&state.compress_latency);
+    samples_free(&state.decompress_latency);
+    c->teardown(state.ctx);
+    arena_destroy(&state.mem);
+    return ret;
+}
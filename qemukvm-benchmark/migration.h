@@ -0,0 +1,29 @@
+#ifndef MIGRATION_H
+#define MIGRATION_H
+
+#include <stddef.h>
+#include "codec.h"
+#include "benchmark.h"
+#include "util.h"
+
+// Page sizes of migration workload: small pages and huge pages.
+#define MIGRATION_PAGE_MIN 4096
+#define MIGRATION_PAGE_MAX (2 * 1024 * 1024)
+
+/**
+ * @brief Runs migration workload benchmark (in the style of QEMU live migration with compression).
+ * Input is sliced into options.page_size pages, zero pages are detected and skipped, every other page
+ * is compressed independently with the same codec context (reset between pages). Pages which don't
+ * shrink are sent as they are. Decompression restores pages into destination buffer the same way.
+ * Pages per second, bytes saved and percentiles of per-page latency (of the last iteration) are reported.
+ * @param c codec
+ * @param source input buffer (page aligned)
+ * @param source_len input buffer size
+ * @param options benchmark options
+ * @param result summary of run, may be NULL
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_migration_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options,
+                            bench_result *result);
+
+#endif // MIGRATION_H
@@ -0,0 +1,441 @@
+#include "parallel.h"
+#include "benchmark.h"
+#include "report.h"
+#include "checksum.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compressed block waiting to be written.
+typedef struct {
+    size_t index;           // Block number.
+    int done;               // Block is compressed and waits for writer.
+    int failed;
+    unsigned char *data;    // Compressed block.
+    size_t len;
+    size_t block_len;       // Uncompressed block size.
+    unsigned long check;    // Block checksum.
+} block_slot;
+
+typedef struct parallel_pool parallel_pool;
+
+typedef struct {
+    parallel_pool *pool;
+    void *ctx;              // Private codec context of worker.
+    pthread_t id;
+} pool_worker;
+
+// Pool of compression threads. Shared fields are protected by lock.
+struct parallel_pool {
+    const codec *c;
+    const unsigned char *source;
+    size_t source_len;
+    size_t block_size;
+    size_t blocks;          // Number of blocks in current job.
+    size_t next_block;      // Next block to be taken by worker.
+    size_t written;         // Number of blocks written in order.
+    int running;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    block_slot *slots;      // Ring of compressed blocks, block i goes to slot i % ring.
+    size_t ring;
+    pool_worker *workers;
+    int threads;
+};
+
+/**
+ * @brief Compression thread. Takes next block, when its slot in ring was released by writer.
+ * @param arg pool_worker structure
+ * @return Returns NULL.
+ */
+static void *pool_thread(void *arg)
+{
+    pool_worker *w = (pool_worker*)arg;
+    parallel_pool *pool = w->pool;
+
+    while (1) {
+        size_t i, start;
+        block_slot *slot;
+        int ret;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->running &&
+               (pool->next_block >= pool->blocks || pool->next_block - pool->written >= pool->ring)) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (!pool->running) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        i = pool->next_block++;
+        pthread_mutex_unlock(&pool->lock);
+
+        slot = &pool->slots[i % pool->ring];
+        start = i * pool->block_size;
+        slot->block_len = pool->source_len - start < pool->block_size ? pool->source_len - start : pool->block_size;
+        slot->len = pool->c->block->block_bound(pool->block_size);
+        ret = pool->c->block->compress_block(w->ctx, i ? pool->source : NULL, start,
+                                             pool->source + start, slot->block_len, i == pool->blocks - 1,
+                                             slot->data, &slot->len, &slot->check);
+
+        pthread_mutex_lock(&pool->lock);
+        slot->index = i;
+        slot->failed = ret != CODEC_SUCCESS;
+        slot->done = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Stops compression threads and releases pool.
+ * @param pool pool
+ * @param started number of started threads
+ */
+static void pool_destroy(parallel_pool *pool, int started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->running = 0;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(pool->workers[i].id, NULL);
+    }
+
+    for (int i = 0; i < pool->threads; ++i) {
+        if (pool->workers[i].ctx) {
+            pool->c->teardown(pool->workers[i].ctx);
+        }
+    }
+    for (size_t i = 0; i < pool->ring; ++i) {
+        free(pool->slots[i].data);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slots);
+    free(pool->workers);
+}
+
+/**
+ * @brief Creates pool of compression threads, each with its own codec context.
+ * @param pool pool to initialize
+ * @param c codec
+ * @param level compression level
+ * @param params codec tuning parameters
+ * @param threads threads count
+ * @param block_size block size
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int pool_create(parallel_pool *pool, const codec *c, int level, const codec_params *params, int threads,
+                       size_t block_size)
+{
+    int started = 0;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->c = c;
+    pool->block_size = block_size;
+    pool->threads = threads;
+    pool->running = 1;
+    // Two blocks per thread, so threads don't wait for writer.
+    pool->ring = 2 * threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    pool->slots = (block_slot*)calloc(pool->ring, sizeof(block_slot));
+    pool->workers = (pool_worker*)calloc(threads, sizeof(pool_worker));
+    if (!pool->slots || !pool->workers) {
+        puts("Error: problem with allocating memory for thread pool.");
+        pool->ring = pool->slots ? pool->ring : 0;
+        pool->threads = pool->workers ? threads : 0;
+        pool_destroy(pool, 0);
+        return CODEC_FAILURE;
+    }
+
+    for (size_t i = 0; i < pool->ring; ++i) {
+        pool->slots[i].data = alloc_aligned_buffer(c->block->block_bound(block_size));
+        if (!pool->slots[i].data) {
+            puts("Error: problem with allocating memory for blocks.");
+            pool_destroy(pool, 0);
+            return CODEC_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        pool->workers[i].pool = pool;
+        if (c->init(&pool->workers[i].ctx, level, params) != CODEC_SUCCESS) {
+            printf("%s error: problem with codec initialization.\n", c->name);
+            pool->workers[i].ctx = NULL;
+            pool_destroy(pool, 0);
+            return CODEC_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&pool->workers[i].id, NULL, pool_thread, &pool->workers[i]) != 0) {
+            puts("Error: problem with creating thread.");
+            pool_destroy(pool, started);
+            return CODEC_FAILURE;
+        }
+        started++;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Compresses source buffer on the pool and writes archive in order.
+ * @param pool pool
+ * @param ctx codec context for header and trailer
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param arch archive file
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int pool_compress(parallel_pool *pool, void *ctx, const unsigned char *source, size_t source_len, FILE *arch)
+{
+    const block_codec *block = pool->c->block;
+    unsigned char buf[BLOCK_HEADER_MAX > BLOCK_TRAILER_MAX ? BLOCK_HEADER_MAX : BLOCK_TRAILER_MAX];
+    unsigned long check = 0;
+    size_t len;
+    size_t blocks;
+    int ret = CODEC_SUCCESS;
+
+    // There is always at least one (maybe empty) block, which is the last one.
+    blocks = source_len ? (source_len + pool->block_size - 1) / pool->block_size : 1;
+
+    len = block->header(ctx, pool->block_size, buf);
+    if (fwrite(buf, 1, len, arch) != len) {
+        ret = CODEC_FAILURE;
+    }
+
+    // Start workers.
+    pthread_mutex_lock(&pool->lock);
+    pool->source = source;
+    pool->source_len = source_len;
+    pool->blocks = blocks;
+    pool->next_block = 0;
+    pool->written = 0;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Write blocks in order. All blocks are taken from slots even after error, so workers never stall.
+    for (size_t i = 0; i < blocks; ++i) {
+        block_slot *slot = &pool->slots[i % pool->ring];
+
+        pthread_mutex_lock(&pool->lock);
+        while (!slot->done || slot->index != i) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (slot->failed) {
+            ret = CODEC_FAILURE;
+        } else if (ret == CODEC_SUCCESS) {
+            check = i ? block->combine_check(check, slot->check, slot->block_len) : slot->check;
+            if (fwrite(slot->data, 1, slot->len, arch) != slot->len) {
+                puts("Error: problem with writing to archive file.");
+                ret = CODEC_FAILURE;
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        slot->done = 0;
+        pool->written++;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    len = block->trailer(ctx, check, buf);
+    if (fwrite(buf, 1, len, arch) != len || ferror(arch)) {
+        ret = CODEC_FAILURE;
+    }
+
+    return ret;
+}
+
+// State of parallel benchmark iterations.
+typedef struct {
+    parallel_pool *pool;
+    void *ctx;
+    const unsigned char *source;
+    size_t source_len;
+    FILE *archfile;
+    FILE *outputfile;
+    const sink_options *sink;
+    size_t arch_len;
+    size_t output_len;
+    uint32_t source_crc;    // CRC32C of source for verification (--verify).
+} parallel_state;
+
+static int parallel_compress_run(void *arg)
+{
+    parallel_state *state = (parallel_state*)arg;
+    int ret = pool_compress(state->pool, state->ctx, state->source, state->source_len, state->archfile);
+
+    if (ret == CODEC_SUCCESS && sink_flush(state->sink, state->archfile) != 0) {
+        puts("Error: problem with writing archive file.");
+        ret = CODEC_FAILURE;
+    }
+
+    return ret;
+}
+
+static void parallel_compress_after(void *arg)
+{
+    parallel_state *state = (parallel_state*)arg;
+
+    state->arch_len = ftell(state->archfile);
+    rewind(state->archfile);
+}
+
+static int parallel_decompress_run(void *arg)
+{
+    parallel_state *state = (parallel_state*)arg;
+    const codec *c = state->pool->c;
+
+    if (c->decompress_file(state->ctx, state->archfile, state->outputfile, state->source_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    if (sink_flush(state->sink, state->outputfile) != 0) {
+        puts("Error: problem with writing output file.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static void parallel_decompress_after(void *arg)
+{
+    parallel_state *state = (parallel_state*)arg;
+
+    state->output_len = ftell(state->outputfile);
+    rewind(state->archfile);
+    rewind(state->outputfile);
+}
+
+static int parallel_decompress_verify(void *arg)
+{
+    parallel_state *state = (parallel_state*)arg;
+    uint32_t crc;
+
+    if (crc32c_file(state->outputfile, 0, state->output_len, &crc) != 0) {
+        printf("%s verification error: problem with reading output file.\n", state->pool->c->name);
+        return CODEC_FAILURE;
+    }
+
+    return verify_checksum(state->pool->c->name, state->source_len, state->source_crc, state->output_len, crc) ?
+                CODEC_FAILURE : CODEC_SUCCESS;
+}
+
+int run_parallel_benchmark(const codec *c, const unsigned char *source, size_t source_len,
+                           const char *file_name, bench_options options)
+{
+    measurement compression, decompression;
+    parallel_state state;
+    bench_step compress_step = { NULL, parallel_compress_run, parallel_compress_after, &state };
+    bench_step decompress_step = { NULL, parallel_decompress_run, parallel_decompress_after, &state,
+                                   options.verify ? parallel_decompress_verify : NULL };
+    FILE *archfile, *outputfile;
+    char arch_file_name[FILENAME_MAX];
+    char output_file_name[FILENAME_MAX];
+    parallel_pool pool;
+    arena mem;
+    void *ctx;
+    int ret;
+    int level = codec_level(c, options.level);
+
+    if (!c->block) {
+        printf("%s: parallel compression not supported, skipped.\n", c->name);
+        return CODEC_SUCCESS;
+    }
+
+    if (options.block_size < c->block->min_block_size || options.block_size > c->block->max_block_size) {
+        printf("%s error: block size must be in the range of %zu to %zu bytes.\n",
+               c->name, c->block->min_block_size, c->block->max_block_size);
+        return CODEC_FAILURE;
+    }
+
+    if (make_file_names(file_name, c->extension, arch_file_name, output_file_name) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    // Arena holds only memory sink buffers and O_DIRECT stdio buffers.
+    arena_init(&mem);
+    archfile = sink_open(&options.sink, arch_file_name, c->compress_bound(source_len), 0, &mem);
+    if (!archfile) {
+        puts("Error: problem with opening archive file.");
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    outputfile = sink_open(&options.sink, output_file_name, source_len, 1, &mem);
+    if (!outputfile) {
+        puts("Error: problem with opening output file.");
+        fclose(archfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        fclose(archfile);
+        fclose(outputfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    if (pool_create(&pool, c, level, &options.params, options.parallel, options.block_size) != CODEC_SUCCESS) {
+        c->teardown(ctx);
+        fclose(archfile);
+        fclose(outputfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: parallel mode, %d threads, block size %zu, compression level set on %d\n",
+           c->name, options.parallel, options.block_size, level);
+
+    state.pool = &pool;
+    state.ctx = ctx;
+    state.source = source;
+    state.source_len = source_len;
+    state.archfile = archfile;
+    state.outputfile = outputfile;
+    state.sink = &options.sink;
+    state.arch_len = 0;
+    state.output_len = 0;
+    state.source_crc = options.verify ? crc32c(0, source, source_len) : 0;
+
+    ret = run_measurement(&compress_step, options, &compression);
+    if (ret == CODEC_SUCCESS) {
+        // Blocks are compressed by pool threads.
+        compression.threaded = 1;
+        // Archive has the standard format, so it is decompressed serially.
+        ret = run_measurement(&decompress_step, options, &decompression);
+        if (ret == CODEC_SUCCESS) {
+            printf("Mean compression ratio: %.2f%%\n", source_len ? (state.arch_len / (double)source_len) * 100.0 : 0.0);
+            print_measurement("compression", &compression, source_len);
+            print_measurement("serial decompression", &decompression, source_len);
+            if (options.verify) {
+                printf("Verification: every decompressed output matches source (CRC32C %08x, %s)\n",
+                       state.source_crc, crc32c_implementation());
+            }
+            report_measurements(c, options, "parallel", source_len, state.arch_len, &compression, &decompression,
+                                NULL);
+        }
+        measurement_free(&decompression);
+    }
+    measurement_free(&compression);
+
+    pool_destroy(&pool, options.parallel);
+    c->teardown(ctx);
+    fclose(archfile);
+    fclose(outputfile);
+    arena_destroy(&mem);
+    return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "codec.h"
+#include "util.h"
+
+// Default block size of parallel compression.
+#define PARALLEL_BLOCK_SIZE (256 * 1024)
+
+/**
+ * @brief Runs parallel block compression benchmark (in the style of pigz).
+ * Input is split into independent blocks, which are compressed on a pool of options.parallel threads
+ * and written in order to <file_name><extension>. Archive has the same format as serial one,
+ * so it is decompressed (serially) to <file_name><extension>_dec with codec's decompress_file.
+ * Input is loaded once before measurement, timed region contains compression and writing of archive.
+ * @param c codec (must support block interface)
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param file_name input file name
+ * @param options benchmark options
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_parallel_benchmark(const codec *c, const unsigned char *source, size_t source_len,
+                           const char *file_name, bench_options options);
+
+#endif // PARALLEL_H
@@ -0,0 +1,276 @@
+#include "perf.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Group read: number of events, enabled and running time, values in group order.
+#define PERF_READ_SIZE (3 + PERF_EVENTS)
+
+typedef struct {
+    const char *key;        // Name in result records.
+    const char *name;       // Name in text output.
+    uint32_t type;
+    uint64_t config;
+} perf_event;
+
+static const perf_event events[PERF_EVENTS] = {
+    { "cycles", "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache_misses", "cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch_misses", "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dtlb_misses", "dTLB misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "context_switches", "context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "task_clock_ns", "task clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page_faults", "page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }
+};
+
+/**
+ * @brief Opens counter of calling thread on any CPU.
+ * @param event event
+ * @param group group leader, -1 to open a new group
+ * @param exclude_kernel non-zero to count user space only
+ * @return Returns file descriptor or -1 if event could not be opened.
+ */
+static int open_event(const perf_event *event, int group, int exclude_kernel)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Group members follow the leader, which is enabled around measured region.
+    attr.disabled = group == -1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+int perf_open(perf_counters *p)
+{
+    int missing = 0;
+
+    p->group = -1;
+    p->count = 0;
+    p->available = 0;
+    p->hardware = 0;
+    p->user_only = 0;
+
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        int fd = p->user_only ? -1 : open_event(&events[i], p->group, 0);
+
+        // With perf_event_paranoid > 1 unprivileged user may count user space only.
+        if (fd == -1 && (p->user_only || errno == EACCES || errno == EPERM)) {
+            fd = open_event(&events[i], p->group, 1);
+            if (fd != -1) {
+                p->user_only = 1;
+            }
+        }
+
+        p->fd[i] = fd;
+        if (fd == -1) {
+            missing |= 1 << i;
+            continue;
+        }
+
+        if (p->group == -1) {
+            p->group = fd;
+        }
+        p->order[p->count++] = i;
+        p->available |= 1u << i;
+        if (events[i].type != PERF_TYPE_SOFTWARE) {
+            p->hardware = 1;
+        }
+    }
+
+    if (p->group == -1) {
+        puts("Warning: performance counters are not available (perf_event_open() failed), they are not counted.");
+        return 1;
+    }
+
+    if (!p->hardware) {
+        puts("Warning: hardware performance counters are not available (no PMU, e.g. guest without vPMU), "
+             "only software events are counted.");
+    } else {
+        for (int i = 0; i < PERF_EVENTS; ++i) {
+            if (missing & (1 << i)) {
+                printf("Warning: %s counter is not available.\n", events[i].name);
+            }
+        }
+    }
+
+    printf("Performance counters:");
+    for (int i = 0; i < p->count; ++i) {
+        printf("%s %s", i ? "," : "", events[p->order[i]].name);
+    }
+    printf("%s\n", p->user_only ? " (user space only, see perf_event_paranoid)" : "");
+
+    return 0;
+}
+
+void perf_close(perf_counters *p)
+{
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        if (p->fd[i] != -1) {
+            close(p->fd[i]);
+            p->fd[i] = -1;
+        }
+    }
+
+    p->group = -1;
+    p->count = 0;
+    p->available = 0;
+}
+
+void perf_start(const perf_counters *p)
+{
+    ioctl(p->group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(p->group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+int perf_stop(const perf_counters *p, uint64_t values[PERF_EVENTS])
+{
+    uint64_t data[PERF_READ_SIZE];
+    ssize_t size;
+
+    ioctl(p->group, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    memset(values, 0, sizeof(uint64_t) * PERF_EVENTS);
+
+    size = read(p->group, data, sizeof(data));
+    if (size < (ssize_t)(sizeof(uint64_t) * 3) || data[0] != (uint64_t)p->count) {
+        return 1;
+    }
+
+    for (int i = 0; i < p->count; ++i) {
+        uint64_t value = data[3 + i];
+
+        // Group shared hardware counters with other users, scale value to whole enabled time.
+        if (data[2] && data[2] < data[1]) {
+            value = (uint64_t)((double)value * data[1] / data[2]);
+        }
+        values[p->order[i]] = value;
+    }
+
+    return 0;
+}
+
+const char *perf_event_key(int event)
+{
+    return events[event].key;
+}
+
+int perf_samples_init(perf_samples *s, const perf_counters *p, int capacity)
+{
+    s->count = 0;
+    s->capacity = 0;
+    s->values = NULL;
+    s->available = p ? p->available : 0;
+    if (!s->available) {
+        return 0;
+    }
+
+    s->values = (uint64_t*)malloc(sizeof(uint64_t) * PERF_EVENTS * (capacity > 0 ? capacity : 16));
+    if (!s->values) {
+        return 1;
+    }
+    s->capacity = capacity > 0 ? capacity : 16;
+
+    return 0;
+}
+
+int perf_samples_add(perf_samples *s, const uint64_t values[PERF_EVENTS])
+{
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 16;
+        uint64_t *v = (uint64_t*)realloc(s->values, sizeof(uint64_t) * PERF_EVENTS * capacity);
+        if (!v) {
+            puts("Error: problem with allocating memory for counter samples.");
+            return 1;
+        }
+        s->values = v;
+        s->capacity = capacity;
+    }
+
+    memcpy(s->values + (size_t)s->count * PERF_EVENTS, values, sizeof(uint64_t) * PERF_EVENTS);
+    ++s->count;
+    return 0;
+}
+
+void perf_samples_free(perf_samples *s)
+{
+    free(s->values);
+    s->values = NULL;
+    s->count = 0;
+    s->capacity = 0;
+}
+
+double perf_samples_mean(const perf_samples *s, int event)
+{
+    double total = 0.0;
+
+    if (!s->count) {
+        return 0.0;
+    }
+
+    for (int i = 0; i < s->count; ++i) {
+        total += s->values[(size_t)i * PERF_EVENTS + event];
+    }
+
+    return total / s->count;
+}
+
+double perf_samples_ipc(const perf_samples *s)
+{
+    double cycles;
+
+    if (!(s->available & (1u << PERF_CYCLES)) || !(s->available & (1u << PERF_INSTRUCTIONS))) {
+        return -1.0;
+    }
+
+    cycles = perf_samples_mean(s, PERF_CYCLES);
+    return cycles > 0.0 ? perf_samples_mean(s, PERF_INSTRUCTIONS) / cycles : 0.0;
+}
+
+void print_perf_samples(const char *label, const perf_samples *s)
+{
+    char name[64];
+    double ipc = perf_samples_ipc(s);
+    int first = 1;
+
+    if (!s->available || !s->count) {
+        return;
+    }
+
+    snprintf(name, sizeof(name), "%s", label);
+    name[0] = toupper((unsigned char)name[0]);
+
+    printf("%s counters per iteration:", name);
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        if (!(s->available & (1u << i))) {
+            continue;
+        }
+
+        if (i == PERF_TASK_CLOCK) {
+            printf("%s %s %.3f ms", first ? "" : ",", events[i].name, perf_samples_mean(s, i) / 1e6);
+        } else {
+            // Software events are rare, their fraction per iteration is meaningful.
+            printf(events[i].type == PERF_TYPE_SOFTWARE ? "%s %s %.1f" : "%s %s %.0f", first ? "" : ",",
+                   events[i].name, perf_samples_mean(s, i));
+        }
+        first = 0;
+
+        if (i == PERF_INSTRUCTIONS && ipc >= 0.0) {
+            printf(", IPC %.2f", ipc);
+        }
+    }
+    putchar('\n');
+}
@@ -0,0 +1,128 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+/**
+ * Counted events. Hardware events need a PMU (vPMU in a guest), software events
+ * (task clock, page faults, context switches) are counted by kernel and work everywhere.
+ */
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,       // dTLB load misses.
+    PERF_CONTEXT_SWITCHES,
+    PERF_TASK_CLOCK,        // In ns.
+    PERF_PAGE_FAULTS,
+    PERF_EVENTS
+};
+
+// Bit mask of software events.
+#define PERF_SOFTWARE_EVENTS ((1u << PERF_CONTEXT_SWITCHES) | (1u << PERF_TASK_CLOCK) | (1u << PERF_PAGE_FAULTS))
+
+/**
+ * Counters of calling thread, opened as one group so all events count the same region.
+ */
+typedef struct {
+    int group;              // Group leader, -1 if no event could be opened.
+    int fd[PERF_EVENTS];    // -1 for events which are not counted.
+    int order[PERF_EVENTS]; // Events in group read order.
+    int count;              // Number of opened events.
+    unsigned available;     // Bit mask of opened events.
+    int hardware;           // Non-zero if any hardware event is counted.
+    int user_only;          // Non-zero if kernel is excluded (perf_event_paranoid).
+} perf_counters;
+
+/**
+ * Counter values of all iterations of one measurement.
+ */
+typedef struct {
+    uint64_t *values;       // PERF_EVENTS values per iteration.
+    int count;
+    int capacity;
+    unsigned available;     // Bit mask of counted events, 0 - counters are not used.
+} perf_samples;
+
+/**
+ * @brief Opens counters of calling thread (disabled) and prints which events are counted.
+ * Hardware events that are not available, e.g. in a guest without vPMU, are left out.
+ * @param p counters
+ * @return Returns 0 on success or 1 if no event could be opened.
+ */
+int perf_open(perf_counters *p);
+
+/**
+ * @brief Closes counters.
+ * @param p counters
+ */
+void perf_close(perf_counters *p);
+
+/**
+ * @brief Resets and enables counters.
+ * @param p counters
+ */
+void perf_start(const perf_counters *p);
+
+/**
+ * @brief Disables counters and reads them. Values of multiplexed counters are scaled to the whole region.
+ * @param p counters
+ * @param values counted values, indexed by event (0 for events which are not counted)
+ * @return Returns 0 on success or 1 if counters could not be read.
+ */
+int perf_stop(const perf_counters *p, uint64_t values[PERF_EVENTS]);
+
+/**
+ * @brief Gets name of event used in result records, e.g. "dtlb_misses".
+ * @param event event
+ * @return Returns name.
+ */
+const char *perf_event_key(int event);
+
+/**
+ * @brief Initializes samples.
+ * @param s samples
+ * @param p counters, NULL if counters are not used
+ * @param capacity expected number of iterations (array grows if needed)
+ * @return Returns 0 on success or 1 if memory could not be allocated (perf_samples_add will try again).
+ */
+int perf_samples_init(perf_samples *s, const perf_counters *p, int capacity);
+
+/**
+ * @brief Adds counter values of one iteration.
+ * @param s samples
+ * @param values counter values, indexed by event
+ * @return Returns 0 on success or 1 if memory could not be allocated.
+ */
+int perf_samples_add(perf_samples *s, const uint64_t values[PERF_EVENTS]);
+
+/**
+ * @brief Releases samples.
+ * @param s samples
+ */
+void perf_samples_free(perf_samples *s);
+
+/**
+ * @brief Gets mean value of event per iteration.
+ * @param s samples
+ * @param event event
+ * @return Returns mean value or 0 if there are no samples.
+ */
+double perf_samples_mean(const perf_samples *s, int event);
+
+/**
+ * @brief Gets instructions per cycle.
+ * @param s samples
+ * @return Returns IPC or negative value if cycles or instructions are not counted.
+ */
+double perf_samples_ipc(const perf_samples *s);
+
+/**
+ * @brief Prints mean counter values per iteration, if counters are used.
+ * @param label name of measurement, e.g. "compression"
+ * @param s samples
+ */
+void print_perf_samples(const char *label, const perf_samples *s);
+
+#endif // PERF_H
@@ -0,0 +1,935 @@
+#include "pipeline.h"
+#include "benchmark.h"
+#include "report.h"
+#include "checksum.h"
+#include "timer.h"
+#include "input.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <sys/uio.h>
+#include <liburing.h>
+#endif
+
+// Kinds of io_uring requests, kept in user data with slot index.
+#define PIPELINE_TAG_WRITE 0x100
+
+static const char *backend_names[] = { "off", "auto", "uring", "threads" };
+
+// Buffers of one ring position. Block i is read into and compressed from slot i % PIPELINE_DEPTH.
+typedef struct {
+    unsigned char *in;      // Uncompressed block.
+    size_t in_len;
+    unsigned char *out;     // Compressed block, with archive header before the first and trailer after the last one.
+    size_t out_len;
+    int ready;              // io_uring: block is read.
+    int writing;            // io_uring: write of compressed block is in flight.
+} pipeline_slot;
+
+// State of pipeline, reused by all iterations. Shared fields of threads backend are protected by lock.
+typedef struct {
+    const codec *c;
+    void *ctx;
+    int fd;                 // Input file.
+    int drop_cache;         // Drop page cache of input before every iteration (--drop-cache).
+    size_t source_len;
+    size_t block_size;
+    size_t blocks;
+    size_t out_size;        // Size of compressed block buffers.
+    FILE *archfile;
+    FILE *outputfile;
+    const sink_options *sink;
+    size_t arch_len;
+    size_t output_len;
+    uint32_t source_crc;    // CRC32C of source for verification (--verify).
+    pipeline_slot slots[PIPELINE_DEPTH];
+    pipeline_stats iteration;   // Stage times of current iteration.
+    pipeline_stats stats;       // Sum of stage times of measured iterations.
+    // Threads backend.
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t reader;
+    pthread_t writer;
+    int threads;            // Number of started threads.
+    int running;
+    unsigned job;           // Started iterations, threads wait for the next one.
+    unsigned reader_job;    // Iterations finished by reader and writer.
+    unsigned writer_job;
+    int failed;
+    size_t read;            // Blocks of current iteration done by each stage.
+    size_t compressed;
+    size_t written;
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    int ring_ready;
+    int inflight[PIPELINE_STAGES];  // Requests in flight of read and write stage.
+    uint64_t since[PIPELINE_STAGES];    // timer_now() when stage got its first request in flight.
+#endif
+} pipeline;
+
+/**
+ * @brief Compresses one block from its slot into the same slot. Called only when the previous block
+ * (dictionary) is still in its slot.
+ * @param p pipeline
+ * @param i block index
+ * @param check checksum of preceding blocks, updated with the block
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int compress_slot(pipeline *p, size_t i, unsigned long *check)
+{
+    const block_codec *block = p->c->block;
+    pipeline_slot *slot = &p->slots[i % PIPELINE_DEPTH];
+    const pipeline_slot *prev = &p->slots[(i + PIPELINE_DEPTH - 1) % PIPELINE_DEPTH];
+    int last = i == p->blocks - 1;
+    unsigned long block_check;
+    size_t len = 0;
+    size_t n;
+
+    if (i == 0) {
+        len = block->header(p->ctx, p->block_size, slot->out);
+    }
+
+    n = p->out_size - len - BLOCK_TRAILER_MAX;
+    if (block->compress_block(p->ctx, i ? prev->in : NULL, i ? prev->in_len : 0, slot->in, slot->in_len, last,
+                              slot->out + len, &n, &block_check) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    *check = i ? block->combine_check(*check, block_check, slot->in_len) : block_check;
+    len += n;
+    if (last) {
+        len += block->trailer(p->ctx, *check, slot->out + len);
+    }
+
+    slot->out_len = len;
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Sets size of block in its slot.
+ * @param p pipeline
+ * @param i block index
+ * @return Returns slot of block.
+ */
+static pipeline_slot *block_slot_of(pipeline *p, size_t i)
+{
+    pipeline_slot *slot = &p->slots[i % PIPELINE_DEPTH];
+    size_t start = i * p->block_size;
+
+    slot->in_len = p->source_len - start < p->block_size ? p->source_len - start : p->block_size;
+    return slot;
+}
+
+/**
+ * @brief Reads block of input file.
+ * @param p pipeline
+ * @param i block index
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+static int read_block(pipeline *p, size_t i)
+{
+    pipeline_slot *slot = block_slot_of(p, i);
+    size_t done = 0;
+
+    while (done < slot->in_len) {
+        ssize_t n = pread(p->fd, slot->in + done, slot->in_len - done, i * p->block_size + done);
+        if (n <= 0) {
+            return 1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Reader thread: reads blocks of every iteration, when their slots were released by codec.
+ * A slot is free when the block after its previous block was compressed (the block is its dictionary).
+ * @param arg pipeline
+ * @return Returns NULL.
+ */
+static void *reader_thread(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+    unsigned job = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (p->running && p->job == job) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        if (!p->running) {
+            break;
+        }
+        job = p->job;
+
+        for (size_t i = 0; i < p->blocks; ++i) {
+            uint64_t start = timer_now();
+            int ret;
+
+            while (!p->failed && i + 2 > p->compressed + PIPELINE_DEPTH) {
+                pthread_cond_wait(&p->cond, &p->lock);
+            }
+            p->iteration.stall[PIPELINE_READ] += timer_ns(timer_now() - start);
+            if (p->failed) {
+                break;
+            }
+            pthread_mutex_unlock(&p->lock);
+
+            start = timer_now();
+            ret = read_block(p, i);
+
+            pthread_mutex_lock(&p->lock);
+            p->iteration.busy[PIPELINE_READ] += timer_ns(timer_now() - start);
+            if (ret != 0) {
+                puts("Error: problem with reading input file.");
+                p->failed = 1;
+            } else {
+                p->read++;
+            }
+            pthread_cond_broadcast(&p->cond);
+        }
+
+        p->reader_job = job;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Writer thread: writes compressed blocks of every iteration in order and flushes archive sink.
+ * @param arg pipeline
+ * @return Returns NULL.
+ */
+static void *writer_thread(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+    unsigned job = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        uint64_t start;
+        int ret = 0;
+
+        while (p->running && p->job == job) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        if (!p->running) {
+            break;
+        }
+        job = p->job;
+
+        for (size_t i = 0; i < p->blocks; ++i) {
+            pipeline_slot *slot = &p->slots[i % PIPELINE_DEPTH];
+
+            start = timer_now();
+            while (!p->failed && p->compressed <= i) {
+                pthread_cond_wait(&p->cond, &p->lock);
+            }
+            p->iteration.stall[PIPELINE_WRITE] += timer_ns(timer_now() - start);
+            if (p->failed) {
+                break;
+            }
+            pthread_mutex_unlock(&p->lock);
+
+            start = timer_now();
+            ret = fwrite(slot->out, 1, slot->out_len, p->archfile) != slot->out_len;
+
+            pthread_mutex_lock(&p->lock);
+            p->iteration.busy[PIPELINE_WRITE] += timer_ns(timer_now() - start);
+            if (ret) {
+                puts("Error: problem with writing archive file.");
+                p->failed = 1;
+            } else {
+                p->written++;
+            }
+            pthread_cond_broadcast(&p->cond);
+        }
+
+        if (!p->failed) {
+            pthread_mutex_unlock(&p->lock);
+            start = timer_now();
+            ret = sink_flush(p->sink, p->archfile);
+            pthread_mutex_lock(&p->lock);
+            p->iteration.busy[PIPELINE_WRITE] += timer_ns(timer_now() - start);
+            if (ret) {
+                puts("Error: problem with writing archive file.");
+                p->failed = 1;
+            }
+        }
+
+        p->writer_job = job;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Compresses input on calling thread, while reader and writer threads do I/O.
+ * @param p pipeline
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int threads_compress(pipeline *p)
+{
+    unsigned long check = 0;
+    uint64_t start, wait;
+    int ret;
+
+    pthread_mutex_lock(&p->lock);
+    p->read = p->compressed = p->written = 0;
+    p->failed = 0;
+    p->job++;
+    pthread_cond_broadcast(&p->cond);
+
+    for (size_t i = 0; i < p->blocks; ++i) {
+        start = timer_now();
+        while (!p->failed && p->read <= i) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        wait = timer_now();
+        p->iteration.input_wait += timer_ns(wait - start);
+        while (!p->failed && i >= p->written + PIPELINE_DEPTH) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        start = timer_now();
+        p->iteration.output_wait += timer_ns(start - wait);
+        if (p->failed) {
+            break;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        ret = compress_slot(p, i, &check);
+
+        pthread_mutex_lock(&p->lock);
+        p->iteration.busy[PIPELINE_CODEC] += timer_ns(timer_now() - start);
+        if (ret != CODEC_SUCCESS) {
+            p->failed = 1;
+        } else {
+            p->compressed++;
+        }
+        pthread_cond_broadcast(&p->cond);
+    }
+
+    // Archive is complete when writer wrote and flushed it.
+    start = timer_now();
+    while (p->reader_job != p->job || p->writer_job != p->job) {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    p->iteration.output_wait += timer_ns(timer_now() - start);
+    ret = p->failed ? CODEC_FAILURE : CODEC_SUCCESS;
+    pthread_mutex_unlock(&p->lock);
+
+    return ret;
+}
+
+/**
+ * @brief Stops reader and writer threads.
+ * @param p pipeline
+ */
+static void threads_stop(pipeline *p)
+{
+    pthread_mutex_lock(&p->lock);
+    p->running = 0;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->threads > 0) {
+        pthread_join(p->reader, NULL);
+    }
+    if (p->threads > 1) {
+        pthread_join(p->writer, NULL);
+    }
+    p->threads = 0;
+}
+
+/**
+ * @brief Starts reader and writer threads.
+ * @param p pipeline
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int threads_start(pipeline *p)
+{
+    p->running = 1;
+    if (pthread_create(&p->reader, NULL, reader_thread, p) != 0) {
+        puts("Error: problem with creating thread.");
+        return CODEC_FAILURE;
+    }
+    p->threads++;
+
+    if (pthread_create(&p->writer, NULL, writer_thread, p) != 0) {
+        puts("Error: problem with creating thread.");
+        threads_stop(p);
+        return CODEC_FAILURE;
+    }
+    p->threads++;
+
+    return CODEC_SUCCESS;
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * @brief Accounts request of stage put in flight.
+ * @param p pipeline
+ * @param stage PIPELINE_READ or PIPELINE_WRITE
+ */
+static void uring_issued(pipeline *p, int stage)
+{
+    if (p->inflight[stage]++ == 0) {
+        p->since[stage] = timer_now();
+    }
+}
+
+/**
+ * @brief Queues read of block into its slot (registered buffer i % PIPELINE_DEPTH).
+ * @param p pipeline
+ * @param i block index
+ * @return Returns 0 on success or 1 if submission queue is full.
+ */
+static int uring_queue_read(pipeline *p, size_t i)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&p->ring);
+    pipeline_slot *slot = block_slot_of(p, i);
+    int index = i % PIPELINE_DEPTH;
+
+    if (!sqe) {
+        return 1;
+    }
+
+    io_uring_prep_read_fixed(sqe, p->fd, slot->in, slot->in_len, i * p->block_size, index);
+    io_uring_sqe_set_data(sqe, (void*)(uintptr_t)index);
+    slot->ready = 0;
+    uring_issued(p, PIPELINE_READ);
+    return 0;
+}
+
+/**
+ * @brief Queues write of compressed block (registered buffer PIPELINE_DEPTH + slot index).
+ * @param p pipeline
+ * @param i block index
+ * @param offset archive offset of block
+ * @return Returns 0 on success or 1 if submission queue is full.
+ */
+static int uring_queue_write(pipeline *p, size_t i, size_t offset)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&p->ring);
+    pipeline_slot *slot = &p->slots[i % PIPELINE_DEPTH];
+    int index = i % PIPELINE_DEPTH;
+
+    if (!sqe) {
+        return 1;
+    }
+
+    io_uring_prep_write_fixed(sqe, fileno(p->archfile), slot->out, slot->out_len, offset, PIPELINE_DEPTH + index);
+    io_uring_sqe_set_data(sqe, (void*)(uintptr_t)(PIPELINE_TAG_WRITE | index));
+    slot->writing = 1;
+    uring_issued(p, PIPELINE_WRITE);
+    return 0;
+}
+
+/**
+ * @brief Takes one completion: marks block as read or its output buffer as free.
+ * Short reads and writes are errors (files are regular, sizes are known).
+ * @param p pipeline
+ * @param wait wait for completion if there is none
+ * @return Returns 1 if completion was taken, 0 if there is none or -1 if request failed.
+ */
+static int uring_reap(pipeline *p, int wait)
+{
+    struct io_uring_cqe *cqe = NULL;
+    uintptr_t tag;
+    pipeline_slot *slot;
+    int stage, ret;
+
+    ret = wait ? io_uring_wait_cqe(&p->ring, &cqe) : io_uring_peek_cqe(&p->ring, &cqe);
+    if (ret != 0) {
+        return wait ? -1 : 0;
+    }
+
+    tag = (uintptr_t)io_uring_cqe_get_data(cqe);
+    slot = &p->slots[tag & (PIPELINE_TAG_WRITE - 1)];
+    stage = tag & PIPELINE_TAG_WRITE ? PIPELINE_WRITE : PIPELINE_READ;
+    if (stage == PIPELINE_WRITE) {
+        ret = cqe->res == (int)slot->out_len ? 1 : -1;
+        slot->writing = 0;
+    } else {
+        ret = cqe->res == (int)slot->in_len ? 1 : -1;
+        slot->ready = 1;
+    }
+    io_uring_cqe_seen(&p->ring, cqe);
+
+    if (--p->inflight[stage] == 0) {
+        p->iteration.busy[stage] += timer_ns(timer_now() - p->since[stage]);
+    }
+    if (ret < 0) {
+        printf("Error: problem with %s file.\n", stage == PIPELINE_WRITE ? "writing archive" : "reading input");
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Compresses input on calling thread, which also queues reads ahead and writes behind the block being
+ * compressed. Completions are taken before and after every block.
+ * @param p pipeline
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int uring_compress(pipeline *p)
+{
+    unsigned long check = 0;
+    size_t next_read = 0;
+    size_t offset = 0;
+    uint64_t start, wait;
+    int ret = CODEC_SUCCESS;
+
+    for (size_t i = 0; i < p->blocks && ret == CODEC_SUCCESS; ++i) {
+        pipeline_slot *slot = &p->slots[i % PIPELINE_DEPTH];
+
+        // Slot of block i + PIPELINE_DEPTH - 1 holds dictionary of block i.
+        while (next_read < p->blocks && next_read + 2 <= i + PIPELINE_DEPTH && uring_queue_read(p, next_read) == 0) {
+            next_read++;
+        }
+        io_uring_submit(&p->ring);
+
+        start = timer_now();
+        while (ret == CODEC_SUCCESS && !slot->ready) {
+            ret = uring_reap(p, 1) < 0 ? CODEC_FAILURE : CODEC_SUCCESS;
+        }
+        wait = timer_now();
+        p->iteration.input_wait += timer_ns(wait - start);
+        while (ret == CODEC_SUCCESS && slot->writing) {
+            ret = uring_reap(p, 1) < 0 ? CODEC_FAILURE : CODEC_SUCCESS;
+        }
+        start = timer_now();
+        p->iteration.output_wait += timer_ns(start - wait);
+        if (ret != CODEC_SUCCESS) {
+            break;
+        }
+
+        ret = compress_slot(p, i, &check);
+        p->iteration.busy[PIPELINE_CODEC] += timer_ns(timer_now() - start);
+        if (ret != CODEC_SUCCESS) {
+            break;
+        }
+
+        // Submission queue has an entry for every buffer, so it is never full here.
+        uring_queue_write(p, i, offset);
+        offset += slot->out_len;
+        io_uring_submit(&p->ring);
+
+        while ((ret = uring_reap(p, 0)) > 0) {
+        }
+        ret = ret < 0 ? CODEC_FAILURE : CODEC_SUCCESS;
+    }
+
+    // Buffers are reused by the next iteration, so all requests are completed even after error.
+    start = timer_now();
+    while (p->inflight[PIPELINE_READ] || p->inflight[PIPELINE_WRITE]) {
+        if (uring_reap(p, 1) < 0) {
+            ret = CODEC_FAILURE;
+        }
+    }
+    if (ret == CODEC_SUCCESS) {
+        wait = timer_now();
+        if (sink_flush(p->sink, p->archfile) != 0) {
+            puts("Error: problem with writing archive file.");
+            ret = CODEC_FAILURE;
+        }
+        p->iteration.busy[PIPELINE_WRITE] += timer_ns(timer_now() - wait);
+    }
+    p->iteration.output_wait += timer_ns(timer_now() - start);
+
+    // Archive was written with pwrite, stdio position is moved to its end.
+    fseek(p->archfile, offset, SEEK_SET);
+    return ret;
+}
+
+/**
+ * @brief Sets up io_uring with input and output buffers registered.
+ * @param p pipeline with buffers allocated
+ * @return Returns 0 on success or 1 if io_uring is not available (e.g. disabled in kernel or by seccomp).
+ */
+static int uring_setup(pipeline *p)
+{
+    struct iovec iov[2 * PIPELINE_DEPTH];
+
+    if (io_uring_queue_init(2 * PIPELINE_DEPTH, &p->ring, 0) != 0) {
+        return 1;
+    }
+
+    for (int i = 0; i < PIPELINE_DEPTH; ++i) {
+        iov[i].iov_base = p->slots[i].in;
+        iov[i].iov_len = p->block_size;
+        iov[PIPELINE_DEPTH + i].iov_base = p->slots[i].out;
+        iov[PIPELINE_DEPTH + i].iov_len = p->out_size;
+    }
+
+    if (io_uring_register_buffers(&p->ring, iov, 2 * PIPELINE_DEPTH) != 0) {
+        io_uring_queue_exit(&p->ring);
+        return 1;
+    }
+
+    p->ring_ready = 1;
+    return 0;
+}
+#endif
+
+// Blocks are read from the device in every iteration, not from page cache filled by the previous one.
+static void pipeline_compress_before(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+
+    if (p->drop_cache) {
+        input_drop_cache(p->fd);
+    }
+}
+
+static int pipeline_compress_run(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+    uint64_t start;
+    uint64_t wall;
+    int ret;
+
+    memset(&p->iteration, 0, sizeof(p->iteration));
+    start = timer_now();
+#ifdef HAVE_LIBURING
+    if (p->stats.backend == PIPELINE_URING) {
+        static const int io_stages[] = { PIPELINE_READ, PIPELINE_WRITE };
+
+        ret = uring_compress(p);
+        wall = timer_ns(timer_now() - start);
+        // Kernel does the I/O, its stages stall whenever they have nothing in flight.
+        for (int i = 0; i < 2; ++i) {
+            uint64_t stage_busy = p->iteration.busy[io_stages[i]];
+            p->iteration.stall[io_stages[i]] = wall > stage_busy ? wall - stage_busy : 0;
+        }
+    } else
+#endif
+    {
+        ret = threads_compress(p);
+        wall = timer_ns(timer_now() - start);
+    }
+
+    p->iteration.wall = wall;
+    p->iteration.stall[PIPELINE_CODEC] = p->iteration.input_wait + p->iteration.output_wait;
+    return ret;
+}
+
+// Stage times of cold, warm-up and discarded iterations are dropped, as their wall times are.
+static void pipeline_compress_measured(void *arg, int kept)
+{
+    pipeline *p = (pipeline*)arg;
+
+    if (!kept) {
+        return;
+    }
+
+    p->stats.wall += p->iteration.wall;
+    for (int i = 0; i < PIPELINE_STAGES; ++i) {
+        p->stats.busy[i] += p->iteration.busy[i];
+        p->stats.stall[i] += p->iteration.stall[i];
+    }
+    p->stats.input_wait += p->iteration.input_wait;
+    p->stats.output_wait += p->iteration.output_wait;
+    p->stats.iterations++;
+}
+
+static void pipeline_compress_after(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+
+    p->arch_len = ftell(p->archfile);
+    rewind(p->archfile);
+}
+
+static int pipeline_decompress_run(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+
+    if (p->c->decompress_file(p->ctx, p->archfile, p->outputfile, p->source_len) != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    if (sink_flush(p->sink, p->outputfile) != 0) {
+        puts("Error: problem with writing output file.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static void pipeline_decompress_after(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+
+    p->output_len = ftell(p->outputfile);
+    rewind(p->archfile);
+    rewind(p->outputfile);
+}
+
+static int pipeline_decompress_verify(void *arg)
+{
+    pipeline *p = (pipeline*)arg;
+    uint32_t crc;
+
+    if (crc32c_file(p->outputfile, 0, p->output_len, &crc) != 0) {
+        printf("%s verification error: problem with reading output file.\n", p->c->name);
+        return CODEC_FAILURE;
+    }
+
+    return verify_checksum(p->c->name, p->source_len, p->source_crc, p->output_len, crc) ?
+                CODEC_FAILURE : CODEC_SUCCESS;
+}
+
+/**
+ * @brief Prints mean stage times per iteration, overlap and bottleneck.
+ * @param stats stage times
+ */
+static void print_pipeline(const pipeline_stats *stats)
+{
+    static const char *stages[] = { "read", "compress", "write" };
+    double n = stats->iterations ? stats->iterations : 1;
+
+    printf("Pipeline stages (mean per iteration of %.3f ms, %s):\n", stats->wall / 1e6 / n,
+           pipeline_backend_name(stats->backend));
+    for (int i = 0; i < PIPELINE_STAGES; ++i) {
+        printf("  %-8s busy %.3f ms (%.1f%%), stall %.3f ms (%.1f%%)\n", stages[i],
+               stats->busy[i] / 1e6 / n, stats->wall ? stats->busy[i] * 100.0 / stats->wall : 0.0,
+               stats->stall[i] / 1e6 / n, stats->wall ? stats->stall[i] * 100.0 / stats->wall : 0.0);
+    }
+    printf("Compress stall: waiting for input %.3f ms, for output buffers %.3f ms\n",
+           stats->input_wait / 1e6 / n, stats->output_wait / 1e6 / n);
+    printf("Overlap: %.1f%% of I/O time hidden behind compression, bottleneck: %s\n",
+           pipeline_overlap(stats), pipeline_bottleneck(stats));
+}
+
+/**
+ * @brief Releases pipeline: stops threads, tears io_uring down and frees buffers.
+ * @param p pipeline
+ */
+static void pipeline_destroy(pipeline *p)
+{
+    threads_stop(p);
+#ifdef HAVE_LIBURING
+    if (p->ring_ready) {
+        io_uring_queue_exit(&p->ring);
+    }
+#endif
+    for (int i = 0; i < PIPELINE_DEPTH; ++i) {
+        free(p->slots[i].in);
+        free(p->slots[i].out);
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->lock);
+}
+
+/**
+ * @brief Allocates buffers and starts I/O backend. Automatic backend falls back to threads,
+ * if io_uring is not built in, is not available or archive sink has no plain file descriptor.
+ * @param p pipeline with codec, block size and sink set
+ * @param backend requested backend
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int pipeline_create(pipeline *p, int backend)
+{
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    p->out_size = BLOCK_HEADER_MAX + p->c->block->block_bound(p->block_size) + BLOCK_TRAILER_MAX;
+    for (int i = 0; i < PIPELINE_DEPTH; ++i) {
+        p->slots[i].in = alloc_aligned_buffer(p->block_size);
+        p->slots[i].out = alloc_aligned_buffer(p->out_size);
+        if (!p->slots[i].in || !p->slots[i].out) {
+            puts("Error: problem with allocating memory for blocks.");
+            return CODEC_FAILURE;
+        }
+    }
+
+#ifdef HAVE_LIBURING
+    // Blocks of arbitrary size are written at arbitrary offsets, which O_DIRECT does not allow.
+    int fd_sink = (p->sink->type == SINK_FILE || p->sink->type == SINK_TMPFS) && !p->sink->direct;
+
+    if (backend != PIPELINE_THREADS && fd_sink && uring_setup(p) == 0) {
+        p->stats.backend = PIPELINE_URING;
+        return CODEC_SUCCESS;
+    }
+    if (backend == PIPELINE_URING) {
+        puts(fd_sink ? "Error: io_uring is not available." :
+                       "Error: io_uring pipeline needs file or tmpfs sink without --direct.");
+        return CODEC_FAILURE;
+    }
+#else
+    if (backend == PIPELINE_URING) {
+        puts("Error: io_uring pipeline is not built in (liburing was not found).");
+        return CODEC_FAILURE;
+    }
+#endif
+
+    p->stats.backend = PIPELINE_THREADS;
+    return threads_start(p);
+}
+
+int run_pipeline_benchmark(const codec *c, FILE *source, const char *file_name, bench_options options)
+{
+    measurement compression, decompression;
+    pipeline p;
+    bench_step compress_step = { pipeline_compress_before, pipeline_compress_run, pipeline_compress_after, &p, NULL,
+                                 pipeline_compress_measured };
+    bench_step decompress_step = { NULL, pipeline_decompress_run, pipeline_decompress_after, &p,
+                                   options.verify ? pipeline_decompress_verify : NULL };
+    char arch_file_name[FILENAME_MAX];
+    char output_file_name[FILENAME_MAX];
+    arena mem;
+    off_t file_size;
+    int ret;
+    int level = codec_level(c, options.level);
+
+    if (!c->block) {
+        printf("%s: pipelined compression not supported, skipped.\n", c->name);
+        return CODEC_SUCCESS;
+    }
+
+    if (options.block_size < c->block->min_block_size || options.block_size > c->block->max_block_size) {
+        printf("%s error: block size must be in the range of %zu to %zu bytes.\n",
+               c->name, c->block->min_block_size, c->block->max_block_size);
+        return CODEC_FAILURE;
+    }
+
+    file_size = get_file_size(source);
+    if (file_size < 0) {
+        puts("Error: problem with getting input file size.");
+        return CODEC_FAILURE;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.c = c;
+    p.fd = fileno(source);
+    p.drop_cache = options.drop_cache;
+    p.source_len = file_size;
+    p.block_size = options.block_size;
+    // There is always at least one (maybe empty) block, which is the last one.
+    p.blocks = p.source_len ? (p.source_len + p.block_size - 1) / p.block_size : 1;
+    p.sink = &options.sink;
+
+    if (make_file_names(file_name, c->extension, arch_file_name, output_file_name) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    // Arena holds only memory sink buffers and O_DIRECT stdio buffers.
+    arena_init(&mem);
+    p.archfile = sink_open(&options.sink, arch_file_name, c->compress_bound(p.source_len), 0, &mem);
+    if (!p.archfile) {
+        puts("Error: problem with opening archive file.");
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    p.outputfile = sink_open(&options.sink, output_file_name, p.source_len, 1, &mem);
+    if (!p.outputfile) {
+        puts("Error: problem with opening output file.");
+        fclose(p.archfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    if (c->init(&p.ctx, level, &options.params) != CODEC_SUCCESS) {
+        printf("%s error: problem with codec initialization.\n", c->name);
+        fclose(p.archfile);
+        fclose(p.outputfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    ret = pipeline_create(&p, options.pipeline);
+    if (ret == CODEC_SUCCESS && options.drop_cache && input_drop_cache(p.fd) != 0) {
+        puts("Error: problem with dropping page cache of input file.");
+        ret = CODEC_FAILURE;
+    }
+    if (ret == CODEC_SUCCESS && options.verify && crc32c_file(source, 0, p.source_len, &p.source_crc) != 0) {
+        puts("Error: problem with reading input file.");
+        ret = CODEC_FAILURE;
+    }
+    if (ret != CODEC_SUCCESS) {
+        pipeline_destroy(&p);
+        c->teardown(p.ctx);
+        fclose(p.archfile);
+        fclose(p.outputfile);
+        arena_destroy(&mem);
+        return CODEC_FAILURE;
+    }
+
+    printf("%s: pipelined mode (%s), block size %zu, %d buffers per stage, compression level set on %d\n",
+           c->name, pipeline_backend_name(p.stats.backend), p.block_size, PIPELINE_DEPTH, level);
+
+    ret = run_measurement(&compress_step, options, &compression);
+    if (ret == CODEC_SUCCESS) {
+        // Reader and writer threads do I/O of threads backend.
+        compression.threaded = p.stats.backend == PIPELINE_THREADS;
+        // Archive has the standard format, so it is decompressed serially.
+        ret = run_measurement(&decompress_step, options, &decompression);
+        if (ret == CODEC_SUCCESS) {
+            printf("Mean compression ratio: %.2f%%\n", p.source_len ? (p.arch_len / (double)p.source_len) * 100.0 : 0.0);
+            print_measurement("pipelined compression", &compression, p.source_len);
+            print_pipeline(&p.stats);
+            print_measurement("serial decompression", &decompression, p.source_len);
+            if (options.verify) {
+                printf("Verification: every decompressed output matches source (CRC32C %08x, %s)\n",
+                       p.source_crc, crc32c_implementation());
+            }
+            report_pipeline(c, options, p.source_len, p.arch_len, &compression, &decompression, &p.stats);
+        }
+        measurement_free(&decompression);
+    }
+    measurement_free(&compression);
+
+    pipeline_destroy(&p);
+    c->teardown(p.ctx);
+    fclose(p.archfile);
+    fclose(p.outputfile);
+    arena_destroy(&mem);
+    return ret;
+}
+
+double pipeline_overlap(const pipeline_stats *stats)
+{
+    double io = stats->busy[PIPELINE_READ] + stats->busy[PIPELINE_WRITE];
+    double stall = stats->stall[PIPELINE_CODEC];
+    double overlap;
+
+    if (io <= 0.0) {
+        return 100.0;
+    }
+
+    overlap = (1.0 - stall / io) * 100.0;
+    return overlap > 0.0 ? overlap : 0.0;
+}
+
+const char *pipeline_bottleneck(const pipeline_stats *stats)
+{
+    if (!stats->wall || stats->stall[PIPELINE_CODEC] * 100.0 / stats->wall < PIPELINE_STALL_THRESHOLD) {
+        return "codec";
+    }
+
+    return stats->input_wait >= stats->output_wait ? "read" : "write";
+}
+
+const char *pipeline_backend_name(int backend)
+{
+    return backend >= 0 && backend <= PIPELINE_THREADS ? backend_names[backend] : "unknown";
+}
+
+int pipeline_backend(const char *name)
+{
+    for (int i = PIPELINE_AUTO; i <= PIPELINE_THREADS; ++i) {
+        if (!strcmp(name, backend_names[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,89 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "codec.h"
+#include "util.h"
+
+// Buffers of every pipeline stage (input blocks and compressed blocks).
+#define PIPELINE_DEPTH 4
+
+// Codec stall (% of pipeline time) below which codec is the bottleneck.
+#define PIPELINE_STALL_THRESHOLD 5.0
+
+// I/O backend of pipelined mode.
+enum {
+    PIPELINE_OFF,       // Pipelined mode is not used.
+    PIPELINE_AUTO,      // io_uring if it is built in and available, threads otherwise.
+    PIPELINE_URING,     // io_uring with registered buffers, driven by codec thread.
+    PIPELINE_THREADS    // Reader and writer threads.
+};
+
+// Stages of pipeline.
+enum {
+    PIPELINE_READ,
+    PIPELINE_CODEC,
+    PIPELINE_WRITE,
+    PIPELINE_STAGES
+};
+
+/**
+ * Times of pipeline stages in ns, summed over measured iterations (cold, warm-up and discarded ones are not counted).
+ * Busy time of io_uring reads and writes is time with requests in flight, as seen by codec thread between blocks.
+ */
+typedef struct {
+    uint64_t wall;                      // Time of compression with reading and writing.
+    uint64_t busy[PIPELINE_STAGES];     // Reading, compressing, writing.
+    uint64_t stall[PIPELINE_STAGES];    // Waiting for other stage (reader for free buffer, codec for input
+                                        // or free output buffer, writer for compressed block).
+    uint64_t input_wait;                // Part of codec stall waiting for input.
+    uint64_t output_wait;               // Part of codec stall waiting for free output buffer and final write-out.
+    int iterations;
+    int backend;                        // PIPELINE_URING or PIPELINE_THREADS.
+} pipeline_stats;
+
+/**
+ * @brief Runs pipelined end-to-end benchmark, a model of backup agent: reads of block N+1 and writes
+ * of compressed block N-1 overlap compression of block N. Input file is read in blocks of options.block_size
+ * into a ring of PIPELINE_DEPTH buffers, blocks are compressed with codec's block interface (previous block
+ * is the dictionary) on calling thread and written in order to archive sink. I/O is done with io_uring
+ * (registered buffers) or with reader and writer threads. Archive has the standard format, so it is
+ * decompressed serially with codec's decompress_file. Overlap and stall times of stages are reported.
+ * @param c codec (must support block interface)
+ * @param source input file
+ * @param file_name input file name
+ * @param options benchmark options
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_pipeline_benchmark(const codec *c, FILE *source, const char *file_name, bench_options options);
+
+/**
+ * @brief Gets share of I/O time hidden behind compression.
+ * @param stats stage times
+ * @return Returns overlap in %.
+ */
+double pipeline_overlap(const pipeline_stats *stats);
+
+/**
+ * @brief Gets bottleneck of pipeline: codec, if it hardly waits for I/O, otherwise the I/O stage it waits for.
+ * @param stats stage times
+ * @return Returns "codec", "read" or "write".
+ */
+const char *pipeline_bottleneck(const pipeline_stats *stats);
+
+/**
+ * @brief Gets name of pipeline backend.
+ * @param backend PIPELINE_URING or PIPELINE_THREADS
+ * @return Returns "uring" or "threads".
+ */
+const char *pipeline_backend_name(int backend);
+
+/**
+ * @brief Parses pipeline backend name.
+ * @param name "auto", "uring" or "threads"
+ * @return Returns backend or -1 if name is invalid.
+ */
+int pipeline_backend(const char *name);
+
+#endif // PIPELINE_H
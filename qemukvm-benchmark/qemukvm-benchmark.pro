@@ -9,17 +9,73 @@ SOURCES += main.c \
     util.c \
     bzip2_compression.c \
     snappy_compression.c \
-    lzo_compression.c
+    lzo_compression.c \
+    zstd_compression.c \
+    lz4_compression.c \
+    codec.c \
+    benchmark.c \
+    threads.c \
+    parallel.c \
+    stats.c \
+    report.c \
+    corpus.c \
+    input.c \
+    arena.c \
+    sweep.c \
+    checksum.c \
+    perf.c \
+    steal.c \
+    synthetic.c \
+    migration.c \
+    histogram.c \
+    timer.c \
+    latency.c \
+    streams.c \
+    sink.c \
+    pipeline.c
 
 HEADERS += \
     zlib_compression.h \
     util.h \
     bzip2_compression.h \
     snappy_compression.h \
-    lzo_compression.h
+    lzo_compression.h \
+    zstd_compression.h \
+    lz4_compression.h \
+    codec.h \
+    benchmark.h \
+    threads.h \
+    parallel.h \
+    stats.h \
+    report.h \
+    corpus.h \
+    input.h \
+    arena.h \
+    sweep.h \
+    checksum.h \
+    perf.h \
+    steal.h \
+    synthetic.h \
+    migration.h \
+    histogram.h \
+    timer.h \
+    latency.h \
+    streams.h \
+    sink.h \
+    pipeline.h
 
 unix:!macx: LIBS += -lz
 unix:!macx: LIBS += -lrt
 unix:!macx: LIBS += -lbz2
 unix:!macx: LIBS += -lsnappy
 unix:!macx: LIBS += -llzo2
+unix:!macx: LIBS += -lzstd
+unix:!macx: LIBS += -llz4
+unix:!macx: LIBS += -lpthread
+unix:!macx: LIBS += -lm
+
+# io_uring backend of pipelined mode, built when liburing (liburing-dev) is installed.
+unix:!macx:exists(/usr/include/liburing.h) {
+    DEFINES += HAVE_LIBURING
+    LIBS += -luring
+}
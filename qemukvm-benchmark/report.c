@@ -0,0 +1,806 @@
+#include "report.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// Host/guest metadata, collected once.
+typedef struct {
+    char timestamp[32];
+    char hostname[256];
+    char kernel[256];
+    char machine[80];
+    char cpu_model[256];
+    long cpus;
+    char hypervisor[64];
+} host_info;
+
+static FILE *report_file;
+static int report_type;
+static host_info host;
+
+/**
+ * @brief Reads value of first line with given key from /proc/cpuinfo.
+ * @param key key, e.g. "model name"
+ * @param value buffer for value
+ * @param size buffer size
+ * @return Returns 0 on success or 1 if key was not found.
+ */
+static int read_cpuinfo(const char *key, char *value, size_t size)
+{
+    char line[1024];
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    int ret = 1;
+
+    if (!f) {
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (colon && !strncmp(line, key, strlen(key))) {
+            char *start = colon + 1;
+            while (*start == ' ' || *start == '\t') {
+                start++;
+            }
+            start[strcspn(start, "\n")] = '\0';
+            snprintf(value, size, "%s", start);
+            ret = 0;
+            break;
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+/**
+ * @brief Detects hypervisor: CPUID hypervisor leaf on x86 ("KVMKVMKVM", "TCGTCGTCGTCG" for QEMU TCG, ...),
+ * otherwise /sys/hypervisor/type. "none" means bare metal (or hypervisor which hides itself).
+ * @param name buffer for hypervisor name
+ * @param size buffer size
+ */
+static void detect_hypervisor(char *name, size_t size)
+{
+    FILE *f;
+
+    snprintf(name, size, "none");
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    // CPUID.1:ECX bit 31 - running under hypervisor.
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 31))) {
+        char vendor[13];
+
+        __cpuid(0x40000000, eax, ebx, ecx, edx);
+        memcpy(vendor, &ebx, 4);
+        memcpy(vendor + 4, &ecx, 4);
+        memcpy(vendor + 8, &edx, 4);
+        vendor[12] = '\0';
+        snprintf(name, size, "%s", vendor[0] ? vendor : "unknown");
+        return;
+    }
+#endif
+
+    f = fopen("/sys/hypervisor/type", "r");
+    if (f) {
+        if (fgets(name, size, f)) {
+            name[strcspn(name, "\n")] = '\0';
+        }
+        fclose(f);
+    }
+}
+
+static void collect_host_info(void)
+{
+    struct utsname uts;
+    time_t now = time(NULL);
+
+    memset(&host, 0, sizeof(host));
+    strftime(host.timestamp, sizeof(host.timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    if (gethostname(host.hostname, sizeof(host.hostname) - 1) != 0) {
+        snprintf(host.hostname, sizeof(host.hostname), "unknown");
+    }
+    if (uname(&uts) == 0) {
+        snprintf(host.kernel, sizeof(host.kernel), "%s %s", uts.sysname, uts.release);
+        snprintf(host.machine, sizeof(host.machine), "%s", uts.machine);
+    }
+    if (read_cpuinfo("model name", host.cpu_model, sizeof(host.cpu_model)) != 0) {
+        snprintf(host.cpu_model, sizeof(host.cpu_model), "unknown");
+    }
+    host.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    detect_hypervisor(host.hypervisor, sizeof(host.hypervisor));
+}
+
+/**
+ * @brief Writes JSON string with escaping.
+ * @param f output file
+ * @param str string
+ */
+static void write_json_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; str && *str; ++str) {
+        unsigned char ch = (unsigned char)*str;
+        if (ch == '"' || ch == '\\') {
+            fprintf(f, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(f, "\\u%04x", ch);
+        } else {
+            fputc(ch, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/**
+ * @brief Writes CSV field, quoted if needed.
+ * @param f output file
+ * @param str field value
+ */
+static void write_csv_string(FILE *f, const char *str)
+{
+    if (!str || !strpbrk(str, ",\"\n")) {
+        fputs(str ? str : "", f);
+        return;
+    }
+
+    fputc('"', f);
+    for (; *str; ++str) {
+        if (*str == '"') {
+            fputc('"', f);
+        }
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+/**
+ * @brief Writes CPU and steal time of measurement, per-iteration values and flagged iterations.
+ * @param f result file
+ * @param m measurement
+ */
+static void write_json_cpu(FILE *f, const measurement *m)
+{
+    // CPU time of calling thread doesn't cover work on other threads, so it is null.
+    if (m->threaded) {
+        fputs(",\"cpu_mean_ms\":null", f);
+    } else {
+        fprintf(f, ",\"cpu_mean_ms\":%.6f", m->cpu.count ? m->cpu.total / 1e6 / m->cpu.count : 0.0);
+    }
+    fprintf(f, ",\"steal_ms\":%.6f,\"stolen_iterations\":%d,\"discarded_iterations\":%d",
+            m->steal.total / 1e6, m->stolen, m->discarded);
+
+    if (m->peak_memory) {
+        fprintf(f, ",\"peak_memory\":%zu", m->peak_memory);
+    }
+    if (m->checksum) {
+        fprintf(f, ",\"checksum_ms\":%.6f", m->checksum / 1e6);
+    }
+
+    fputs(",\"cpu_ns\":[", f);
+    for (int i = 0; !m->threaded && i < m->cpu.count; ++i) {
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)m->cpu.samples[i]);
+    }
+    fputs("],\"steal_ns\":[", f);
+    for (int i = 0; i < m->steal.count; ++i) {
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)m->steal.samples[i]);
+    }
+    fputc(']', f);
+}
+
+/**
+ * @brief Writes mean counter values per iteration and per-iteration values of measurement (--perf).
+ * @param f result file
+ * @param s counter samples
+ */
+static void write_json_perf(FILE *f, const perf_samples *s)
+{
+    double ipc = perf_samples_ipc(s);
+    int first = 1;
+
+    fprintf(f, ",\"perf\":{\"hardware\":%s", s->available & ~PERF_SOFTWARE_EVENTS ? "true" : "false");
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        if (s->available & (1u << i)) {
+            fprintf(f, ",\"%s\":%.1f", perf_event_key(i), perf_samples_mean(s, i));
+        }
+    }
+    if (ipc >= 0.0) {
+        fprintf(f, ",\"ipc\":%.4f", ipc);
+    }
+
+    fputs("},\"perf_samples\":{", f);
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        if (!(s->available & (1u << i))) {
+            continue;
+        }
+        fprintf(f, "%s\"%s\":[", first ? "" : ",", perf_event_key(i));
+        for (int k = 0; k < s->count; ++k) {
+            fprintf(f, "%s%llu", k ? "," : "", (unsigned long long)s->values[(size_t)k * PERF_EVENTS + i]);
+        }
+        fputc(']', f);
+        first = 0;
+    }
+    fputc('}', f);
+}
+
+/**
+ * @brief Gets pages per second of migration workload record.
+ * @param r record
+ * @param summary summary of pass times
+ * @return Returns pages per second.
+ */
+static double pages_per_second(const result_record *r, const time_summary *summary)
+{
+    size_t pages = (r->input_size + r->page_size - 1) / r->page_size;
+
+    return summary->mean > 0.0 ? pages * 1000.0 / summary->mean : 0.0;
+}
+
+static void write_json(const result_record *r, const time_summary *summary, double throughput)
+{
+    FILE *f = report_file;
+
+    fputs("{\"codec\":", f);
+    write_json_string(f, r->codec);
+    fprintf(f, ",\"level\":%d,\"mode\":", r->level);
+    write_json_string(f, r->mode);
+    fputs(",\"operation\":", f);
+    write_json_string(f, r->operation);
+    fputs(",\"file\":", f);
+    write_json_string(f, r->file);
+    // Output size is unknown (0) for aggregate results.
+    if (r->output_size) {
+        fprintf(f, ",\"input_size\":%zu,\"output_size\":%zu,\"ratio\":%.4f",
+                r->input_size, r->output_size, r->input_size ? r->output_size / (double)r->input_size : 0.0);
+    } else {
+        fprintf(f, ",\"input_size\":%zu", r->input_size);
+    }
+    fprintf(f, ",\"threads\":%d", r->threads);
+    if (r->chunk_size) {
+        fprintf(f, ",\"chunk_size\":%zu", r->chunk_size);
+    }
+    if (r->method) {
+        fputs(",\"method\":", f);
+        write_json_string(f, r->method);
+    }
+    if (r->unsafe) {
+        fputs(",\"unsafe\":true", f);
+    }
+    if (r->dict_size) {
+        fprintf(f, ",\"dict_size\":%zu", r->dict_size);
+    }
+    if (r->workers) {
+        fprintf(f, ",\"workers\":%d", r->workers);
+    }
+    if (r->work_factor) {
+        fprintf(f, ",\"work_factor\":%d", r->work_factor);
+    }
+    if (r->small) {
+        fputs(",\"small\":true", f);
+    }
+    if (r->sink) {
+        fprintf(f, ",\"sink\":\"%s\"", r->sink);
+    }
+
+    if (r->m) {
+        fprintf(f, ",\"iterations\":%d,\"cold_ms\":%.6f,\"mean_ms\":%.6f,\"min_ms\":%.6f,\"median_ms\":%.6f,"
+                "\"p90_ms\":%.6f,\"p99_ms\":%.6f,\"max_ms\":%.6f,\"stddev_ms\":%.6f,\"ci95_ms\":%.6f,\"samples_ns\":[",
+                summary->count, r->m->cold / 1e6, summary->mean, summary->min, summary->median,
+                summary->p90, summary->p99, summary->max, summary->stddev, summary->ci95);
+        for (int i = 0; i < r->m->warm.count; ++i) {
+            fprintf(f, "%s%llu", i ? "," : "", (unsigned long long)r->m->warm.samples[i]);
+        }
+        fputc(']', f);
+        write_json_cpu(f, r->m);
+        if (r->m->perf.available && r->m->perf.count) {
+            write_json_perf(f, &r->m->perf);
+        }
+    }
+
+    if (r->setup_ms >= 0.0) {
+        fprintf(f, ",\"setup_ms\":%.6f,\"pages\":\"%s\"", r->setup_ms, r->pages);
+    }
+
+    fprintf(f, ",\"throughput_mbs\":%.3f", throughput);
+    if (r->scaling_efficiency >= 0.0) {
+        fprintf(f, ",\"scaling_efficiency\":%.2f", r->scaling_efficiency);
+    }
+    if (r->page_latency) {
+        time_summary page_summary;
+
+        samples_summary(r->page_latency, &page_summary);
+        fprintf(f, ",\"page_size\":%zu,\"zero_pages\":%zu,\"pages_per_s\":%.1f,\"page_p50_us\":%.3f,"
+                "\"page_p90_us\":%.3f,\"page_p99_us\":%.3f,\"page_max_us\":%.3f",
+                r->page_size, r->zero_pages, pages_per_second(r, summary), page_summary.median * 1000.0,
+                page_summary.p90 * 1000.0, page_summary.p99 * 1000.0, page_summary.max * 1000.0);
+    }
+
+    if (r->call_latency) {
+        fprintf(f, ",\"call_size\":%zu,\"calls\":%llu,\"call_mean_us\":%.3f,\"call_p50_us\":%.3f,"
+                "\"call_p99_us\":%.3f,\"call_p999_us\":%.3f,\"call_max_us\":%.3f",
+                r->call_size, (unsigned long long)r->call_latency->count, histogram_mean(r->call_latency) / 1e3,
+                histogram_percentile(r->call_latency, 50.0) / 1e3, histogram_percentile(r->call_latency, 99.0) / 1e3,
+                histogram_percentile(r->call_latency, 99.9) / 1e3, r->call_latency->max / 1e3);
+    }
+
+    if (r->queue_wait) {
+        fprintf(f, ",\"jobs\":%llu,\"queue_wait_mean_us\":%.3f,\"queue_wait_p50_us\":%.3f,"
+                "\"queue_wait_p99_us\":%.3f,\"queue_wait_max_us\":%.3f,\"utilization\":%.2f",
+                (unsigned long long)r->queue_wait->count, histogram_mean(r->queue_wait) / 1e3,
+                histogram_percentile(r->queue_wait, 50.0) / 1e3, histogram_percentile(r->queue_wait, 99.0) / 1e3,
+                r->queue_wait->max / 1e3, r->utilization);
+    }
+
+    if (r->pipeline) {
+        double n = r->pipeline->iterations ? r->pipeline->iterations : 1;
+
+        fprintf(f, ",\"overlap\":%.2f,\"bottleneck\":\"%s\",\"read_busy_ms\":%.6f,\"read_stall_ms\":%.6f,"
+                "\"compress_busy_ms\":%.6f,\"compress_stall_ms\":%.6f,\"write_busy_ms\":%.6f,\"write_stall_ms\":%.6f",
+                pipeline_overlap(r->pipeline), pipeline_bottleneck(r->pipeline),
+                r->pipeline->busy[PIPELINE_READ] / 1e6 / n, r->pipeline->stall[PIPELINE_READ] / 1e6 / n,
+                r->pipeline->busy[PIPELINE_CODEC] / 1e6 / n, r->pipeline->stall[PIPELINE_CODEC] / 1e6 / n,
+                r->pipeline->busy[PIPELINE_WRITE] / 1e6 / n, r->pipeline->stall[PIPELINE_WRITE] / 1e6 / n);
+    }
+
+    fprintf(f, ",\"host\":{\"timestamp\":\"%s\",\"hostname\":", host.timestamp);
+    write_json_string(f, host.hostname);
+    fputs(",\"kernel\":", f);
+    write_json_string(f, host.kernel);
+    fputs(",\"machine\":", f);
+    write_json_string(f, host.machine);
+    fputs(",\"cpu_model\":", f);
+    write_json_string(f, host.cpu_model);
+    fprintf(f, ",\"cpus\":%ld,\"hypervisor\":", host.cpus);
+    write_json_string(f, host.hypervisor);
+    fputs("}}\n", f);
+}
+
+static void write_csv_header(void)
+{
+    fputs("timestamp,hostname,kernel,machine,cpu_model,cpus,hypervisor,codec,level,mode,operation,file,"
+          "input_size,output_size,ratio,threads,chunk_size,method,unsafe,dict_size,workers,work_factor,small,sink,"
+          "iterations,cold_ms,mean_ms,min_ms,median_ms,p90_ms,p99_ms,max_ms,stddev_ms,ci95_ms,"
+          "cpu_mean_ms,steal_ms,stolen_iterations,discarded_iterations,peak_memory,checksum_ms,setup_ms,pages,throughput_mbs,scaling_efficiency,"
+          "page_size,zero_pages,pages_per_s,page_p50_us,page_p90_us,page_p99_us,page_max_us,"
+          "call_size,calls,call_mean_us,call_p50_us,call_p99_us,call_p999_us,call_max_us,"
+          "jobs,queue_wait_mean_us,queue_wait_p50_us,queue_wait_p99_us,queue_wait_max_us,utilization,"
+          "overlap,bottleneck,read_busy_ms,read_stall_ms,compress_busy_ms,compress_stall_ms,write_busy_ms,write_stall_ms,"
+          "cycles,instructions,ipc,cache_misses,branch_misses,dtlb_misses,context_switches,task_clock_ns,page_faults,"
+          "samples_ns\n", report_file);
+}
+
+static void write_csv(const result_record *r, const time_summary *summary, double throughput)
+{
+    FILE *f = report_file;
+
+    fprintf(f, "%s,", host.timestamp);
+    write_csv_string(f, host.hostname);
+    fputc(',', f);
+    write_csv_string(f, host.kernel);
+    fprintf(f, ",%s,", host.machine);
+    write_csv_string(f, host.cpu_model);
+    fprintf(f, ",%ld,", host.cpus);
+    write_csv_string(f, host.hypervisor);
+    fprintf(f, ",%s,%d,%s,%s,", r->codec, r->level, r->mode, r->operation);
+    write_csv_string(f, r->file);
+    if (r->output_size) {
+        fprintf(f, ",%zu,%zu,%.4f,%d,", r->input_size, r->output_size,
+                r->input_size ? r->output_size / (double)r->input_size : 0.0, r->threads);
+    } else {
+        fprintf(f, ",%zu,,,%d,", r->input_size, r->threads);
+    }
+    if (r->chunk_size) {
+        fprintf(f, "%zu", r->chunk_size);
+    }
+    fputc(',', f);
+    if (r->method) {
+        write_csv_string(f, r->method);
+    }
+    fprintf(f, ",%s,", r->unsafe ? "1" : "");
+    if (r->dict_size) {
+        fprintf(f, "%zu", r->dict_size);
+    }
+    fputc(',', f);
+    if (r->workers) {
+        fprintf(f, "%d", r->workers);
+    }
+    fputc(',', f);
+    if (r->work_factor) {
+        fprintf(f, "%d", r->work_factor);
+    }
+    fprintf(f, ",%s,%s,", r->small ? "1" : "", r->sink ? r->sink : "");
+
+    if (r->m) {
+        fprintf(f, "%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,",
+                summary->count, r->m->cold / 1e6, summary->mean, summary->min, summary->median,
+                summary->p90, summary->p99, summary->max, summary->stddev, summary->ci95);
+        if (!r->m->threaded) {
+            fprintf(f, "%.6f", r->m->cpu.count ? r->m->cpu.total / 1e6 / r->m->cpu.count : 0.0);
+        }
+        fprintf(f, ",%.6f,%d,%d,", r->m->steal.total / 1e6, r->m->stolen, r->m->discarded);
+        if (r->m->peak_memory) {
+            fprintf(f, "%zu", r->m->peak_memory);
+        }
+        fputc(',', f);
+        if (r->m->checksum) {
+            fprintf(f, "%.6f", r->m->checksum / 1e6);
+        }
+        fputc(',', f);
+    } else {
+        fputs(",,,,,,,,,,,,,,,,", f);
+    }
+
+    if (r->setup_ms >= 0.0) {
+        fprintf(f, "%.6f,%s,", r->setup_ms, r->pages);
+    } else {
+        fputs(",,", f);
+    }
+
+    fprintf(f, "%.3f,", throughput);
+    if (r->scaling_efficiency >= 0.0) {
+        fprintf(f, "%.2f", r->scaling_efficiency);
+    }
+    fputc(',', f);
+
+    if (r->page_latency) {
+        time_summary page_summary;
+
+        samples_summary(r->page_latency, &page_summary);
+        fprintf(f, "%zu,%zu,%.1f,%.3f,%.3f,%.3f,%.3f,", r->page_size, r->zero_pages, pages_per_second(r, summary),
+                page_summary.median * 1000.0, page_summary.p90 * 1000.0, page_summary.p99 * 1000.0,
+                page_summary.max * 1000.0);
+    } else {
+        fputs(",,,,,,,", f);
+    }
+
+    if (r->call_latency) {
+        fprintf(f, "%zu,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,", r->call_size, (unsigned long long)r->call_latency->count,
+                histogram_mean(r->call_latency) / 1e3, histogram_percentile(r->call_latency, 50.0) / 1e3,
+                histogram_percentile(r->call_latency, 99.0) / 1e3, histogram_percentile(r->call_latency, 99.9) / 1e3,
+                r->call_latency->max / 1e3);
+    } else {
+        fputs(",,,,,,,", f);
+    }
+
+    if (r->queue_wait) {
+        fprintf(f, "%llu,%.3f,%.3f,%.3f,%.3f,%.2f,", (unsigned long long)r->queue_wait->count,
+                histogram_mean(r->queue_wait) / 1e3, histogram_percentile(r->queue_wait, 50.0) / 1e3,
+                histogram_percentile(r->queue_wait, 99.0) / 1e3, r->queue_wait->max / 1e3, r->utilization);
+    } else {
+        fputs(",,,,,,", f);
+    }
+
+    if (r->pipeline) {
+        double n = r->pipeline->iterations ? r->pipeline->iterations : 1;
+
+        fprintf(f, "%.2f,%s,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,", pipeline_overlap(r->pipeline),
+                pipeline_bottleneck(r->pipeline),
+                r->pipeline->busy[PIPELINE_READ] / 1e6 / n, r->pipeline->stall[PIPELINE_READ] / 1e6 / n,
+                r->pipeline->busy[PIPELINE_CODEC] / 1e6 / n, r->pipeline->stall[PIPELINE_CODEC] / 1e6 / n,
+                r->pipeline->busy[PIPELINE_WRITE] / 1e6 / n, r->pipeline->stall[PIPELINE_WRITE] / 1e6 / n);
+    } else {
+        fputs(",,,,,,,,", f);
+    }
+
+    // Mean counter values per iteration, empty for events which are not counted.
+    for (int i = 0; i < PERF_EVENTS; ++i) {
+        const perf_samples *s = r->m ? &r->m->perf : NULL;
+
+        if (s && s->count && (s->available & (1u << i))) {
+            fprintf(f, "%.1f", perf_samples_mean(s, i));
+        }
+        fputc(',', f);
+        if (i == PERF_INSTRUCTIONS) {
+            if (s && s->count && perf_samples_ipc(s) >= 0.0) {
+                fprintf(f, "%.4f", perf_samples_ipc(s));
+            }
+            fputc(',', f);
+        }
+    }
+
+    // Per-iteration times separated with semicolons.
+    for (int i = 0; r->m && i < r->m->warm.count; ++i) {
+        fprintf(f, "%s%llu", i ? ";" : "", (unsigned long long)r->m->warm.samples[i]);
+    }
+    fputc('\n', f);
+}
+
+int report_open(int format, const char *path)
+{
+    long size;
+
+    report_file = fopen(path, "a");
+    if (!report_file) {
+        puts("Error: problem with opening result file.");
+        return 1;
+    }
+
+    report_type = format;
+    collect_host_info();
+
+    // Results of many runs can be appended to one file, CSV header is written only once.
+    fseek(report_file, 0, SEEK_END);
+    size = ftell(report_file);
+    if (format == REPORT_CSV && size == 0) {
+        write_csv_header();
+    }
+
+    return 0;
+}
+
+void report_close(void)
+{
+    if (report_file) {
+        fclose(report_file);
+        report_file = NULL;
+    }
+}
+
+void report_result(const result_record *r)
+{
+    time_summary summary;
+    double throughput = r->throughput;
+
+    if (!report_file) {
+        return;
+    }
+
+    memset(&summary, 0, sizeof(summary));
+    if (r->m) {
+        samples_summary(&r->m->warm, &summary);
+        throughput = summary.mean > 0.0 ? r->input_size / 1000.0 / summary.mean : 0.0;
+    }
+
+    if (report_type == REPORT_JSON) {
+        write_json(r, &summary, throughput);
+    } else {
+        write_csv(r, &summary, throughput);
+    }
+}
+
+/**
+ * @brief Sets codec parameters of record, the optional ones only for codecs which support them.
+ * @param r result record
+ * @param c codec
+ * @param options benchmark options
+ */
+static void set_params(result_record *r, const codec *c, bench_options options)
+{
+    r->chunk_size = options.params.chunk_size;
+    if (options.params.method && codec_has_method(c, options.params.method)) {
+        r->method = options.params.method;
+    }
+    r->unsafe = options.params.unsafe && c->unsafe_decompress;
+    r->dict_size = c->dictionary ? options.params.dict_len : 0;
+    r->workers = c->multithreaded ? options.params.workers : 0;
+    r->work_factor = c->work_factor ? options.params.work_factor : 0;
+    r->small = options.params.small && c->small_decompress;
+}
+
+void report_measurements(const codec *c, bench_options options, const char *mode, size_t source_len, size_t arch_len,
+                         const measurement *compression, const measurement *decompression, const arena *mem)
+{
+    result_record r;
+    char sink[32];
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = mode;
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+    r.output_size = arch_len;
+    r.threads = options.parallel ? options.parallel : 1;
+    // Codec-only benchmark writes no files.
+    r.sink = options.in_memory ? NULL : sink_describe(&options.sink, sink, sizeof(sink));
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = mem ? mem->setup_ns / 1e6 : -1.0;
+    r.pages = mem ? arena_backing(mem) : NULL;
+
+    r.operation = "compression";
+    r.m = compression;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.m = decompression;
+    report_result(&r);
+}
+
+void report_input(const codec *c, bench_options options, const char *method, size_t source_len,
+                  const measurement *input)
+{
+    result_record r;
+    char mode[32];
+
+    snprintf(mode, sizeof(mode), "end-to-end-%s", method);
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = mode;
+    r.operation = "input";
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+    r.threads = 1;
+    r.m = input;
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = -1.0;
+    report_result(&r);
+}
+
+void report_pages(const codec *c, bench_options options, size_t source_len, size_t stream_len, size_t zero_pages,
+                  const measurement *compression, const time_samples *compress_latency,
+                  const measurement *decompression, const time_samples *decompress_latency, const arena *mem)
+{
+    result_record r;
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = "migration";
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+    r.output_size = stream_len;
+    r.threads = 1;
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = mem->setup_ns / 1e6;
+    r.pages = arena_backing(mem);
+    r.page_size = options.page_size;
+    r.zero_pages = zero_pages;
+
+    r.operation = "compression";
+    r.m = compression;
+    r.page_latency = compress_latency;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.m = decompression;
+    r.page_latency = decompress_latency;
+    report_result(&r);
+}
+
+void report_latency(const codec *c, bench_options options, size_t call_size, size_t calls, size_t arch_len,
+                    const histogram *compression, const histogram *decompression)
+{
+    result_record r;
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = "latency";
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = call_size * calls;
+    r.output_size = arch_len;
+    r.threads = 1;
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = -1.0;
+    r.call_size = call_size;
+
+    r.operation = "compression";
+    r.call_latency = compression;
+    r.throughput = histogram_mean(compression) > 0.0 ? call_size * 1000.0 / histogram_mean(compression) : 0.0;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.call_latency = decompression;
+    r.throughput = histogram_mean(decompression) > 0.0 ? call_size * 1000.0 / histogram_mean(decompression) : 0.0;
+    report_result(&r);
+}
+
+void report_streams(const codec *c, bench_options options, size_t source_len, size_t arch_len, double compression,
+                    double decompression, const histogram *queue_wait, double utilization)
+{
+    result_record r;
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = "streams";
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+    r.output_size = arch_len;
+    r.threads = options.streams;
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = -1.0;
+    r.queue_wait = queue_wait;
+    r.utilization = utilization;
+
+    r.operation = "compression";
+    r.throughput = compression;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.throughput = decompression;
+    report_result(&r);
+}
+
+void report_pipeline(const codec *c, bench_options options, size_t source_len, size_t arch_len,
+                     const measurement *compression, const measurement *decompression, const pipeline_stats *stats)
+{
+    result_record r;
+    char mode[32];
+    char sink[32];
+
+    snprintf(mode, sizeof(mode), "pipeline-%s", pipeline_backend_name(stats->backend));
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = mode;
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+    r.output_size = arch_len;
+    r.threads = 1;
+    r.sink = sink_describe(&options.sink, sink, sizeof(sink));
+    r.scaling_efficiency = -1.0;
+    r.setup_ms = -1.0;
+
+    r.operation = "compression";
+    r.m = compression;
+    r.pipeline = stats;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.m = decompression;
+    r.pipeline = NULL;
+    report_result(&r);
+}
+
+void report_scaling(const codec *c, bench_options options, size_t source_len, double single_compression,
+                    double compression, double single_decompression, double decompression)
+{
+    result_record r;
+
+    memset(&r, 0, sizeof(r));
+    r.codec = c->name;
+    r.level = codec_level(c, options.level);
+    r.mode = "threads";
+    r.setup_ms = -1.0;
+    r.file = options.input_name;
+    set_params(&r, c, options);
+    r.input_size = source_len;
+
+    r.operation = "compression";
+    r.threads = 1;
+    r.throughput = single_compression;
+    r.scaling_efficiency = 100.0;
+    report_result(&r);
+
+    r.threads = options.threads;
+    r.throughput = compression;
+    r.scaling_efficiency = compression / (single_compression * options.threads) * 100.0;
+    report_result(&r);
+
+    r.operation = "decompression";
+    r.threads = 1;
+    r.throughput = single_decompression;
+    r.scaling_efficiency = 100.0;
+    report_result(&r);
+
+    r.threads = options.threads;
+    r.throughput = decompression;
+    r.scaling_efficiency = decompression / (single_decompression * options.threads) * 100.0;
+    report_result(&r);
+}
+
+int report_format(const char *name)
+{
+    if (!strcmp(name, "json")) {
+        return REPORT_JSON;
+    }
+    if (!strcmp(name, "csv")) {
+        return REPORT_CSV;
+    }
+
+    return REPORT_NONE;
+}
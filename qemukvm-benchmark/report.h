@@ -0,0 +1,174 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+#include "benchmark.h"
+#include "arena.h"
+#include "histogram.h"
+#include "pipeline.h"
+
+enum {
+    REPORT_NONE,
+    REPORT_JSON,    // JSON lines, one object per record.
+    REPORT_CSV
+};
+
+/**
+ * One result record: a measurement of one operation of codec on one input.
+ */
+typedef struct {
+    const char *codec;
+    int level;
+    const char *mode;           // "end-to-end", "in-memory", "parallel", "threads", "streams",
+                                // "pipeline-uring", "pipeline-threads"
+    const char *operation;      // "compression", "decompression"
+    const char *file;           // Input name.
+    size_t input_size;
+    size_t output_size;         // Compressed data size.
+    int threads;
+    size_t chunk_size;          // Streaming buffer size, 0 - codec default.
+    const char *method;         // Algorithm variant (--method), NULL - chosen by level.
+    int unsafe;                 // Decompression without checks of input.
+    size_t dict_size;           // Dictionary size, 0 - no dictionary.
+    int workers;                // Codec's own compression threads, 0 - none.
+    int work_factor;            // Work factor of compression, 0 - library default.
+    int small;                  // Decompression with less memory.
+    const char *sink;           // Destination of archive and output (sink_describe()), NULL - buffers only.
+    double setup_ms;            // Allocation and first touch time of buffers, negative if not measured.
+    const char *pages;          // Backing of buffers (arena_backing()), NULL if not measured.
+    const measurement *m;       // Per-iteration times, NULL for aggregate results.
+    double throughput;          // MB/s, used when m is NULL.
+    double scaling_efficiency;  // %, negative if not applicable.
+    size_t page_size;           // Page size of migration workload, 0 - whole input.
+    size_t zero_pages;          // Skipped zero pages of migration workload.
+    const time_samples *page_latency;   // Per-page latency of migration workload, NULL if not applicable.
+    size_t call_size;           // Buffer size of one call of latency benchmark.
+    const histogram *call_latency;      // Per-call latency of latency benchmark, NULL if not applicable.
+    const histogram *queue_wait;        // Queue wait of jobs of multi-stream mode, NULL if not applicable.
+    double utilization;         // Mean utilization of workers of multi-stream mode, %.
+    const pipeline_stats *pipeline;     // Stage times of pipelined compression, NULL if not applicable.
+} result_record;
+
+/**
+ * @brief Opens result file and collects host/guest metadata written with every record.
+ * @param format REPORT_JSON or REPORT_CSV
+ * @param path result file path
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int report_open(int format, const char *path);
+
+/**
+ * @brief Closes result file.
+ */
+void report_close(void);
+
+/**
+ * @brief Writes result record, if result file is open.
+ * @param r record
+ */
+void report_result(const result_record *r);
+
+/**
+ * @brief Writes compression and decompression records of one benchmark run.
+ * @param c codec
+ * @param options benchmark options
+ * @param mode benchmark mode name
+ * @param source_len uncompressed data size
+ * @param arch_len compressed data size
+ * @param compression compression measurement
+ * @param decompression decompression measurement
+ * @param mem arena of run, NULL if there is none
+ */
+void report_measurements(const codec *c, bench_options options, const char *mode, size_t source_len, size_t arch_len,
+                         const measurement *compression, const measurement *decompression, const arena *mem);
+
+/**
+ * @brief Writes record of input measurement (read or map of input file).
+ * @param c codec
+ * @param options benchmark options
+ * @param method input method name
+ * @param source_len input file size
+ * @param input input measurement
+ */
+void report_input(const codec *c, bench_options options, const char *method, size_t source_len,
+                  const measurement *input);
+
+/**
+ * @brief Writes compression and decompression records of migration workload.
+ * @param c codec
+ * @param options benchmark options
+ * @param source_len uncompressed data size
+ * @param stream_len size of sent pages
+ * @param zero_pages number of skipped zero pages
+ * @param compression compression measurement
+ * @param compress_latency per-page compression latency
+ * @param decompression decompression measurement
+ * @param decompress_latency per-page decompression latency
+ * @param mem arena of run
+ */
+void report_pages(const codec *c, bench_options options, size_t source_len, size_t stream_len, size_t zero_pages,
+                  const measurement *compression, const time_samples *compress_latency,
+                  const measurement *decompression, const time_samples *decompress_latency, const arena *mem);
+
+/**
+ * @brief Writes compression and decompression records of one call size of latency benchmark.
+ * @param c codec
+ * @param options benchmark options
+ * @param call_size buffer size of one call
+ * @param calls number of buffers (calls in one pass)
+ * @param arch_len total compressed size of buffers
+ * @param compression compression call latency
+ * @param decompression decompression call latency
+ */
+void report_latency(const codec *c, bench_options options, size_t call_size, size_t calls, size_t arch_len,
+                    const histogram *compression, const histogram *decompression);
+
+/**
+ * @brief Writes compression and decompression records of one codec and level of multi-stream benchmark.
+ * @param c codec
+ * @param options benchmark options
+ * @param source_len uncompressed size of files of measured jobs
+ * @param arch_len compressed size of files of measured jobs
+ * @param compression compression throughput of a single stream in MB/s
+ * @param decompression decompression throughput of a single stream in MB/s
+ * @param queue_wait queue wait of all measured jobs
+ * @param utilization mean utilization of workers, %
+ */
+void report_streams(const codec *c, bench_options options, size_t source_len, size_t arch_len, double compression,
+                    double decompression, const histogram *queue_wait, double utilization);
+
+/**
+ * @brief Writes compression and serial decompression records of pipelined benchmark.
+ * Compression record holds mean stage times per iteration, overlap and bottleneck.
+ * @param c codec
+ * @param options benchmark options
+ * @param source_len uncompressed data size
+ * @param arch_len archive size
+ * @param compression pipelined compression measurement
+ * @param decompression serial decompression measurement
+ * @param stats stage times
+ */
+void report_pipeline(const codec *c, bench_options options, size_t source_len, size_t arch_len,
+                     const measurement *compression, const measurement *decompression, const pipeline_stats *stats);
+
+/**
+ * @brief Writes single thread and aggregate records of threaded benchmark.
+ * @param c codec
+ * @param options benchmark options
+ * @param source_len uncompressed data size
+ * @param single_compression single thread compression throughput in MB/s
+ * @param compression aggregate compression throughput in MB/s
+ * @param single_decompression single thread decompression throughput in MB/s
+ * @param decompression aggregate decompression throughput in MB/s
+ */
+void report_scaling(const codec *c, bench_options options, size_t source_len, double single_compression,
+                    double compression, double single_decompression, double decompression);
+
+/**
+ * @brief Parses format name.
+ * @param name "json" or "csv"
+ * @return Returns REPORT_JSON, REPORT_CSV or REPORT_NONE if name is invalid.
+ */
+int report_format(const char *name);
+
+#endif // REPORT_H
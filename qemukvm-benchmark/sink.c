@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include "sink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+
+#ifndef TMPFS_MAGIC
+#define TMPFS_MAGIC 0x01021994
+#endif
+
+static const char *sink_names[] = { "file", "tmpfs", "memory", "null" };
+
+// Memory buffer behind FILE of memory and null sinks.
+typedef struct {
+    unsigned char *data;    // NULL - written data is discarded (null sink).
+    size_t capacity;
+    size_t len;             // Size of written data.
+    size_t pos;
+} memory_file;
+
+static ssize_t memory_read(void *cookie, char *buf, size_t size)
+{
+    memory_file *m = (memory_file*)cookie;
+    size_t n = m->data && m->pos < m->len ? m->len - m->pos : 0;
+
+    if (n > size) {
+        n = size;
+    }
+    memcpy(buf, m->data + m->pos, n);
+    m->pos += n;
+    return n;
+}
+
+static ssize_t memory_write(void *cookie, const char *buf, size_t size)
+{
+    memory_file *m = (memory_file*)cookie;
+
+    if (m->data) {
+        if (size > m->capacity - m->pos) {
+            errno = ENOSPC;
+            return 0;
+        }
+        memcpy(m->data + m->pos, buf, size);
+    }
+
+    m->pos += size;
+    if (m->pos > m->len) {
+        m->len = m->pos;
+    }
+    return size;
+}
+
+static int memory_seek(void *cookie, off64_t *offset, int whence)
+{
+    memory_file *m = (memory_file*)cookie;
+    off64_t pos = *offset;
+
+    if (whence == SEEK_CUR) {
+        pos += m->pos;
+    } else if (whence == SEEK_END) {
+        pos += m->len;
+    }
+
+    if (pos < 0 || (m->data && (size_t)pos > m->capacity)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    m->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int memory_close(void *cookie)
+{
+    free(cookie);
+    return 0;
+}
+
+/**
+ * @brief Opens stream on memory buffer.
+ * @param data buffer, NULL - written data is discarded
+ * @param capacity buffer size
+ * @return Returns stream or NULL if something go wrong.
+ */
+static FILE *open_memory(unsigned char *data, size_t capacity)
+{
+    cookie_io_functions_t io = { memory_read, memory_write, memory_seek, memory_close };
+    memory_file *m = (memory_file*)calloc(1, sizeof(memory_file));
+    FILE *f;
+
+    if (!m) {
+        return NULL;
+    }
+    m->data = data;
+    m->capacity = capacity;
+
+    f = fopencookie(m, "w+", io);
+    if (!f) {
+        free(m);
+        return NULL;
+    }
+
+    return f;
+}
+
+/**
+ * @brief Creates (truncates) file and opens stream on it.
+ * @param path file name
+ * @param direct O_DIRECT
+ * @param mem arena for aligned stdio buffer of O_DIRECT file
+ * @return Returns stream or NULL if something go wrong.
+ */
+static FILE *open_file(const char *path, int direct, arena *mem)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0666);
+    FILE *f;
+    void *buf;
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    f = fdopen(fd, "w+");
+    if (!f) {
+        close(fd);
+        return NULL;
+    }
+
+    // Full buffers are written at aligned offsets from aligned memory, as O_DIRECT requires.
+    if (direct) {
+        buf = arena_alloc(mem, SINK_DIRECT_BUFFER);
+        if (!buf || setvbuf(f, (char*)buf, _IOFBF, SINK_DIRECT_BUFFER) != 0) {
+            fclose(f);
+            return NULL;
+        }
+    }
+
+    return f;
+}
+
+FILE *sink_open(const sink_options *options, const char *path, size_t capacity, int output, arena *mem)
+{
+    char tmpfs_path[FILENAME_MAX];
+    const char *base;
+    unsigned char *data = NULL;
+
+    switch (options->type) {
+    case SINK_TMPFS:
+        base = strrchr(path, '/');
+        snprintf(tmpfs_path, sizeof(tmpfs_path), "%s/%s", options->dir, base ? base + 1 : path);
+        return open_file(tmpfs_path, options->direct, mem);
+    case SINK_MEMORY:
+    case SINK_NULL:
+        if (options->type == SINK_MEMORY || !output) {
+            capacity += capacity / 64 + SINK_MEMORY_SLACK;
+            data = (unsigned char*)arena_alloc(mem, capacity);
+            if (!data) {
+                return NULL;
+            }
+        }
+        return open_memory(data, capacity);
+    default:
+        return open_file(path, options->direct, mem);
+    }
+}
+
+int sink_flush(const sink_options *options, FILE *f)
+{
+    int fd, flags = 0;
+    int ret;
+
+    if (options->type != SINK_FILE && options->type != SINK_TMPFS) {
+        return fflush(f) != 0;
+    }
+
+    fd = fileno(f);
+    if (options->direct) {
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_DIRECT) != 0) {
+            return 1;
+        }
+    }
+
+    ret = fflush(f) != 0;
+    if (options->direct && fcntl(fd, F_SETFL, flags) != 0) {
+        ret = 1;
+    }
+    if (!ret && options->sync && fsync(fd) != 0) {
+        ret = 1;
+    }
+
+    return ret;
+}
+
+int sink_on_tmpfs(const char *dir)
+{
+    struct statfs fs;
+
+    return statfs(dir, &fs) == 0 && fs.f_type == TMPFS_MAGIC;
+}
+
+const char *sink_describe(const sink_options *options, char *buf, size_t size)
+{
+    snprintf(buf, size, "%s%s%s", sink_names[options->type], options->direct ? "+direct" : "",
+             options->sync ? "+fsync" : "");
+    return buf;
+}
+
+int sink_type(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(sink_names) / sizeof(sink_names[0])); ++i) {
+        if (!strcmp(name, sink_names[i])) {
+            return i;
+        }
+    }
+
+    return -1;
+}
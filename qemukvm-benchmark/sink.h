@@ -0,0 +1,78 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "arena.h"
+
+// Default directory of tmpfs sink.
+#define SINK_TMPFS_DIR "/dev/shm"
+
+// Size of aligned stdio buffer of O_DIRECT files (multiple of logical block size of any device).
+#define SINK_DIRECT_BUFFER (1024 * 1024)
+
+// Space added to memory sink buffers for container overhead of file formats (headers, block and frame lengths).
+#define SINK_MEMORY_SLACK (1024 * 1024)
+
+// Destination of archive and decompressed output of end-to-end and parallel benchmarks.
+enum {
+    SINK_FILE,      // Files next to input (<input><extension> and <...>_dec).
+    SINK_TMPFS,     // Files in tmpfs directory, no writeback to block device.
+    SINK_MEMORY,    // Preallocated memory buffers behind FILE (fopencookie()).
+    SINK_NULL       // Archive in memory (decompression reads it), decompressed output is discarded.
+};
+
+typedef struct {
+    int type;
+    const char *dir;    // Directory of tmpfs sink.
+    int sync;           // fsync() at the end of every iteration, inside timed region (file and tmpfs sinks).
+    int direct;         // O_DIRECT (file and tmpfs sinks).
+} sink_options;
+
+/**
+ * @brief Opens archive or decompressed output of benchmark run for reading and writing, files are truncated.
+ * File sink opens path, tmpfs sink base name of path in its directory. Memory sink buffer has capacity bytes
+ * (plus slack for container overhead) from arena, null sink discards output and keeps archive in memory.
+ * O_DIRECT files get aligned stdio buffer of SINK_DIRECT_BUFFER bytes from arena.
+ * @param options sink options
+ * @param path file name next to input
+ * @param capacity archive or output size limit of memory sink
+ * @param output 1 - decompressed output, 0 - archive
+ * @param mem arena for memory buffers
+ * @return Returns stream or NULL if something go wrong.
+ */
+FILE *sink_open(const sink_options *options, const char *path, size_t capacity, int output, arena *mem);
+
+/**
+ * @brief Writes buffered data out at the end of timed iteration: fflush() and fsync() with options->sync.
+ * Tail of O_DIRECT file, which is not a multiple of block size, is written through page cache.
+ * @param options sink options
+ * @param f stream opened with sink_open()
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int sink_flush(const sink_options *options, FILE *f);
+
+/**
+ * @brief Checks if directory is on tmpfs.
+ * @param dir directory
+ * @return Returns 1 if directory is on tmpfs, otherwise 0.
+ */
+int sink_on_tmpfs(const char *dir);
+
+/**
+ * @brief Describes sink with its flags, e.g. "file+direct+fsync".
+ * @param options sink options
+ * @param buf buffer for description
+ * @param size buffer size
+ * @return Returns buf.
+ */
+const char *sink_describe(const sink_options *options, char *buf, size_t size);
+
+/**
+ * @brief Parses sink name.
+ * @param name "file", "tmpfs", "memory" or "null"
+ * @return Returns sink type or -1 if name is invalid.
+ */
+int sink_type(const char *name);
+
+#endif // SINK_H
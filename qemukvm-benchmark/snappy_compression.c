@@ -1,146 +1,335 @@
 #include "snappy_compression.h"
 #include "util.h"
+#include "arena.h"
+#include "checksum.h"
 #include <snappy-c.h>
 #include <stdlib.h>
+#include <string.h>
 
-static float mean_compression_time;
-static float mean_compression_ratio;
-static float mean_decompression_time;
+// Chunk types of framing format.
+enum {
+    FRAME_COMPRESSED = 0x00,
+    FRAME_UNCOMPRESSED = 0x01,
+    FRAME_RESERVED = 0x80,      // Chunk types from 0x80 up are skippable (0xfe is padding).
+    FRAME_STREAM_ID = 0xff
+};
+
+// Chunk header: type and 24-bit little endian length of chunk data.
+#define FRAME_HEADER_SIZE 4
+
+// Masked CRC32C of uncompressed data in front of data of compressed and uncompressed chunks.
+#define FRAME_CRC_SIZE 4
+
+// Stream identifier chunk, starts every stream.
+static const unsigned char stream_id[] = { FRAME_STREAM_ID, 0x06, 0x00, 0x00, 's', 'N', 'a', 'P', 'p', 'Y' };
+
+typedef struct {
+    work_buffer in;         // Streaming buffers of file functions: uncompressed chunk and chunk of archive.
+    work_buffer out;
+    uint64_t checksum_ns;   // Time of CRC32C of chunks since the last snappy_checksum_time().
+} snappy_context;
+
+static int snappy_init(void **ctx, int level, const codec_params *params)
+{
+    // Snappy has no compression levels, context holds only buffers.
+    snappy_context *context = (snappy_context*)calloc(1, sizeof(snappy_context));
+    if (!context) {
+        return CODEC_FAILURE;
+    }
+
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t snappy_compress_bound(size_t source_len)
+{
+    return snappy_max_compressed_length(source_len);
+}
+
+static int snappy_compress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                  unsigned char *dest, size_t *dest_len)
+{
+    if (snappy_compress((const char*)source, source_len, (char*)dest, dest_len) != SNAPPY_OK) {
+        puts("snappy compression error.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int snappy_decompress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                    unsigned char *dest, size_t *dest_len)
+{
+    if (snappy_uncompress((const char*)source, source_len, (char*)dest, dest_len) != SNAPPY_OK) {
+        puts("snappy decompression error.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
 
 /**
- * @brief Compresses source file to archive file. Measures compression stats.
- * @param source source file
- * @param arch archive file
- * @return Returns SNAPPY_SUCCESS on success or SNAPPY_FAILURE if something go wrong.
+ * @brief Gets masked CRC32C of chunk data (masking keeps CRC of data which contains CRCs well distributed)
+ * and adds its time to checksum time of context.
+ * @param context snappy context
+ * @param data uncompressed chunk data
+ * @param len data size
+ * @return Returns masked CRC32C.
  */
-int compress(FILE *source, FILE *arch)
+static uint32_t masked_crc(snappy_context *context, const unsigned char *data, size_t len)
 {
     struct timespec start_ts, stop_ts;
-    char *buffer;
-    char *compressed;
-    int buf_len;
-    size_t compressed_len;
-
-    buf_len = get_file_size(source);
-    buffer = (char*)malloc(sizeof(char) * buf_len);
-    if (!buffer) {
-        puts("snappy compression error: problem with allocating memory for input buffer.");
-        return SNAPPY_FAILURE;
-    }
+    uint32_t crc;
 
-    compressed = (char*)malloc(sizeof(char) * snappy_max_compressed_length(buf_len));
-    if (!compressed) {
-        puts("snappy compression error: problem with allocating memory for archive buffer.");
-        if (buffer) {
-            free(buffer);
-            buffer = NULL;
-        }
-        return SNAPPY_FAILURE;
+    get_time(&start_ts);
+    crc = crc32c(0, data, len);
+    get_time(&stop_ts);
+    context->checksum_ns += elapsed_ns(start_ts, stop_ts);
+
+    return ((crc >> 15) | (crc << 17)) + 0xa282ead8;
+}
+
+/**
+ * @brief Writes 32-bit value in little endian order.
+ */
+static void put_le32(unsigned char *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+/**
+ * @brief Reads 32-bit value in little endian order.
+ */
+static uint32_t get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Gets streaming buffers of context, allocated on first use.
+ * @param context snappy context
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if memory could not be allocated.
+ */
+static int streaming_buffers(snappy_context *context)
+{
+    size_t frame_size = FRAME_HEADER_SIZE + FRAME_CRC_SIZE + snappy_max_compressed_length(SNAPPY_FRAME_CHUNK);
+
+    if (work_buffer_reserve(&context->in, SNAPPY_FRAME_CHUNK, NULL) != 0 ||
+            work_buffer_reserve(&context->out, frame_size, NULL) != 0) {
+        return CODEC_FAILURE;
     }
 
-    // Start measure time.
-    clock_gettime(CLOCK_REALTIME, &start_ts);
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Compresses source file to archive file in framing format: stream identifier, then every
+ * SNAPPY_FRAME_CHUNK bytes of input as compressed chunk (or uncompressed one, if data doesn't shrink)
+ * with masked CRC32C of its data. Memory use doesn't depend on file size.
+ * @param ctx codec context
+ * @param source source file
+ * @param arch archive file
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int snappy_compress_file(void *ctx, FILE *source, FILE *arch)
+{
+    snappy_context *context = (snappy_context*)ctx;
+    size_t len;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS) {
+        puts("snappy compression error: problem with allocating memory for buffers.");
+        return CODEC_FAILURE;
+    }
 
-    fread(buffer, 1, buf_len, source);
+    if (fwrite(stream_id, 1, sizeof(stream_id), arch) != sizeof(stream_id)) {
+        puts("snappy compression error: problem with writing to archive file");
+        return CODEC_FAILURE;
+    }
 
-    snappy_compress(buffer, buf_len, compressed, &compressed_len);
+    while ((len = fread(context->in.data, 1, SNAPPY_FRAME_CHUNK, source)) > 0) {
+        unsigned char *frame = context->out.data;
+        size_t data_len = snappy_max_compressed_length(SNAPPY_FRAME_CHUNK);
 
-    fwrite(compressed, 1, compressed_len, arch);
+        put_le32(frame + FRAME_HEADER_SIZE, masked_crc(context, context->in.data, len));
+        if (snappy_compress((const char*)context->in.data, len, (char*)frame + FRAME_HEADER_SIZE + FRAME_CRC_SIZE,
+                            &data_len) != SNAPPY_OK) {
+            puts("snappy compression error.");
+            return CODEC_FAILURE;
+        }
 
-    // Print/measure stats.
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_compression_time += result_ts.tv_nsec / 1000000.0f;
-    mean_compression_ratio += (compressed_len / (float)buf_len) * 100.0f;
+        if (data_len < len) {
+            frame[0] = FRAME_COMPRESSED;
+        } else {
+            frame[0] = FRAME_UNCOMPRESSED;
+            memcpy(frame + FRAME_HEADER_SIZE + FRAME_CRC_SIZE, context->in.data, len);
+            data_len = len;
+        }
+        data_len += FRAME_CRC_SIZE;
+        frame[1] = data_len;
+        frame[2] = data_len >> 8;
+        frame[3] = data_len >> 16;
 
-    if (buffer) {
-        free(buffer);
-        buffer = NULL;
+        if (fwrite(frame, 1, FRAME_HEADER_SIZE + data_len, arch) != FRAME_HEADER_SIZE + data_len || ferror(arch)) {
+            puts("snappy compression error: problem with writing to archive file");
+            return CODEC_FAILURE;
+        }
     }
 
-    if (compressed) {
-        free(compressed);
-        compressed = NULL;
+    if (ferror(source)) {
+        puts("snappy compression error: problem with reading input file.");
+        return CODEC_FAILURE;
     }
-    return SNAPPY_SUCCESS;
+
+    return CODEC_SUCCESS;
 }
 
 /**
- * @brief Decompresses archive file and measures decompression stats.
+ * @brief Decompresses archive file in framing format to output file, chunk by chunk. CRC32C of every
+ * chunk is checked, skippable chunks are skipped.
+ * @param ctx codec context
  * @param arch archive file
  * @param output_file output, decompressed file
- * @return Returns SNAPPY_SUCCESS on success or SNAPPY_FAILURE if something go wrong.
+ * @param source_len source (uncompressed) data size.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
  */
-int decompress(FILE *arch, FILE *output_file)
+static int snappy_decompress_file(void *ctx, FILE *arch, FILE *output_file, size_t source_len)
 {
-    struct timespec start_ts, stop_ts;
-    char *compressed = NULL;
-    int compressed_len = 0;
-    char *uncompressed = NULL;
-    size_t uncompressed_len = 0;
-
-    compressed_len = get_file_size(arch);
-    compressed = (char*)malloc(sizeof(char) * compressed_len);
-    if (!compressed) {
-        puts("snappy decompression error: problem with allocating memory for archive buffer.");
-        return SNAPPY_FAILURE;
+    snappy_context *context = (snappy_context*)ctx;
+    size_t frame_max = FRAME_CRC_SIZE + snappy_max_compressed_length(SNAPPY_FRAME_CHUNK);
+    size_t total_len = 0;
+    unsigned char header[FRAME_HEADER_SIZE];
+    int stream_started = 0;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS) {
+        puts("snappy decompression error: problem with allocating memory for buffers.");
+        return CODEC_FAILURE;
     }
 
-    clock_gettime(CLOCK_REALTIME, &start_ts);
+    while (fread(header, 1, FRAME_HEADER_SIZE, arch) == FRAME_HEADER_SIZE) {
+        size_t data_len = header[1] | (header[2] << 8) | (header[3] << 16);
+        unsigned char *data = context->out.data;
+        const unsigned char *chunk;
+        size_t len = SNAPPY_FRAME_CHUNK;
 
-    fread(compressed, 1, compressed_len, arch);
-    snappy_uncompressed_length(compressed, compressed_len, &uncompressed_len);
-    uncompressed = (char*)malloc(sizeof(char) * uncompressed_len);
-    if (!uncompressed) {
-        puts("snappy decompression error: problem with allocating memory for output buffer.");
-        if (compressed) {
-            free(compressed);
-            compressed = NULL;
+        if (header[0] >= FRAME_RESERVED && header[0] != FRAME_STREAM_ID) {
+            if (fseek(arch, data_len, SEEK_CUR) != 0) {
+                puts("snappy decompression error: problem with reading archive file.");
+                return CODEC_FAILURE;
+            }
+            continue;
+        }
+
+        if ((header[0] == FRAME_STREAM_ID && data_len != sizeof(stream_id) - FRAME_HEADER_SIZE) ||
+                (header[0] != FRAME_STREAM_ID && (!stream_started || header[0] > FRAME_UNCOMPRESSED ||
+                                                  data_len < FRAME_CRC_SIZE || data_len > frame_max))) {
+            puts("snappy decompression error: invalid chunk in archive file.");
+            return CODEC_FAILURE;
+        }
+        if (fread(data, 1, data_len, arch) != data_len) {
+            puts("snappy decompression error: problem with reading archive file.");
+            return CODEC_FAILURE;
         }
-        return SNAPPY_FAILURE;
-    }
 
-    snappy_uncompress(compressed, compressed_len, uncompressed, &uncompressed_len);
+        // Stream identifier may be repeated (streams can be concatenated).
+        if (header[0] == FRAME_STREAM_ID) {
+            if (memcmp(data, stream_id + FRAME_HEADER_SIZE, data_len)) {
+                puts("snappy decompression error: invalid stream identifier.");
+                return CODEC_FAILURE;
+            }
+            stream_started = 1;
+            continue;
+        }
 
-    if (fwrite(uncompressed, 1, uncompressed_len, output_file) != uncompressed_len || ferror(output_file)) {
-        puts("snappy decompression error: problem with writing to output file");
-        return SNAPPY_FAILURE;
-    }
+        if (header[0] == FRAME_COMPRESSED) {
+            size_t uncompressed_len;
+
+            if (snappy_uncompressed_length((const char*)data + FRAME_CRC_SIZE, data_len - FRAME_CRC_SIZE,
+                                           &uncompressed_len) != SNAPPY_OK || uncompressed_len > SNAPPY_FRAME_CHUNK ||
+                    snappy_uncompress((const char*)data + FRAME_CRC_SIZE, data_len - FRAME_CRC_SIZE,
+                                      (char*)context->in.data, &len) != SNAPPY_OK) {
+                puts("snappy decompression error.");
+                return CODEC_FAILURE;
+            }
+            chunk = context->in.data;
+        } else {
+            len = data_len - FRAME_CRC_SIZE;
+            if (len > SNAPPY_FRAME_CHUNK) {
+                puts("snappy decompression error: invalid chunk in archive file.");
+                return CODEC_FAILURE;
+            }
+            chunk = data + FRAME_CRC_SIZE;
+        }
+
+        if (masked_crc(context, chunk, len) != get_le32(data)) {
+            puts("snappy decompression error: CRC32C of chunk doesn't match.");
+            return CODEC_FAILURE;
+        }
 
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
+        if (fwrite(chunk, 1, len, output_file) != len || ferror(output_file)) {
+            puts("snappy decompression error: problem with writing to output file");
+            return CODEC_FAILURE;
+        }
+        total_len += len;
+    }
 
-    struct timespec result_ts = diff(start_ts, stop_ts);
-    mean_decompression_time += result_ts.tv_nsec / 1000000.0f;
+    if (ferror(arch) || total_len != source_len) {
+        puts("snappy decompression error: archive is truncated.");
+        return CODEC_FAILURE;
+    }
 
-    return SNAPPY_SUCCESS;
+    return CODEC_SUCCESS;
 }
 
-int run_snappy(FILE *source, FILE *arch, FILE *output, int iterations)
+static int snappy_reserve(void *ctx, arena *a, size_t source_len)
 {
-    int ret;
-    for (int i = 0; i < iterations; ++i) {
-        ret = compress(source, arch);
-        if (ret == SNAPPY_FAILURE) {
-            return ret;
-        }
+    snappy_context *context = (snappy_context*)ctx;
+    size_t frame_size = FRAME_HEADER_SIZE + FRAME_CRC_SIZE + snappy_max_compressed_length(SNAPPY_FRAME_CHUNK);
 
-        rewind(source);
-        rewind(arch);
+    // File functions stream through one chunk and one frame, whatever the file size.
+    if (work_buffer_reserve(&context->in, SNAPPY_FRAME_CHUNK, a) != 0 ||
+            work_buffer_reserve(&context->out, frame_size, a) != 0) {
+        return CODEC_FAILURE;
     }
 
-    printf("Mean compression ratio: %.2f%%\n", mean_compression_ratio / iterations);
-    printf("Mean compression time: %.3f ms\n", mean_compression_time / iterations);
+    return CODEC_SUCCESS;
+}
 
-    rewind(arch);
-    for (int i = 0; i < iterations; ++i) {
-        ret = decompress(arch, output);
-        if (ret == SNAPPY_FAILURE) {
-            return ret;
-        }
+static uint64_t snappy_checksum_time(void *ctx)
+{
+    snappy_context *context = (snappy_context*)ctx;
+    uint64_t checksum_ns = context->checksum_ns;
 
-        rewind(arch);
-    }
+    context->checksum_ns = 0;
+    return checksum_ns;
+}
 
-    printf("Mean decompression time: %.3f ms\n", mean_decompression_time / iterations);
-    return SNAPPY_SUCCESS;
+static void snappy_teardown(void *ctx)
+{
+    snappy_context *context = (snappy_context*)ctx;
+
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    free(context);
 }
+
+// Snappy ignores compression level. Archives are in framing format (.sz), buffers are compressed raw.
+const codec snappy_codec = {
+    .name = "snappy",
+    .extension = ".sz",
+    .min_level = 0,
+    .max_level = 0,
+    .low_level = 0,
+    .high_level = 0,
+    .init = snappy_init,
+    .compress_bound = snappy_compress_bound,
+    .compress = snappy_compress_buffer,
+    .decompress = snappy_decompress_buffer,
+    .compress_file = snappy_compress_file,
+    .decompress_file = snappy_decompress_file,
+    .reserve = snappy_reserve,
+    .checksum_time = snappy_checksum_time,
+    .teardown = snappy_teardown
+};
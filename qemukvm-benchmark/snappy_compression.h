@@ -1,21 +1,12 @@
 #ifndef SNAPPY_COMPRESSION_H
 #define SNAPPY_COMPRESSION_H
 
-#include <stdio.h>
+#include "codec.h"
 
-enum {
-    SNAPPY_SUCCESS,
-    SNAPPY_FAILURE
-};
+// Maximum uncompressed size of chunk of framing format, used by file functions.
+#define SNAPPY_FRAME_CHUNK 65536
 
-/**
- * @brief Start benchmark with snappy.
- * @param source input file
- * @param arch archive file after compression
- * @param output output file after decompression
- * @param iterations iterations count
- * @return Returns SNAPPY_SUCCESS on success or SNAPPY_FAILURE if something go wrong.
- */
-int run_snappy(FILE *source, FILE *arch, FILE *output, int iterations);
+// Snappy backend.
+extern const codec snappy_codec;
 
 #endif // SNAPPY_COMPRESSION_H
@@ -0,0 +1,151 @@
+#include "stats.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Two-sided 95% quantiles of Student's t-distribution for 1 to 30 degrees of freedom.
+static const double t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+double t_quantile95(int df)
+{
+    if (df < 1) {
+        return 0.0;
+    }
+
+    return df <= 30 ? t95[df - 1] : 1.96;
+}
+
+int samples_init(time_samples *s, int capacity)
+{
+    s->count = 0;
+    s->total = 0;
+    s->capacity = capacity > 0 ? capacity : 16;
+    s->samples = (uint64_t*)malloc(sizeof(uint64_t) * s->capacity);
+    if (!s->samples) {
+        s->capacity = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+int samples_add(time_samples *s, uint64_t ns)
+{
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 16;
+        uint64_t *samples = (uint64_t*)realloc(s->samples, sizeof(uint64_t) * capacity);
+        if (!samples) {
+            puts("Error: problem with allocating memory for time samples.");
+            return 1;
+        }
+        s->samples = samples;
+        s->capacity = capacity;
+    }
+
+    s->samples[s->count++] = ns;
+    s->total += ns;
+    return 0;
+}
+
+void samples_clear(time_samples *s)
+{
+    s->count = 0;
+    s->total = 0;
+}
+
+void samples_free(time_samples *s)
+{
+    free(s->samples);
+    s->samples = NULL;
+    s->count = 0;
+    s->capacity = 0;
+    s->total = 0;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Gets percentile of sorted samples (linear interpolation between closest ranks).
+ * @param sorted sorted samples
+ * @param count samples count
+ * @param p percentile (0 to 100)
+ * @return Returns percentile in nanoseconds.
+ */
+static double percentile(const uint64_t *sorted, int count, double p)
+{
+    double rank = p / 100.0 * (count - 1);
+    int lower = (int)rank;
+
+    if (lower + 1 >= count) {
+        return sorted[count - 1];
+    }
+
+    return sorted[lower] + (rank - lower) * (sorted[lower + 1] - (double)sorted[lower]);
+}
+
+void samples_summary(const time_samples *s, time_summary *summary)
+{
+    uint64_t *sorted;
+    double mean, variance = 0.0;
+
+    memset(summary, 0, sizeof(*summary));
+    summary->count = s->count;
+    if (s->count == 0) {
+        return;
+    }
+
+    mean = s->total / (double)s->count;
+    for (int i = 0; i < s->count; ++i) {
+        variance += (s->samples[i] - mean) * (s->samples[i] - mean);
+    }
+
+    summary->mean = mean / 1e6;
+    if (s->count > 1) {
+        summary->stddev = sqrt(variance / (s->count - 1)) / 1e6;
+        summary->ci95 = t_quantile95(s->count - 1) * summary->stddev / sqrt(s->count);
+    }
+
+    sorted = (uint64_t*)malloc(sizeof(uint64_t) * s->count);
+    if (!sorted) {
+        summary->min = summary->median = summary->p90 = summary->p99 = summary->max = summary->mean;
+        return;
+    }
+
+    memcpy(sorted, s->samples, sizeof(uint64_t) * s->count);
+    qsort(sorted, s->count, sizeof(uint64_t), compare_samples);
+    summary->min = sorted[0] / 1e6;
+    summary->median = percentile(sorted, s->count, 50.0) / 1e6;
+    summary->p90 = percentile(sorted, s->count, 90.0) / 1e6;
+    summary->p99 = percentile(sorted, s->count, 99.0) / 1e6;
+    summary->max = sorted[s->count - 1] / 1e6;
+    free(sorted);
+}
+
+void print_time_stats(const char *label, const time_samples *s, size_t bytes)
+{
+    time_summary summary;
+    char name[64];
+
+    samples_summary(s, &summary);
+    snprintf(name, sizeof(name), "%s", label);
+    name[0] = toupper((unsigned char)name[0]);
+
+    printf("Mean %s time: %.3f ms\n", label, summary.mean);
+    printf("%s time: min %.3f ms, median %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms, "
+           "stddev %.3f ms, 95%% CI +-%.3f ms (%d samples)\n",
+           name, summary.min, summary.median, summary.p90, summary.p99, summary.max,
+           summary.stddev, summary.ci95, summary.count);
+    printf("%s throughput: %.2f MB/s\n", name, summary.mean > 0.0 ? bytes / 1000.0 / summary.mean : 0.0);
+}
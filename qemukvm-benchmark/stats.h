@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Times of all iterations of one measurement, in nanoseconds.
+ */
+typedef struct {
+    uint64_t *samples;
+    int count;
+    int capacity;
+    uint64_t total;     // Sum of all samples.
+} time_samples;
+
+/**
+ * Summary of time samples, in milliseconds.
+ */
+typedef struct {
+    int count;
+    double mean;
+    double min;
+    double median;
+    double p90;
+    double p99;
+    double max;
+    double stddev;
+    double ci95;        // Half-width of 95% confidence interval of the mean.
+} time_summary;
+
+/**
+ * @brief Initializes samples.
+ * @param s samples
+ * @param capacity expected number of samples (array grows if needed)
+ * @return Returns 0 on success or 1 if memory could not be allocated (samples_add will try again).
+ */
+int samples_init(time_samples *s, int capacity);
+
+/**
+ * @brief Adds sample.
+ * @param s samples
+ * @param ns time in nanoseconds
+ * @return Returns 0 on success or 1 if memory could not be allocated.
+ */
+int samples_add(time_samples *s, uint64_t ns);
+
+/**
+ * @brief Removes all samples, keeps allocated memory.
+ * @param s samples
+ */
+void samples_clear(time_samples *s);
+
+/**
+ * @brief Releases samples.
+ * @param s samples
+ */
+void samples_free(time_samples *s);
+
+/**
+ * @brief Calculates summary of samples.
+ * @param s samples
+ * @param summary calculated summary
+ */
+void samples_summary(const time_samples *s, time_summary *summary);
+
+/**
+ * @brief Gets two-sided 95% quantile of Student's t-distribution.
+ * @param df degrees of freedom
+ * @return Returns quantile (normal distribution quantile for df > 30).
+ */
+double t_quantile95(int df);
+
+/**
+ * @brief Prints mean time, time distribution and throughput of measurement.
+ * @param label name of measurement, e.g. "compression"
+ * @param s samples
+ * @param bytes amount of data processed in one iteration
+ */
+void print_time_stats(const char *label, const time_samples *s, size_t bytes);
+
+#endif // STATS_H
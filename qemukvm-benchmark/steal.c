@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include "steal.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Size of buffer for CPU lines at the beginning of /proc/stat.
+#define STAT_BUFFER_SIZE 65536
+
+// Index of steal among times of CPU line (user nice system idle iowait irq softirq steal).
+#define STEAL_FIELD 7
+
+// /proc/stat is kept open and read from the beginning, it is only read by measuring thread.
+static int stat_fd = -1;
+static char stat_buffer[STAT_BUFFER_SIZE];
+
+/**
+ * @brief Parses steal time of CPU line.
+ * @param line times after CPU name
+ * @return Returns steal time in clock ticks, 0 if line has no steal field (kernels before 2.6.11).
+ */
+static uint64_t parse_steal(const char *line)
+{
+    char *end;
+    uint64_t value = 0;
+
+    for (int i = 0; i <= STEAL_FIELD; ++i) {
+        value = strtoull(line, &end, 10);
+        if (end == line) {
+            return 0;
+        }
+        line = end;
+    }
+
+    return value;
+}
+
+int steal_read(steal_sample *s)
+{
+    ssize_t len;
+    char *line;
+
+    memset(s, 0, sizeof(*s));
+    s->cpu = sched_getcpu();
+
+    if (stat_fd == -1) {
+        stat_fd = open("/proc/stat", O_RDONLY);
+        if (stat_fd == -1) {
+            return 1;
+        }
+    }
+
+    len = pread(stat_fd, stat_buffer, sizeof(stat_buffer) - 1, 0);
+    if (len <= 0) {
+        return 1;
+    }
+    stat_buffer[len] = '\0';
+
+    // CPU lines come first: "cpu" with times of all CPUs, then "cpuN" for every CPU.
+    for (line = stat_buffer; !strncmp(line, "cpu", 3); ) {
+        char *next = strchr(line, '\n');
+
+        if (line[3] == ' ') {
+            s->total = parse_steal(line + 3);
+        } else {
+            char *times;
+            long cpu = strtol(line + 3, &times, 10);
+
+            if (cpu == s->cpu) {
+                s->cpu_steal = parse_steal(times);
+            }
+        }
+
+        if (!next) {
+            break;
+        }
+        line = next + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Converts clock ticks to nanoseconds.
+ * @param ticks clock ticks
+ * @return Returns time in nanoseconds.
+ */
+static uint64_t ticks_ns(uint64_t ticks)
+{
+    static long ticks_per_second;
+
+    if (!ticks_per_second) {
+        ticks_per_second = sysconf(_SC_CLK_TCK);
+        if (ticks_per_second <= 0) {
+            ticks_per_second = 100;
+        }
+    }
+
+    return ticks * (1000000000ULL / ticks_per_second);
+}
+
+uint64_t steal_elapsed_ns(const steal_sample *start, const steal_sample *stop)
+{
+    static long cpus;
+
+    if (!cpus) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus <= 0) {
+            cpus = 1;
+        }
+    }
+
+    if (start->cpu >= 0 && start->cpu == stop->cpu) {
+        return ticks_ns(stop->cpu_steal > start->cpu_steal ? stop->cpu_steal - start->cpu_steal : 0);
+    }
+
+    // Sum over N vCPUs can be up to N times the wall time, mean per CPU is what one thread could lose.
+    return steal_total_ns(start, stop) / cpus;
+}
+
+uint64_t steal_total_ns(const steal_sample *start, const steal_sample *stop)
+{
+    return ticks_ns(stop->total > start->total ? stop->total - start->total : 0);
+}
@@ -0,0 +1,44 @@
+#ifndef STEAL_H
+#define STEAL_H
+
+#include <stdint.h>
+
+// Default threshold of steal time, in percent of iteration time, above which iteration is flagged.
+#define STEAL_THRESHOLD 5.0
+
+/**
+ * Steal time counters from /proc/stat: time when a runnable vCPU was not run by hypervisor.
+ */
+typedef struct {
+    int cpu;                // CPU of calling thread, -1 if unknown.
+    uint64_t total;         // Steal time of all CPUs, in clock ticks.
+    uint64_t cpu_steal;     // Steal time of cpu, in clock ticks.
+} steal_sample;
+
+/**
+ * @brief Reads steal time of all CPUs and of CPU the calling thread runs on.
+ * @param s read counters
+ * @return Returns 0 on success or 1 if steal time is not available (s is zeroed).
+ */
+int steal_read(steal_sample *s);
+
+/**
+ * @brief Gets steal time between two reads. Steal time of the CPU is used, unless the thread migrated
+ * to other CPU (measuring thread is not pinned), then steal time of all CPUs divided by number of online CPUs,
+ * so estimate stays comparable with wall time of one thread. Resolution is one clock tick (usually 10 ms).
+ * @param start counters read before region
+ * @param stop counters read after region
+ * @return Returns steal time in nanoseconds.
+ */
+uint64_t steal_elapsed_ns(const steal_sample *start, const steal_sample *stop);
+
+/**
+ * @brief Gets steal time of all CPUs between two reads, summed over CPUs (N vCPUs can lose up to N times
+ * the wall time). Used for work spread over many threads.
+ * @param start counters read before region
+ * @param stop counters read after region
+ * @return Returns steal time in nanoseconds.
+ */
+uint64_t steal_total_ns(const steal_sample *start, const steal_sample *stop);
+
+#endif // STEAL_H
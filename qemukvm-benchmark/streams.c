@@ -0,0 +1,689 @@
+#define _GNU_SOURCE
+#include "streams.h"
+#include "histogram.h"
+#include "timer.h"
+#include "report.h"
+#include "arena.h"
+#include "checksum.h"
+#include "steal.h"
+#include "sweep.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// File index of job which tells worker to exit.
+#define JOB_STOP -1
+
+typedef struct {
+    int file;           // Corpus file index, JOB_STOP - exit.
+    int slot;           // Codec and level.
+    int measured;       // Zero for jobs of cold and warm-up rounds.
+    uint64_t enqueued;  // timer_now() when job was pushed.
+} stream_job;
+
+typedef struct {
+    size_t sequence;
+    stream_job job;
+} queue_cell;
+
+/**
+ * Place where threads sleep after STREAMS_SPIN failed attempts, until other thread changes what they wait for.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int sleeping;       // Threads waiting on cond, so wake_up() takes lock only if there is somebody to wake.
+} parking;
+
+/**
+ * Bounded lock-free MPMC queue (Dmitry Vyukov's algorithm). Sequence number of every cell tells
+ * producers and consumers whose turn it is, so they contend only on their own position counter
+ * (kept on separate cache lines).
+ */
+typedef struct {
+    queue_cell *cells;
+    size_t mask;
+    size_t enqueue_pos __attribute__((aligned(64)));
+    size_t dequeue_pos __attribute__((aligned(64)));
+    parking not_empty;  // Idle workers.
+    parking not_full;   // Producer.
+} job_queue;
+
+// Codec and level of jobs.
+typedef struct {
+    const codec *c;
+    int level;          // Codec's own level.
+} stream_slot;
+
+// Measured jobs of one codec and level done by one worker.
+typedef struct {
+    uint64_t jobs;
+    uint64_t bytes;             // Uncompressed size of files.
+    uint64_t arch_bytes;        // Compressed size of files.
+    uint64_t compression_ns;
+    uint64_t decompression_ns;
+} slot_stats;
+
+typedef struct {
+    const corpus *corp;
+    const stream_slot *slots;
+    int slots_count;
+    const codec_params *params;
+    size_t max_len;             // Size of the largest file.
+    size_t arch_size;           // Maximum compressed size of the largest file of all codecs.
+    const uint32_t *crcs;       // CRC32C of files, NULL - no verification.
+    job_queue *queue;
+    size_t *completed;          // Jobs done by all workers.
+    parking *drained;           // Producer waiting for jobs of cold and warm-up rounds.
+    slot_stats *stats;          // Per slot.
+    histogram *wait;            // Queue wait of measured jobs, ns.
+    uint64_t jobs;              // Measured jobs.
+    uint64_t busy_ns;           // Time of measured jobs.
+    uint64_t cpu_ns;            // CPU time of measured jobs, less than busy_ns if worker was preempted.
+    uint64_t last_stop;         // timer_now() at the end of the last measured job.
+    int failed;
+} stream_worker;
+
+/**
+ * @brief Initializes parking.
+ * @param p parking
+ */
+static void parking_init(parking *p)
+{
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    p->sleeping = 0;
+}
+
+/**
+ * @brief Releases parking.
+ * @param p parking
+ */
+static void parking_destroy(parking *p)
+{
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+}
+
+/**
+ * @brief Repeats attempt until it succeeds: STREAMS_SPIN times yielding CPU between attempts, then sleeping
+ * until wake_up(), so waiting threads don't take vCPU time from workers (and don't add to steal time).
+ * @param p parking
+ * @param attempt operation to repeat, returns non-zero on success
+ * @param arg argument of attempt
+ */
+static void wait_for(parking *p, int (*attempt)(void *arg), void *arg)
+{
+    for (int i = 0; i < STREAMS_SPIN; ++i) {
+        if (attempt(arg)) {
+            return;
+        }
+        sched_yield();
+    }
+
+    // Attempt under lock after announcing sleep: wake_up() either sees sleeping thread or happens before attempt.
+    pthread_mutex_lock(&p->lock);
+    __atomic_add_fetch(&p->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (!attempt(arg)) {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    __atomic_sub_fetch(&p->sleeping, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * @brief Wakes thread sleeping in wait_for() after change of what it waits for. One push, pop or completed
+ * job is enough for one thread, the others sleep on.
+ * @param p parking
+ */
+static void wake_up(parking *p)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p->sleeping, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+/**
+ * @brief Initializes empty queue.
+ * @param q queue
+ * @param cells array of STREAMS_QUEUE_SIZE cells
+ */
+static void queue_init(job_queue *q, queue_cell *cells)
+{
+    for (size_t i = 0; i < STREAMS_QUEUE_SIZE; ++i) {
+        cells[i].sequence = i;
+    }
+    q->cells = cells;
+    q->mask = STREAMS_QUEUE_SIZE - 1;
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+}
+
+/**
+ * @brief Pushes job into queue.
+ * @param q queue
+ * @param job job
+ * @return Returns 1 on success or 0 if queue is full.
+ */
+static int queue_push(job_queue *q, const stream_job *job)
+{
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        queue_cell *cell = &q->cells[pos & q->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)sequence - (intptr_t)pos;
+
+        if (dif == 0) {
+            // On failure pos is updated to the current position.
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->job = *job;
+                __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * @brief Pops job from queue.
+ * @param q queue
+ * @param job popped job
+ * @return Returns 1 on success or 0 if queue is empty.
+ */
+static int queue_pop(job_queue *q, stream_job *job)
+{
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+
+    for (;;) {
+        queue_cell *cell = &q->cells[pos & q->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *job = cell->job;
+                __atomic_store_n(&cell->sequence, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Arguments of attempts of wait_for().
+typedef struct {
+    job_queue *q;
+    stream_job *job;
+} queue_attempt;
+
+static int attempt_push(void *arg)
+{
+    queue_attempt *a = (queue_attempt*)arg;
+    return queue_push(a->q, a->job);
+}
+
+static int attempt_pop(void *arg)
+{
+    queue_attempt *a = (queue_attempt*)arg;
+    return queue_pop(a->q, a->job);
+}
+
+/**
+ * @brief Pushes job, waits while queue is full.
+ * @param q queue
+ * @param job job
+ */
+static void queue_push_wait(job_queue *q, stream_job *job)
+{
+    queue_attempt a = { q, job };
+
+    wait_for(&q->not_full, attempt_push, &a);
+    wake_up(&q->not_empty);
+}
+
+/**
+ * @brief Pops job, waits while queue is empty.
+ * @param q queue
+ * @param job popped job
+ */
+static void queue_pop_wait(job_queue *q, stream_job *job)
+{
+    queue_attempt a = { q, job };
+
+    wait_for(&q->not_empty, attempt_pop, &a);
+    wake_up(&q->not_full);
+}
+
+// Arguments of wait for completion of all pushed jobs.
+typedef struct {
+    const size_t *completed;
+    size_t pushed;
+} drain_attempt;
+
+static int attempt_drain(void *arg)
+{
+    drain_attempt *a = (drain_attempt*)arg;
+    return __atomic_load_n(a->completed, __ATOMIC_ACQUIRE) >= a->pushed;
+}
+
+/**
+ * @brief Compresses and decompresses file of job.
+ * @param w worker
+ * @param ctx codec context of job's codec and level
+ * @param job job
+ * @param arch buffer for compressed file
+ * @param output buffer for decompressed file
+ * @param start timer_now() when job was popped
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_job(stream_worker *w, void *ctx, const stream_job *job, unsigned char *arch, unsigned char *output,
+                   uint64_t start)
+{
+    const corpus_file *f = &w->corp->files[job->file];
+    const codec *c = w->slots[job->slot].c;
+    size_t arch_len = w->arch_size;
+    size_t output_len = f->len;
+    struct timespec cpu_start, cpu_stop;
+    uint64_t compressed, stop;
+    int ret;
+
+    get_cpu_time(&cpu_start);
+    ret = c->compress(ctx, f->data, f->len, arch, &arch_len);
+    compressed = timer_now();
+    if (ret == CODEC_SUCCESS) {
+        ret = c->decompress(ctx, arch, arch_len, output, &output_len);
+    }
+    stop = timer_now();
+    get_cpu_time(&cpu_stop);
+
+    if (ret != CODEC_SUCCESS) {
+        printf("%s error: job of file %s failed.\n", c->name, f->name);
+        return CODEC_FAILURE;
+    }
+    if (w->crcs && verify_checksum(c->name, f->len, w->crcs[job->file], output_len,
+                                   crc32c(0, output, output_len)) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    if (job->measured) {
+        slot_stats *s = &w->stats[job->slot];
+
+        s->jobs++;
+        s->bytes += f->len;
+        s->arch_bytes += arch_len;
+        s->compression_ns += timer_ns(compressed - start);
+        s->decompression_ns += timer_ns(stop - compressed);
+        histogram_add(w->wait, timer_ns(start - job->enqueued));
+        w->jobs++;
+        w->busy_ns += timer_ns(stop - start);
+        w->cpu_ns += elapsed_ns(cpu_start, cpu_stop);
+        w->last_stop = stop;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Worker thread. Pulls jobs until stop job, also after a failure, so producer is never blocked.
+ * @param arg stream_worker structure
+ * @return Returns NULL.
+ */
+static void *stream_worker_thread(void *arg)
+{
+    stream_worker *w = (stream_worker*)arg;
+    arena mem;
+    void **ctx;
+    unsigned char *arch, *output;
+    stream_job job;
+
+    // Contexts and buffers are created once and reused by all jobs, as a server would do. Library state
+    // (z_stream, bzip2 blocks, LZO work memory, snappy buffers) is reserved from worker arena, jobs don't allocate.
+    arena_init(&mem);
+    ctx = (void**)arena_alloc(&mem, sizeof(void*) * w->slots_count);
+    arch = (unsigned char*)arena_alloc(&mem, w->arch_size);
+    output = (unsigned char*)arena_alloc(&mem, w->max_len);
+    if (!ctx || !arch || !output) {
+        puts("Error: problem with allocating memory for buffers.");
+        w->failed = 1;
+    } else {
+        memset(ctx, 0, sizeof(void*) * w->slots_count);
+        for (int i = 0; i < w->slots_count && !w->failed; ++i) {
+            const codec *c = w->slots[i].c;
+
+            if (c->init(&ctx[i], w->slots[i].level, w->params) != CODEC_SUCCESS) {
+                printf("%s error: problem with codec initialization.\n", c->name);
+                ctx[i] = NULL;
+                w->failed = 1;
+            } else if (c->reserve && c->reserve(ctx[i], &mem, w->max_len) != CODEC_SUCCESS) {
+                printf("%s error: problem with allocating work memory.\n", c->name);
+                w->failed = 1;
+            }
+        }
+    }
+
+    for (;;) {
+        uint64_t start;
+
+        queue_pop_wait(w->queue, &job);
+        start = timer_now();
+        if (job.file == JOB_STOP) {
+            break;
+        }
+
+        if (!w->failed && run_job(w, ctx[job.slot], &job, arch, output, start) != CODEC_SUCCESS) {
+            w->failed = 1;
+        }
+        __atomic_add_fetch(w->completed, 1, __ATOMIC_RELEASE);
+        wake_up(w->drained);
+    }
+
+    for (int i = 0; ctx && i < w->slots_count; ++i) {
+        if (ctx[i]) {
+            w->slots[i].c->teardown(ctx[i]);
+        }
+    }
+    arena_destroy(&mem);
+    return NULL;
+}
+
+/**
+ * @brief Gets codecs and levels of jobs.
+ * @param options benchmark options
+ * @param all_levels run both low and high compression level instead of options.level
+ * @param slots array of at least CODECS_MAX * LEVELS_MAX slots
+ * @return Returns number of slots.
+ */
+static int plan_slots(bench_options options, int all_levels, stream_slot *slots)
+{
+    int count = 0;
+
+    for (int i = 0; codecs[i]; ++i) {
+        int levels[LEVELS_MAX];
+        int levels_count;
+
+        if (options.library && options.library != codecs[i]) {
+            continue;
+        }
+
+        levels_count = plan_levels(codecs[i], options, all_levels, levels);
+        for (int l = 0; l < levels_count; ++l) {
+            slots[count].c = codecs[i];
+            slots[count].level = codec_level(codecs[i], levels[l]);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Prints and reports results of multi-stream run.
+ * @param corp corpus
+ * @param options benchmark options
+ * @param slots codecs and levels
+ * @param slots_count number of slots
+ * @param workers workers
+ * @param wall_ns time from the start of measured rounds to the end of the last job
+ * @param steal_ns steal time summed over all CPUs during measured rounds, 0 if not available
+ * @param producer_ns CPU time of producer during measured rounds
+ * @param wait queue wait of all measured jobs
+ */
+static void print_streams(const corpus *corp, bench_options options, const stream_slot *slots, int slots_count,
+                          const stream_worker *workers, uint64_t wall_ns, uint64_t steal_ns, uint64_t producer_ns,
+                          const histogram *wait)
+{
+    uint64_t jobs = 0, bytes = 0;
+    double utilization = 0.0;
+
+    for (int i = 0; i < options.streams; ++i) {
+        jobs += workers[i].jobs;
+        utilization += wall_ns ? workers[i].busy_ns * 100.0 / wall_ns : 0.0;
+        for (int s = 0; s < slots_count; ++s) {
+            bytes += workers[i].stats[s].bytes;
+        }
+    }
+    utilization /= options.streams;
+
+    printf("Jobs: %llu in %.3f ms, %.1f jobs/s\n", (unsigned long long)jobs, wall_ns / 1e6,
+           wall_ns ? jobs * 1e9 / wall_ns : 0.0);
+    // Bytes per nanosecond to MB/s.
+    printf("Aggregate throughput: %.2f MB/s (every job compresses and decompresses one file)\n",
+           wall_ns ? bytes * 1000.0 / wall_ns : 0.0);
+    printf("Queue wait in us: mean %.3f, p50 %.3f, p99 %.3f, max %.3f\n", histogram_mean(wait) / 1e3,
+           histogram_percentile(wait, 50.0) / 1e3, histogram_percentile(wait, 99.0) / 1e3, wait->max / 1e3);
+    // Producer shares vCPUs with workers, its time is taken from them.
+    printf("Producer CPU time: %.3f ms (%.1f%% of wall time)\n", producer_ns / 1e6,
+           wall_ns ? producer_ns * 100.0 / wall_ns : 0.0);
+    if (steal_ns) {
+        printf("Steal time: %.3f ms summed over all CPUs\n", steal_ns / 1e6);
+    }
+
+    printf("%6s %8s %12s %12s %12s %14s\n", "worker", "jobs", "busy ms", "cpu ms", "utilization", "mean wait us");
+    for (int i = 0; i < options.streams; ++i) {
+        const stream_worker *w = &workers[i];
+
+        printf("%6d %8llu %12.3f %12.3f %11.2f%% %14.3f\n", i, (unsigned long long)w->jobs, w->busy_ns / 1e6,
+               w->cpu_ns / 1e6, wall_ns ? w->busy_ns * 100.0 / wall_ns : 0.0, histogram_mean(w->wait) / 1e3);
+    }
+
+    printf("%-8s %5s %8s %9s %18s %20s\n", "library", "level", "jobs", "ratio", "compression MB/s",
+           "decompression MB/s");
+    for (int s = 0; s < slots_count; ++s) {
+        slot_stats total;
+        double compression, decompression;
+
+        memset(&total, 0, sizeof(total));
+        for (int i = 0; i < options.streams; ++i) {
+            const slot_stats *ws = &workers[i].stats[s];
+
+            total.jobs += ws->jobs;
+            total.bytes += ws->bytes;
+            total.arch_bytes += ws->arch_bytes;
+            total.compression_ns += ws->compression_ns;
+            total.decompression_ns += ws->decompression_ns;
+        }
+
+        // Speed of a single stream: bytes divided by time of jobs.
+        compression = total.compression_ns ? total.bytes * 1000.0 / total.compression_ns : 0.0;
+        decompression = total.decompression_ns ? total.bytes * 1000.0 / total.decompression_ns : 0.0;
+        printf("%-8s %5d %8llu %8.2f%% %18.2f %20.2f\n", slots[s].c->name, slots[s].level,
+               (unsigned long long)total.jobs, total.bytes ? total.arch_bytes * 100.0 / total.bytes : 0.0,
+               compression, decompression);
+
+        options.level = slots[s].level;
+        options.input_name = corp->name;
+        report_streams(slots[s].c, options, total.bytes, total.arch_bytes, compression, decompression, wait,
+                       utilization);
+    }
+}
+
+int run_streams_benchmark(const corpus *corp, bench_options options, int all_levels)
+{
+    static stream_slot slots[CODECS_MAX * LEVELS_MAX];
+    int slots_count = plan_slots(options, all_levels, slots);
+    int rounds = 1 + options.warmup + options.iterations;
+    job_queue queue;
+    queue_cell *cells;
+    pthread_t *ids;
+    stream_worker *workers;
+    slot_stats *stats;
+    histogram *waits, *wait;
+    uint32_t *crcs = NULL;
+    size_t max_len = 0, arch_size = 0;
+    size_t completed = 0, pushed = 0;
+    steal_sample steal_start, steal_stop;
+    int steal_available = 0;
+    parking drained;
+    struct timespec producer_start, producer_stop;
+    uint64_t start = 0, stop = 0;
+    int started = 0;
+    int ret = 0;
+
+    parking_init(&queue.not_empty);
+    parking_init(&queue.not_full);
+    parking_init(&drained);
+
+    for (int j = 0; j < corp->count; ++j) {
+        max_len = corp->files[j].len > max_len ? corp->files[j].len : max_len;
+    }
+    // Files above the limit of codec are skipped, so they don't size its archive buffer.
+    for (int s = 0; s < slots_count; ++s) {
+        for (int j = 0; j < corp->count; ++j) {
+            size_t bound;
+
+            if (!codec_accepts(slots[s].c, corp->files[j].len)) {
+                if (s == 0 || slots[s - 1].c != slots[s].c) {
+                    print_skipped(slots[s].c, corp->files[j].name);
+                }
+                continue;
+            }
+            bound = slots[s].c->compress_bound(corp->files[j].len);
+            arch_size = bound > arch_size ? bound : arch_size;
+        }
+    }
+
+    cells = (queue_cell*)malloc(sizeof(queue_cell) * STREAMS_QUEUE_SIZE);
+    ids = (pthread_t*)malloc(sizeof(pthread_t) * options.streams);
+    workers = (stream_worker*)calloc(options.streams, sizeof(stream_worker));
+    stats = (slot_stats*)calloc((size_t)options.streams * slots_count, sizeof(slot_stats));
+    waits = (histogram*)malloc(sizeof(histogram) * (options.streams + 1));
+    if (options.verify) {
+        crcs = (uint32_t*)malloc(sizeof(uint32_t) * corp->count);
+    }
+    if (!cells || !ids || !workers || !stats || !waits || (options.verify && !crcs)) {
+        puts("Error: problem with allocating memory for streams.");
+        ret = 1;
+        goto cleanup;
+    }
+
+    for (int j = 0; crcs && j < corp->count; ++j) {
+        crcs[j] = crc32c(0, corp->files[j].data, corp->files[j].len);
+    }
+
+    printf("Streams: %d workers, %d files, %d codecs and levels, %d measured rounds, timer %s\n", options.streams,
+           corp->count, slots_count, options.iterations, timer_source());
+
+    queue_init(&queue, cells);
+    wait = &waits[options.streams];
+    histogram_reset(wait);
+    for (int i = 0; i < options.streams; ++i) {
+        workers[i].corp = corp;
+        workers[i].slots = slots;
+        workers[i].slots_count = slots_count;
+        workers[i].params = &options.params;
+        workers[i].max_len = max_len;
+        workers[i].arch_size = arch_size;
+        workers[i].crcs = crcs;
+        workers[i].queue = &queue;
+        workers[i].completed = &completed;
+        workers[i].drained = &drained;
+        workers[i].stats = &stats[(size_t)i * slots_count];
+        workers[i].wait = &waits[i];
+        histogram_reset(workers[i].wait);
+
+        // Workers are not pinned: placement of many short jobs is left to the guest scheduler.
+        if (pthread_create(&ids[i], NULL, stream_worker_thread, &workers[i]) != 0) {
+            puts("Error: problem with creating thread.");
+            ret = 1;
+            break;
+        }
+        started++;
+    }
+
+    // Jobs are pushed only if all workers were created, the others get just stop jobs.
+    for (int r = 0; r < rounds && !ret; ++r) {
+        int measured = r > options.warmup;
+
+        // Measured rounds start when all jobs of cold and warm-up rounds are done.
+        if (r == 1 + options.warmup) {
+            drain_attempt drain = { &completed, pushed };
+
+            wait_for(&drained, attempt_drain, &drain);
+            steal_available = !steal_read(&steal_start);
+            get_cpu_time(&producer_start);
+            start = timer_now();
+        }
+
+        for (int j = 0; j < corp->count; ++j) {
+            for (int s = 0; s < slots_count; ++s) {
+                stream_job job;
+
+                if (!codec_accepts(slots[s].c, corp->files[j].len)) {
+                    continue;
+                }
+
+                job.file = j;
+                job.slot = s;
+                job.measured = measured;
+                job.enqueued = timer_now();
+                queue_push_wait(&queue, &job);
+                pushed++;
+            }
+        }
+    }
+
+    for (int i = 0; i < started; ++i) {
+        stream_job job;
+
+        memset(&job, 0, sizeof(job));
+        job.file = JOB_STOP;
+        queue_push_wait(&queue, &job);
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+    get_cpu_time(&producer_stop);
+    // Steal time of all CPUs is summed, workers run on any of them.
+    if (steal_available && steal_read(&steal_stop)) {
+        steal_available = 0;
+    }
+
+    if (ret) {
+        goto cleanup;
+    }
+
+    for (int i = 0; i < options.streams; ++i) {
+        if (workers[i].failed) {
+            ret = 1;
+        }
+        if (workers[i].last_stop > stop) {
+            stop = workers[i].last_stop;
+        }
+        histogram_merge(wait, workers[i].wait);
+    }
+
+    if (ret) {
+        puts("Error: multi-stream benchmark failed.");
+    } else {
+        print_streams(corp, options, slots, slots_count, workers, stop > start ? timer_ns(stop - start) : 0,
+                      steal_available ? steal_total_ns(&steal_start, &steal_stop) : 0,
+                      elapsed_ns(producer_start, producer_stop), wait);
+        if (options.verify) {
+            printf("Verification: every decompressed file matches source (CRC32C, %s)\n", crc32c_implementation());
+        }
+    }
+
+cleanup:
+    parking_destroy(&queue.not_empty);
+    parking_destroy(&queue.not_full);
+    parking_destroy(&drained);
+    free(cells);
+    free(ids);
+    free(workers);
+    free(stats);
+    free(waits);
+    free(crcs);
+    return ret;
+}
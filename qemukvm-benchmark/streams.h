@@ -0,0 +1,31 @@
+#ifndef STREAMS_H
+#define STREAMS_H
+
+#include <stddef.h>
+#include "corpus.h"
+#include "util.h"
+
+// Capacity of job queue of multi-stream mode (power of two).
+#define STREAMS_QUEUE_SIZE 1024
+
+// Attempts of producer and idle workers, yielding CPU between them, before they sleep until queue changes.
+#define STREAMS_SPIN 64
+
+/**
+ * @brief Runs multi-stream benchmark, a model of server doing many independent requests at once.
+ * Calling thread is the producer: it walks the corpus and pushes a (file, codec, level) job for every file
+ * and every selected codec and level into a lock-free MPMC queue, once per round (cold round, options.warmup
+ * rounds, then options.iterations measured rounds). options.streams workers, not pinned to CPUs, pull jobs;
+ * every worker keeps its own codec context of every codec and level (e.g. z_stream, bz_stream, LZO work memory)
+ * for the whole run and compresses and decompresses file of job with it.
+ * Producer waiting for free cell and idle workers sleep after STREAMS_SPIN attempts, so they don't compete
+ * with busy workers for vCPUs. Aggregate throughput, queue wait time of jobs, utilization of every worker
+ * and CPU time of producer are reported.
+ * @param corp corpus (a single file is a corpus of one file)
+ * @param options benchmark options
+ * @param all_levels run both low and high compression level instead of options.level
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int run_streams_benchmark(const corpus *corp, bench_options options, int all_levels);
+
+#endif // STREAMS_H
@@ -0,0 +1,189 @@
+#include "sweep.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_levels(const void *a, const void *b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+int parse_levels(const char *spec, int *levels)
+{
+    int count = 0;
+    const char *p = spec;
+
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+
+        if (end == p || first < 0) {
+            return -1;
+        }
+        p = end;
+
+        if (*p == '-') {
+            const char *start = ++p;
+            last = strtol(start, &end, 10);
+            if (end == start || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+
+        for (long level = first; level <= last; ++level) {
+            if (count == LEVELS_MAX) {
+                return -1;
+            }
+            levels[count++] = (int)level;
+        }
+
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+
+    qsort(levels, count, sizeof(int), compare_levels);
+
+    // Remove duplicates.
+    if (count > 1) {
+        int unique = 1;
+        for (int i = 1; i < count; ++i) {
+            if (levels[i] != levels[unique - 1]) {
+                levels[unique++] = levels[i];
+            }
+        }
+        count = unique;
+    }
+
+    return count;
+}
+
+int plan_levels(const codec *c, bench_options options, int both_levels, int *levels)
+{
+    int count = 0;
+
+    // Method replaces level of codec, so every level would run the same algorithm.
+    if (options.params.method && codec_has_method(c, options.params.method)) {
+        levels[0] = options.levels_count || both_levels ? LOW_COMPRESSION : options.level;
+        return 1;
+    }
+
+    if (options.levels_count) {
+        // Codec without levels is a reference point of every sweep.
+        if (c->min_level == c->max_level) {
+            levels[0] = c->min_level;
+            return 1;
+        }
+
+        for (int i = 0; i < options.levels_count; ++i) {
+            if (codec_has_level(c, options.levels[i])) {
+                levels[count++] = options.levels[i];
+            }
+        }
+        return count;
+    }
+
+    if (both_levels) {
+        levels[count++] = LOW_COMPRESSION;
+        // Both levels can be the same for codecs without levels.
+        if (codec_level(c, LOW_COMPRESSION) != codec_level(c, HIGH_COMPRESSION)) {
+            levels[count++] = HIGH_COMPRESSION;
+        }
+        return count;
+    }
+
+    levels[0] = options.level;
+    return 1;
+}
+
+void sweep_init(level_sweep *s, const char *name)
+{
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+}
+
+int sweep_add(level_sweep *s, const codec *c, int level, const bench_result *result)
+{
+    if (s->count == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : 16;
+        sweep_point *points = (sweep_point*)realloc(s->points, capacity * sizeof(sweep_point));
+        if (!points) {
+            puts("Error: problem with allocating memory for level sweep.");
+            return 1;
+        }
+        s->points = points;
+        s->capacity = capacity;
+    }
+
+    s->points[s->count].c = c;
+    s->points[s->count].level = level;
+    s->points[s->count].result = *result;
+    s->points[s->count].pareto = 0;
+    s->count++;
+    return 0;
+}
+
+static double point_ratio(const sweep_point *p)
+{
+    return p->result.source_len ? p->result.arch_len / (double)p->result.source_len : 0.0;
+}
+
+static double point_speed(const sweep_point *p, double time)
+{
+    // Mean time in ms to MB/s.
+    return time > 0.0 ? p->result.source_len / 1000.0 / time : 0.0;
+}
+
+/**
+ * @brief Marks points which are not dominated: no other point has both better (or equal) ratio and
+ * compression speed, and is strictly better in one of them.
+ * @param s sweep
+ */
+static void mark_pareto(level_sweep *s)
+{
+    for (int i = 0; i < s->count; ++i) {
+        double ratio = point_ratio(&s->points[i]);
+        double speed = point_speed(&s->points[i], s->points[i].result.compression_time);
+
+        s->points[i].pareto = 1;
+        for (int j = 0; j < s->count; ++j) {
+            double other_ratio = point_ratio(&s->points[j]);
+            double other_speed = point_speed(&s->points[j], s->points[j].result.compression_time);
+
+            if (j != i && other_ratio <= ratio && other_speed >= speed && (other_ratio < ratio || other_speed > speed)) {
+                s->points[i].pareto = 0;
+                break;
+            }
+        }
+    }
+}
+
+void print_sweep(level_sweep *s)
+{
+    if (!s->count) {
+        return;
+    }
+
+    mark_pareto(s);
+
+    printf("Level sweep: %s (* - Pareto frontier of compression speed against ratio)\n", s->name);
+    printf("%-8s %5s %9s %18s %20s\n", "library", "level", "ratio", "compression MB/s", "decompression MB/s");
+    for (int i = 0; i < s->count; ++i) {
+        const sweep_point *p = &s->points[i];
+        printf("%-8s %5d %8.2f%% %18.2f %20.2f%s\n", p->c->name, p->level, point_ratio(p) * 100.0,
+               point_speed(p, p->result.compression_time), point_speed(p, p->result.decompression_time),
+               p->pareto ? " *" : "");
+    }
+    printf("\n");
+}
+
+void sweep_free(level_sweep *s)
+{
+    free(s->points);
+    s->points = NULL;
+    s->count = 0;
+    s->capacity = 0;
+}
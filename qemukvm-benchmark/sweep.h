@@ -0,0 +1,79 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "codec.h"
+#include "benchmark.h"
+
+// Maximum number of levels of sweep.
+#define LEVELS_MAX 64
+
+/**
+ * Result of one codec and level.
+ */
+typedef struct {
+    const codec *c;
+    int level;
+    bench_result result;
+    int pareto;             // On Pareto frontier of compression speed against ratio.
+} sweep_point;
+
+/**
+ * Results of level sweep on one input (file or whole corpus).
+ */
+typedef struct {
+    const char *name;
+    sweep_point *points;
+    int count;
+    int capacity;
+} level_sweep;
+
+/**
+ * @brief Parses list of levels, e.g. "1-9" or "1,3,6-9". Levels are sorted and duplicates are removed.
+ * @param spec levels specification
+ * @param levels array of at least LEVELS_MAX levels
+ * @return Returns number of levels or -1 if specification is invalid.
+ */
+int parse_levels(const char *spec, int *levels);
+
+/**
+ * @brief Gets levels to run for codec: levels of sweep supported by codec (codecs without levels always run
+ * their only one), both low and high level or options.level. Codec with method (--method) runs once.
+ * @param c codec
+ * @param options benchmark options
+ * @param both_levels run LOW_COMPRESSION and HIGH_COMPRESSION if there is no sweep
+ * @param levels array of at least LEVELS_MAX levels
+ * @return Returns number of levels.
+ */
+int plan_levels(const codec *c, bench_options options, int both_levels, int *levels);
+
+/**
+ * @brief Initializes empty sweep.
+ * @param s sweep
+ * @param name input name
+ */
+void sweep_init(level_sweep *s, const char *name);
+
+/**
+ * @brief Adds result of codec and level to sweep.
+ * @param s sweep
+ * @param c codec
+ * @param level codec's compression level
+ * @param result benchmark result
+ * @return Returns 0 on success or 1 if something go wrong.
+ */
+int sweep_add(level_sweep *s, const codec *c, int level, const bench_result *result);
+
+/**
+ * @brief Prints ratio and throughput of every codec and level, with Pareto frontier marked:
+ * points which no other point beats both in compression speed and ratio.
+ * @param s sweep
+ */
+void print_sweep(level_sweep *s);
+
+/**
+ * @brief Releases sweep.
+ * @param s sweep
+ */
+void sweep_free(level_sweep *s);
+
+#endif // SWEEP_H
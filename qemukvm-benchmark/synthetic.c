@@ -0,0 +1,204 @@
+#include "synthetic.h"
+#include "util.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lengths of runs of fresh pages (literal or repeated).
+#define RUN_MIN 4
+#define RUN_MAX 64
+
+// First byte value of random symbols, so low entropy data isn't made of zeros.
+#define SYMBOL_BASE 'a'
+
+/**
+ * @brief Gets next random number (splitmix64).
+ * @param state generator state
+ * @return Returns random number.
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Gets random number in the range of 0 to 1 (excluded).
+ */
+static double random_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Fills buffer with random symbols, 8 symbols from one random number.
+ * @param p buffer
+ * @param len buffer size
+ * @param symbols number of distinct symbols, 1 to 256
+ * @param state generator state
+ */
+static void fill_symbols(unsigned char *p, size_t len, unsigned symbols, uint64_t *state)
+{
+    while (len) {
+        uint64_t r = next_random(state);
+
+        for (int i = 0; i < 8 && len; ++i, --len) {
+            *p++ = (unsigned char)((((r & 0xff) * symbols) >> 8) + SYMBOL_BASE);
+            r >>= 8;
+        }
+    }
+}
+
+/**
+ * @brief Generates fresh page: runs of random symbols and runs repeated from spec->repeat_distance bytes back.
+ * @param buf whole data buffer
+ * @param offset page offset
+ * @param len page size
+ * @param spec specification
+ * @param symbols number of distinct symbols
+ * @param state generator state
+ */
+static void fill_fresh(unsigned char *buf, size_t offset, size_t len, const synthetic_spec *spec, unsigned symbols,
+                       uint64_t *state)
+{
+    size_t pos = offset, end = offset + len;
+
+    while (pos < end) {
+        size_t run = RUN_MIN + next_random(state) % (RUN_MAX - RUN_MIN + 1);
+
+        if (run > end - pos) {
+            run = end - pos;
+        }
+
+        if (spec->repeat_distance && pos >= spec->repeat_distance && random_unit(state) < spec->repeat_fraction) {
+            // Byte by byte, run may overlap its source like LZ77 match.
+            for (size_t i = pos; i < pos + run; ++i) {
+                buf[i] = buf[i - spec->repeat_distance];
+            }
+        } else {
+            fill_symbols(buf + pos, run, symbols, state);
+        }
+        pos += run;
+    }
+}
+
+/**
+ * @brief Parses number which must fill the whole string.
+ * @param str string
+ * @param min minimum value
+ * @param max maximum value
+ * @param value parsed number
+ * @return Returns 0 on success or 1 if string is not a number in the range.
+ */
+static int parse_number(const char *str, double min, double max, double *value)
+{
+    char *end;
+
+    *value = strtod(str, &end);
+    return end == str || *end != '\0' || *value < min || *value > max;
+}
+
+int parse_synthetic(const char *str, synthetic_spec *spec)
+{
+    char *copy, *token, *save = NULL;
+    int ret = 0;
+
+    spec->size = SYNTHETIC_SIZE;
+    spec->entropy = 8.0;
+    spec->repeat_distance = 0;
+    spec->repeat_fraction = 0.5;
+    spec->zero_fraction = 0.0;
+    spec->duplicate_fraction = 0.0;
+    spec->seed = 1;
+    snprintf(spec->name, sizeof(spec->name), "synthetic:%s", str);
+
+    copy = strdup(str);
+    if (!copy) {
+        puts("Error: problem with allocating memory.");
+        return 1;
+    }
+
+    for (token = strtok_r(copy, ",", &save); token && !ret; token = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(token, '=');
+
+        if (!value) {
+            ret = 1;
+            break;
+        }
+        *value++ = '\0';
+
+        if (!strcmp(token, "size")) {
+            spec->size = parse_size(value);
+            ret = spec->size == 0;
+        } else if (!strcmp(token, "entropy")) {
+            ret = parse_number(value, 0.0, 8.0, &spec->entropy);
+        } else if (!strcmp(token, "repeat-distance")) {
+            spec->repeat_distance = parse_size(value);
+            ret = spec->repeat_distance == 0 && strcmp(value, "0");
+        } else if (!strcmp(token, "repeat-fraction")) {
+            ret = parse_number(value, 0.0, 1.0, &spec->repeat_fraction);
+        } else if (!strcmp(token, "zero-fraction")) {
+            ret = parse_number(value, 0.0, 1.0, &spec->zero_fraction);
+        } else if (!strcmp(token, "duplicate-fraction")) {
+            ret = parse_number(value, 0.0, 1.0, &spec->duplicate_fraction);
+        } else if (!strcmp(token, "seed")) {
+            char *end;
+            spec->seed = strtoull(value, &end, 0);
+            ret = end == value || *end != '\0';
+        } else {
+            ret = 1;
+        }
+    }
+    free(copy);
+
+    if (ret) {
+        printf("Error: invalid synthetic data specification %s.\n", str);
+        return 1;
+    }
+
+    if (spec->zero_fraction + spec->duplicate_fraction > 1.0) {
+        puts("Error: sum of zero and duplicate page fractions is greater than 1.");
+        return 1;
+    }
+
+    return 0;
+}
+
+unsigned char *generate_synthetic(const synthetic_spec *spec)
+{
+    unsigned char *buf;
+    unsigned symbols = (unsigned)lround(pow(2.0, spec->entropy));
+    uint64_t state = spec->seed;
+    size_t pages = (spec->size + SYNTHETIC_PAGE_SIZE - 1) / SYNTHETIC_PAGE_SIZE;
+
+    // Buffer is zeroed, so zero pages are left as they are.
+    buf = alloc_aligned_buffer(spec->size);
+    if (!buf) {
+        puts("Error: problem with allocating memory for synthetic data.");
+        return NULL;
+    }
+
+    for (size_t page = 0; page < pages; ++page) {
+        size_t offset = page * SYNTHETIC_PAGE_SIZE;
+        size_t len = spec->size - offset < SYNTHETIC_PAGE_SIZE ? spec->size - offset : SYNTHETIC_PAGE_SIZE;
+        double r = random_unit(&state);
+
+        if (r < spec->zero_fraction) {
+            continue;
+        }
+
+        if (r < spec->zero_fraction + spec->duplicate_fraction && page > 0) {
+            size_t source = next_random(&state) % page;
+            memcpy(buf + offset, buf + source * SYNTHETIC_PAGE_SIZE, len);
+            continue;
+        }
+
+        fill_fresh(buf, offset, len, spec, symbols, &state);
+    }
+
+    return buf;
+}
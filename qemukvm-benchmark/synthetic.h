@@ -0,0 +1,52 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Page size of generated data: zero and duplicate pages are whole pages, like pages of guest RAM.
+#define SYNTHETIC_PAGE_SIZE 4096
+
+// Default size of generated data.
+#define SYNTHETIC_SIZE (16 * 1024 * 1024)
+
+// Maximum length of input name of synthetic data.
+#define SYNTHETIC_NAME_MAX 256
+
+// Stem of archive and output file names of synthetic data in tmpfs sink (input name holds the specification).
+#define SYNTHETIC_FILE_STEM "synthetic"
+
+/**
+ * Parameters of synthetic data (--synthetic). Every page is a zero page, a copy of a random
+ * earlier page or a fresh page. Fresh pages are runs of random symbols with given entropy and,
+ * with repeat_distance set, runs copied from repeat_distance bytes back (LZ matches).
+ */
+typedef struct {
+    size_t size;
+    double entropy;             // Bits per byte of random symbols, 0 to 8.
+    size_t repeat_distance;     // Distance of repeated runs, 0 - no repeated runs.
+    double repeat_fraction;     // Fraction of runs of fresh pages which are repeated.
+    double zero_fraction;       // Fraction of zero pages.
+    double duplicate_fraction;  // Fraction of pages duplicating an earlier page.
+    uint64_t seed;              // Seed of generator, same seed gives the same data.
+    char name[SYNTHETIC_NAME_MAX];  // Input name written to result records.
+} synthetic_spec;
+
+/**
+ * @brief Parses specification of synthetic data, comma separated key=value pairs, e.g.
+ * "entropy=6,size=1G,repeat-distance=64K,zero-fraction=0.3". Keys are entropy, size, repeat-distance,
+ * repeat-fraction, zero-fraction, duplicate-fraction and seed, missing ones get defaults.
+ * @param str specification
+ * @param spec parsed specification
+ * @return Returns 0 on success or 1 if specification is invalid (error is printed).
+ */
+int parse_synthetic(const char *str, synthetic_spec *spec);
+
+/**
+ * @brief Generates synthetic data into page aligned buffer. Data depends only on specification.
+ * @param spec specification
+ * @return Returns pointer to buffer of spec->size bytes (release with free()) or NULL if memory could not be allocated.
+ */
+unsigned char *generate_synthetic(const synthetic_spec *spec);
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include "threads.h"
+#include "report.h"
+#include "arena.h"
+#include "checksum.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    GATE_WAIT,
+    GATE_RUN,
+    GATE_ABORT
+};
+
+// Holds workers until all threads are created.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int state;
+} start_gate;
+
+typedef struct {
+    const codec *c;
+    const unsigned char *source;
+    size_t source_len;
+    int level;
+    const codec_params *params;
+    int iterations;
+    int warmup;                     // Discarded iterations (including the first, cold one).
+    int cpu;                        // CPU to pin thread to, -1 - no pinning.
+    start_gate *gate;
+    pthread_barrier_t *barrier;     // Synchronizes start of compression and decompression phases.
+    int failed;                     // Set by every thread, which failed.
+    uint64_t compression_start;     // Start and end of measured compression iterations (BENCH_CLOCK, ns).
+    uint64_t compression_stop;
+    uint64_t decompression_start;   // Start and end of measured decompression iterations.
+    uint64_t decompression_stop;
+    int verify;                     // Check the last decompressed output against source_crc.
+    uint32_t source_crc;
+} worker;
+
+/**
+ * @brief Worker thread. Once started, always waits on all barriers, even if something go wrong,
+ * so other threads are never blocked.
+ * @param arg worker structure
+ * @return Returns NULL.
+ */
+static void *worker_thread(void *arg)
+{
+    worker *w = (worker*)arg;
+    const codec *c = w->c;
+    struct timespec start_ts, stop_ts;
+    arena mem;
+    unsigned char *source, *arch, *output;
+    size_t arch_size = c->compress_bound(w->source_len);
+    size_t arch_len = 0;
+    size_t output_len;
+    void *ctx = NULL;
+    int ret = CODEC_SUCCESS;
+    int state;
+
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            printf("Warning: problem with pinning thread to CPU %d.\n", w->cpu);
+        }
+    }
+
+    // Private buffers and codec work memory are allocated (and touched) by the thread itself,
+    // so they are local to its NUMA node.
+    arena_init(&mem);
+    source = (unsigned char*)arena_alloc(&mem, w->source_len);
+    arch = (unsigned char*)arena_alloc(&mem, arch_size);
+    output = (unsigned char*)arena_alloc(&mem, w->source_len);
+    if (!source || !arch || !output) {
+        printf("%s error: problem with allocating memory for buffers.\n", c->name);
+        ret = CODEC_FAILURE;
+    } else {
+        memcpy(source, w->source, w->source_len);
+        ret = c->init(&ctx, w->level, w->params);
+        if (ret != CODEC_SUCCESS) {
+            ctx = NULL;
+        } else if (c->reserve && c->reserve(ctx, &mem, w->source_len) != CODEC_SUCCESS) {
+            printf("%s error: problem with allocating work memory.\n", c->name);
+            ret = CODEC_FAILURE;
+        }
+    }
+
+    pthread_mutex_lock(&w->gate->lock);
+    while (w->gate->state == GATE_WAIT) {
+        pthread_cond_wait(&w->gate->cond, &w->gate->lock);
+    }
+    state = w->gate->state;
+    pthread_mutex_unlock(&w->gate->lock);
+
+    if (state == GATE_ABORT) {
+        ret = CODEC_FAILURE;
+        goto cleanup;
+    }
+
+    // Warm-up iterations, then all threads start measured iterations at once.
+    pthread_barrier_wait(w->barrier);
+    for (int i = 0; i < w->warmup && ret == CODEC_SUCCESS; ++i) {
+        arch_len = arch_size;
+        ret = c->compress(ctx, source, w->source_len, arch, &arch_len);
+    }
+
+    pthread_barrier_wait(w->barrier);
+    get_time(&start_ts);
+    for (int i = 0; i < w->iterations && ret == CODEC_SUCCESS; ++i) {
+        arch_len = arch_size;
+        ret = c->compress(ctx, source, w->source_len, arch, &arch_len);
+    }
+    get_time(&stop_ts);
+    w->compression_start = timespec_to_ns(start_ts);
+    w->compression_stop = timespec_to_ns(stop_ts);
+
+    pthread_barrier_wait(w->barrier);
+    for (int i = 0; i < w->warmup && ret == CODEC_SUCCESS; ++i) {
+        output_len = w->source_len;
+        ret = c->decompress(ctx, arch, arch_len, output, &output_len);
+    }
+
+    pthread_barrier_wait(w->barrier);
+    get_time(&start_ts);
+    for (int i = 0; i < w->iterations && ret == CODEC_SUCCESS; ++i) {
+        output_len = w->source_len;
+        ret = c->decompress(ctx, arch, arch_len, output, &output_len);
+    }
+    get_time(&stop_ts);
+    w->decompression_start = timespec_to_ns(start_ts);
+    w->decompression_stop = timespec_to_ns(stop_ts);
+
+    // Outside the timed region, no other thread waits for this one anymore.
+    if (ret == CODEC_SUCCESS && w->verify &&
+            verify_checksum(c->name, w->source_len, w->source_crc, output_len, crc32c(0, output, output_len)) != 0) {
+        ret = CODEC_FAILURE;
+    }
+
+cleanup:
+    w->failed = ret != CODEC_SUCCESS;
+    if (ctx) {
+        c->teardown(ctx);
+    }
+    arena_destroy(&mem);
+    return NULL;
+}
+
+/**
+ * @brief Gets CPUs the process is allowed to run on.
+ * @param cpus array of CPU numbers (at least CPU_SETSIZE elements)
+ * @return Returns number of CPUs.
+ */
+static int get_allowed_cpus(int *cpus)
+{
+    cpu_set_t set;
+    int count = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &set)) {
+            cpus[count++] = i;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Runs benchmark on given number of threads.
+ * Aggregate throughput is total amount of data processed by all threads divided by wall time
+ * from the start of the first thread to the end of the last one.
+ * @param c codec
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param options benchmark options
+ * @param threads threads count
+ * @param compression_throughput aggregate compression throughput in MB/s
+ * @param decompression_throughput aggregate decompression throughput in MB/s
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int run_workers(const codec *c, const unsigned char *source, size_t source_len, bench_options options,
+                       int threads, double *compression_throughput, double *decompression_throughput)
+{
+    static int cpus[CPU_SETSIZE];
+    int cpus_count = get_allowed_cpus(cpus);
+    start_gate gate;
+    pthread_barrier_t barrier;
+    pthread_t *ids;
+    worker *workers;
+    uint64_t compression_start = 0, compression_stop = 0;
+    uint64_t decompression_start = 0, decompression_stop = 0;
+    double total_len;
+    uint32_t source_crc = options.verify ? crc32c(0, source, source_len) : 0;
+    int started = 0;
+    int ret = CODEC_SUCCESS;
+
+    ids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    workers = (worker*)calloc(threads, sizeof(worker));
+    if (!ids || !workers) {
+        puts("Error: problem with allocating memory for threads.");
+        free(ids);
+        free(workers);
+        return CODEC_FAILURE;
+    }
+
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.state = GATE_WAIT;
+    pthread_barrier_init(&barrier, NULL, threads);
+    for (int i = 0; i < threads; ++i) {
+        workers[i].c = c;
+        workers[i].source = source;
+        workers[i].source_len = source_len;
+        workers[i].level = codec_level(c, options.level);
+        workers[i].params = &options.params;
+        workers[i].iterations = options.iterations;
+        workers[i].warmup = 1 + options.warmup;
+        workers[i].cpu = cpus_count ? cpus[i % cpus_count] : -1;
+        workers[i].gate = &gate;
+        workers[i].barrier = &barrier;
+        workers[i].verify = options.verify;
+        workers[i].source_crc = source_crc;
+
+        if (pthread_create(&ids[i], NULL, worker_thread, &workers[i]) != 0) {
+            puts("Error: problem with creating thread.");
+            break;
+        }
+        started++;
+    }
+
+    // Threads are released only if all of them were created, otherwise they would wait on the barrier forever.
+    pthread_mutex_lock(&gate.lock);
+    gate.state = started == threads ? GATE_RUN : GATE_ABORT;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+
+    if (started != threads) {
+        ret = CODEC_FAILURE;
+    } else {
+        for (int i = 0; i < threads; ++i) {
+            if (workers[i].failed) {
+                ret = CODEC_FAILURE;
+            }
+            if (i == 0 || workers[i].compression_start < compression_start) {
+                compression_start = workers[i].compression_start;
+            }
+            if (workers[i].compression_stop > compression_stop) {
+                compression_stop = workers[i].compression_stop;
+            }
+            if (i == 0 || workers[i].decompression_start < decompression_start) {
+                decompression_start = workers[i].decompression_start;
+            }
+            if (workers[i].decompression_stop > decompression_stop) {
+                decompression_stop = workers[i].decompression_stop;
+            }
+        }
+
+        total_len = (double)source_len * options.iterations * threads;
+        // Bytes per nanosecond to MB/s.
+        *compression_throughput = compression_stop > compression_start ?
+                    total_len * 1000.0 / (compression_stop - compression_start) : 0.0;
+        *decompression_throughput = decompression_stop > decompression_start ?
+                    total_len * 1000.0 / (decompression_stop - decompression_start) : 0.0;
+    }
+
+    pthread_barrier_destroy(&barrier);
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&gate.lock);
+    free(ids);
+    free(workers);
+    return ret;
+}
+
+int run_threaded_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options)
+{
+    double single_compression, single_decompression;
+    double compression, decompression;
+    int cpus[CPU_SETSIZE];
+    int cpus_count = get_allowed_cpus(cpus);
+
+    if (cpus_count && options.threads > cpus_count) {
+        printf("Warning: %d threads on %d CPUs - some CPUs are shared.\n", options.threads, cpus_count);
+    }
+
+    printf("%s: %d threads, compression level set on %d\n", c->name, options.threads, codec_level(c, options.level));
+
+    if (run_workers(c, source, source_len, options, 1, &single_compression, &single_decompression) != CODEC_SUCCESS ||
+            run_workers(c, source, source_len, options, options.threads, &compression, &decompression) != CODEC_SUCCESS) {
+        printf("%s error: threaded benchmark failed.\n", c->name);
+        return CODEC_FAILURE;
+    }
+
+    printf("Single thread compression throughput: %.2f MB/s\n", single_compression);
+    printf("Aggregate compression throughput: %.2f MB/s\n", compression);
+    printf("Compression scaling efficiency: %.2f%%\n", compression / (single_compression * options.threads) * 100.0);
+    printf("Single thread decompression throughput: %.2f MB/s\n", single_decompression);
+    printf("Aggregate decompression throughput: %.2f MB/s\n", decompression);
+    printf("Decompression scaling efficiency: %.2f%%\n", decompression / (single_decompression * options.threads) * 100.0);
+    if (options.verify) {
+        printf("Verification: the last decompressed output of every thread matches source (CRC32C, %s)\n",
+               crc32c_implementation());
+    }
+
+    report_scaling(c, options, source_len, single_compression, compression, single_decompression, decompression);
+
+    return CODEC_SUCCESS;
+}
@@ -0,0 +1,20 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stddef.h>
+#include "codec.h"
+#include "util.h"
+
+/**
+ * @brief Runs codec-only benchmark on options.threads worker threads pinned to distinct CPUs.
+ * Each thread has its own codec context and private copy of input and output buffers.
+ * Benchmark is run with a single thread first, then with all threads, to get scaling efficiency.
+ * @param c codec
+ * @param source input buffer
+ * @param source_len input buffer size
+ * @param options benchmark options
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+int run_threaded_benchmark(const codec *c, const unsigned char *source, size_t source_len, bench_options options);
+
+#endif // THREADS_H
@@ -0,0 +1,78 @@
+#include "timer.h"
+#include "util.h"
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+static int use_tsc;
+static double ns_per_tick = 1.0;
+static char source[64] = "clock_gettime";
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Checks if CPU has rdtscp instruction and invariant TSC (constant rate, not stopped in idle states).
+ * Guests see invariant TSC only if hypervisor exposes it (e.g. QEMU -cpu host,+invtsc).
+ */
+static int has_invariant_tsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 27))) {
+        return 0;
+    }
+
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+}
+#endif
+
+void timer_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec start_ts, now_ts;
+    uint64_t start, ns;
+    unsigned int aux;
+
+    if (!has_invariant_tsc()) {
+        return;
+    }
+
+    // TSC frequency isn't reported by every CPU (and hypervisor), so it is measured.
+    get_time(&start_ts);
+    start = __rdtscp(&aux);
+    do {
+        get_time(&now_ts);
+        ns = elapsed_ns(start_ts, now_ts);
+    } while (ns < TIMER_CALIBRATION_MS * 1000000ULL);
+    ns_per_tick = (double)ns / (__rdtscp(&aux) - start);
+
+    use_tsc = 1;
+    snprintf(source, sizeof(source), "rdtscp, %.3f GHz", 1.0 / ns_per_tick);
+#endif
+}
+
+uint64_t timer_now(void)
+{
+    struct timespec ts;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (use_tsc) {
+        unsigned int aux;
+        return __rdtscp(&aux);
+    }
+#endif
+
+    get_time(&ts);
+    return timespec_to_ns(ts);
+}
+
+uint64_t timer_ns(uint64_t ticks)
+{
+    return use_tsc ? (uint64_t)(ticks * ns_per_tick) : ticks;
+}
+
+const char *timer_source(void)
+{
+    return source;
+}
@@ -0,0 +1,34 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Calibration time of TSC against BENCH_CLOCK, in ms.
+#define TIMER_CALIBRATION_MS 20
+
+/**
+ * @brief Chooses timestamp source for timing of short calls: rdtscp when CPU has invariant TSC
+ * (calibrated against BENCH_CLOCK), BENCH_CLOCK otherwise. Called once before timer_now().
+ */
+void timer_init(void);
+
+/**
+ * @brief Gets timestamp.
+ * @return Returns timestamp in ticks of timestamp source.
+ */
+uint64_t timer_now(void);
+
+/**
+ * @brief Converts ticks to nanoseconds.
+ * @param ticks difference of timestamps
+ * @return Returns nanoseconds.
+ */
+uint64_t timer_ns(uint64_t ticks);
+
+/**
+ * @brief Gets description of timestamp source, e.g. "rdtscp, 2.100 GHz".
+ * @return Returns description.
+ */
+const char *timer_source(void);
+
+#endif // TIMER_H
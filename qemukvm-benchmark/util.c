@@ -1,4 +1,6 @@
 #include "util.h"
+#include <stdlib.h>
+#include <string.h>
 
 struct timespec diff(struct timespec start, struct timespec end)
 {
@@ -14,12 +16,116 @@ struct timespec diff(struct timespec start, struct timespec end)
     return temp;
 }
 
-int get_file_size(FILE *input_file)
+off_t get_file_size(FILE *input_file)
 {
-    int size = 0;
-    fseek(input_file, 0, SEEK_END);
-    size = ftell(input_file);
+    off_t size = -1;
+
+    // 64-bit offsets, so RAM dumps and block devices of many GB are measured whole.
+    if (fseeko(input_file, 0, SEEK_END) == 0) {
+        size = ftello(input_file);
+    }
     rewind(input_file);
 
     return size;
 }
+
+void get_time(struct timespec *ts)
+{
+    clock_gettime(BENCH_CLOCK, ts);
+}
+
+void get_cpu_time(struct timespec *ts)
+{
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, ts);
+}
+
+uint64_t timespec_to_ns(struct timespec ts)
+{
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t elapsed_ns(struct timespec start, struct timespec end)
+{
+    return timespec_to_ns(diff(start, end));
+}
+
+unsigned char *alloc_aligned_buffer(size_t size)
+{
+    void *buf = NULL;
+
+    // posix_memalign() doesn't guarantee anything for size 0.
+    if (posix_memalign(&buf, BUFFER_ALIGNMENT, size ? size : 1) != 0) {
+        return NULL;
+    }
+
+    memset(buf, 0, size);
+    return (unsigned char*)buf;
+}
+
+unsigned char *load_file_aligned(FILE *input_file, size_t *size)
+{
+    unsigned char *buf;
+    off_t file_size = get_file_size(input_file);
+
+    if (file_size < 0) {
+        puts("Error: problem with getting input file size.");
+        return NULL;
+    }
+
+    buf = alloc_aligned_buffer(file_size);
+    if (!buf) {
+        puts("Error: problem with allocating memory for input buffer.");
+        return NULL;
+    }
+
+    if (fread(buf, 1, file_size, input_file) != (size_t)file_size || ferror(input_file)) {
+        puts("Error: problem with reading input file.");
+        free(buf);
+        return NULL;
+    }
+
+    rewind(input_file);
+    *size = file_size;
+    return buf;
+}
+
+int make_file_names(const char *file_name, const char *extension, char *arch_file_name, char *output_file_name)
+{
+    if (snprintf(arch_file_name, FILENAME_MAX, "%s%s", file_name, extension) >= FILENAME_MAX ||
+            snprintf(output_file_name, FILENAME_MAX, "%s_dec", arch_file_name) >= FILENAME_MAX) {
+        printf("Error: input file name %s is too long.\n", file_name);
+        return 1;
+    }
+
+    return 0;
+}
+
+size_t parse_size(const char *str)
+{
+    char *end;
+    unsigned long long size = strtoull(str, &end, 10);
+
+    if (end == str) {
+        return 0;
+    }
+
+    switch (*end) {
+    case 'G':
+    case 'g':
+        size *= 1024;
+        // Fall through.
+    case 'M':
+    case 'm':
+        size *= 1024;
+        // Fall through.
+    case 'K':
+    case 'k':
+        size *= 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    return *end == '\0' ? size : 0;
+}
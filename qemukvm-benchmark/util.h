@@ -3,22 +3,55 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "codec.h"
+#include "perf.h"
+#include "sink.h"
 
+// Clock used for all measurements. It is not adjusted by NTP (which steps time inside guests).
+#define BENCH_CLOCK CLOCK_MONOTONIC_RAW
+
+// Alignment of buffers used by in-memory benchmark (one page).
+#define BUFFER_ALIGNMENT 4096
+
+// Symbolic compression levels, mapped to codec's low_level and high_level.
+// Non-negative levels are codec's own levels (--levels).
 enum {
-    LIB_ZLIB,
-    LIB_BZIP2,
-    LIB_SNAPPY,
-    LIB_LZO
-};
-enum {
-    LOW_COMPRESSION,
-    HIGH_COMPRESSION
+    DEFAULT_COMPRESSION = -3,   // No level option: high level, corpus runs both.
+    LOW_COMPRESSION = -2,
+    HIGH_COMPRESSION = -1
 };
 
 typedef struct {
-    int iterations;
-    int library;
-    int level;
+    int iterations;     // Measured iterations (minimum in calibration mode).
+    int warmup;         // Discarded iterations after the first, cold one.
+    double time_budget; // Calibration: measure until total time reaches budget (ms), 0 - off.
+    double rel_error;   // Calibration: measure until relative error of the mean drops below (%), 0 - off.
+    const codec *library;  // NULL - all registered codecs.
+    int level;          // Symbolic or codec's own compression level.
+    const int *levels;  // Levels of sweep (--levels), sorted.
+    int levels_count;   // 0 - no sweep.
+    int in_memory;  // Codec-only, buffer-to-buffer measurement.
+    int threads;    // Worker threads count for scaling measurement, 0 - single-threaded benchmark.
+    int parallel;   // Parallel block compression threads count, 0 - serial compression.
+    size_t block_size;  // Block size of parallel compression.
+    size_t page_size;   // Page size of migration workload (--pages), 0 - whole input is compressed at once.
+    int latency;        // Call latency benchmark of small buffers (--latency).
+    int streams;        // Workers of multi-stream mode (--streams), 0 - off.
+    int pipeline;       // I/O backend of pipelined end-to-end mode (--pipeline), 0 (PIPELINE_OFF) - off.
+    const char *input_name; // Input name written to result records.
+    int input;      // Input path of end-to-end benchmark: INPUT_STDIO, INPUT_READ or INPUT_MMAP.
+    int populate;   // MAP_POPULATE for mapped input.
+    int advice;     // madvise() advice for mapped input.
+    int drop_cache; // Drop page cache of input file before every iteration (--drop-cache).
+    sink_options sink;  // Destination of archive and decompressed output of end-to-end and parallel benchmarks.
+    codec_params params;    // Codec tuning parameters.
+    int verify;     // Check every decompressed output against CRC32C of source.
+    const perf_counters *perf;  // Counters around timed regions (--perf), NULL - not counted.
+    double max_steal;   // Steal time threshold (% of iteration time) of flagged iterations.
+    int discard_steal;  // Discard and repeat flagged iterations.
 } bench_options;
 
 /**
@@ -30,9 +63,69 @@ typedef struct {
 struct timespec diff(struct timespec start, struct timespec end);
 
 /**
- * @brief Gets input file size.
+ * @brief Gets input file size, file is rewound.
  * @param input_file input file
- * @return Input file size.
+ * @return Input file size or -1 if it can't be determined (e.g. pipe).
+ */
+off_t get_file_size(FILE *input_file);
+
+/**
+ * @brief Gets current time of BENCH_CLOCK.
+ * @param ts current time
+ */
+void get_time(struct timespec *ts);
+
+/**
+ * @brief Gets CPU time consumed by calling thread (CLOCK_THREAD_CPUTIME_ID).
+ * @param ts current CPU time
+ */
+void get_cpu_time(struct timespec *ts);
+
+/**
+ * @brief Converts timespec structure to nanoseconds.
+ * @param ts time to convert
+ * @return Returns time in nanoseconds.
+ */
+uint64_t timespec_to_ns(struct timespec ts);
+
+/**
+ * @brief Calculates time elapsed between two measurements.
+ * @param start Struct describing beginning of time measurement.
+ * @param end Struct describing end of time measurement.
+ * @return Returns elapsed time in nanoseconds.
+ */
+uint64_t elapsed_ns(struct timespec start, struct timespec end);
+
+/**
+ * @brief Allocates page aligned buffer and touches all its pages,
+ * so page faults are not counted inside timed region.
+ * @param size buffer size
+ * @return Returns pointer to buffer (release with free()) or NULL if allocation failed.
+ */
+unsigned char *alloc_aligned_buffer(size_t size);
+
+/**
+ * @brief Loads whole input file into page aligned buffer.
+ * @param input_file input file
+ * @param size loaded data size
+ * @return Returns pointer to buffer (release with free()) or NULL if something go wrong.
+ */
+unsigned char *load_file_aligned(FILE *input_file, size_t *size);
+
+/**
+ * @brief Makes names of archive (<input><extension>) and decompressed output (<archive>_dec) next to input.
+ * @param file_name input file name
+ * @param extension archive extension of codec
+ * @param arch_file_name archive file name, FILENAME_MAX bytes
+ * @param output_file_name output file name, FILENAME_MAX bytes
+ * @return Returns 0 on success or 1 if names don't fit in FILENAME_MAX.
+ */
+int make_file_names(const char *file_name, const char *extension, char *arch_file_name, char *output_file_name);
+
+/**
+ * @brief Parses size with optional K, M or G suffix (powers of 1024), e.g. 256K.
+ * @param str string to parse
+ * @return Returns size in bytes or 0 if string is invalid.
  */
-int get_file_size(FILE *input_file);
+size_t parse_size(const char *str);
 #endif // UTIL_H
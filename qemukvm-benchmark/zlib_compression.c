@@ -1,75 +1,166 @@
 #include "zlib_compression.h"
 #include "util.h"
+#include "arena.h"
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
 
-static float mean_compression_time;
-static float mean_compression_ratio;
-static float mean_decompression_time;
+// Size of deflate window, which is also maximum dictionary size.
+#define ZLIB_WINDOW_SIZE 32768
+
+typedef struct {
+    int level;
+    size_t chunk_size;          // Size of streaming buffers.
+    work_buffer in;             // Streaming input and output buffers (chunk_size bytes each).
+    work_buffer out;
+    arena *arena;               // Memory of deflate and inflate streams, NULL - zlib default allocator.
+    z_stream deflate_stream;    // Streams reused across calls with deflateReset()/inflateReset().
+    int deflate_ready;
+    z_stream inflate_stream;
+    int inflate_ready;
+    z_stream block_stream;      // Raw deflate stream used by parallel engine.
+    int block_stream_ready;
+} zlib_context;
+
+static voidpf arena_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return arena_alloc((arena*)opaque, (size_t)items * size);
+}
+
+static void arena_zfree(voidpf opaque, voidpf address)
+{
+    // Released with arena.
+}
+
+/**
+ * @brief Sets allocator of stream: arena of context if set, otherwise zlib default one.
+ * @param context zlib context
+ * @param stream stream to initialize
+ */
+static void set_allocator(zlib_context *context, z_stream *stream)
+{
+    if (context->arena) {
+        stream->zalloc = arena_zalloc;
+        stream->zfree = arena_zfree;
+        stream->opaque = context->arena;
+    } else {
+        stream->zalloc = Z_NULL;
+        stream->zfree = Z_NULL;
+        stream->opaque = Z_NULL;
+    }
+}
+
+/**
+ * @brief Gets streaming buffers of context, allocated on first use.
+ * @param context zlib context
+ * @return Returns Z_OK on success or Z_MEM_ERROR if memory could not be allocated.
+ */
+static int streaming_buffers(zlib_context *context)
+{
+    if (work_buffer_reserve(&context->in, context->chunk_size, NULL) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, NULL) != 0) {
+        return Z_MEM_ERROR;
+    }
+
+    return Z_OK;
+}
+
+/**
+ * @brief Gets deflate stream of context, initialized on first use and reset on next ones.
+ * @param context zlib context
+ * @return Returns Z_OK on success or zlib error code.
+ */
+static int deflate_stream(zlib_context *context)
+{
+    int ret;
+
+    if (context->deflate_ready) {
+        return deflateReset(&context->deflate_stream);
+    }
+
+    set_allocator(context, &context->deflate_stream);
+    ret = deflateInit(&context->deflate_stream, context->level);
+    context->deflate_ready = ret == Z_OK;
+    return ret;
+}
+
+/**
+ * @brief Gets inflate stream of context, initialized on first use and reset on next ones.
+ * @param context zlib context
+ * @return Returns Z_OK on success or zlib error code.
+ */
+static int inflate_stream(zlib_context *context)
+{
+    int ret;
+
+    if (context->inflate_ready) {
+        return inflateReset(&context->inflate_stream);
+    }
+
+    set_allocator(context, &context->inflate_stream);
+    context->inflate_stream.avail_in = 0;
+    context->inflate_stream.next_in = Z_NULL;
+    ret = inflateInit(&context->inflate_stream);
+    context->inflate_ready = ret == Z_OK;
+    return ret;
+}
 
 /**
  * @brief Compresses data from source file to dest file.
+ * @param context zlib context (level, streaming buffers and deflate stream)
  * @param source input file
  * @param dest output file
- * @param level compression level (in the range of -1 to 9)
  * @return Returns Z_OK on success,
  * Z_MEM_ERROR if memeory could not be allocated,
  * ZVERSION_ERROR if the version of zlib.h and the version of the library linked do not match,
  * Z_ERRNO if there is an error reading or writing the files.
  */
-static int def(FILE *source, FILE *dest, int level)
+static int def(zlib_context *context, FILE *source, FILE *dest)
 {
     int ret, flush;
     unsigned int have;  // Amount of data returned from deflate().
-    z_stream stream;    // Is used to pass information to/from zlib routines.
-    unsigned char in[CHUNK];    // Input buffer.
-    unsigned char out[CHUNK];   // Output buffer.
-
-    // Initialize zlib state.
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    ret = deflateInit(&stream, level);
+    z_stream *stream = &context->deflate_stream;
+    size_t chunk = context->chunk_size;
+
+    ret = streaming_buffers(context);
+    if (ret == Z_OK) {
+        ret = deflate_stream(context);
+    }
     if (ret != Z_OK) {
         return ret;
     }
 
     // Start compression (until the end of file).
     do {
-        stream.avail_in = fread(in, 1, CHUNK, source);
+        stream->avail_in = fread(context->in.data, 1, chunk, source);
         if (ferror(source)) {
-            // If error occurred - free the allocated zlib state.
-            deflateEnd(&stream);
             return Z_ERRNO;
         }
 
         // Check if end of file.
         flush = feof(source) ? Z_FINISH : Z_NO_FLUSH;
-        stream.next_in = in;
+        stream->next_in = context->in.data;
 
         // Run deflate until output buffer not full.
         do {
-            stream.avail_out = CHUNK;
-            stream.next_out = out;
-            ret = deflate(&stream, flush);
-            have = CHUNK - stream.avail_out;
-            if (fwrite(out, 1, have, dest) != have || ferror(dest)) {
-                (void)deflateEnd(&stream);
+            stream->avail_out = chunk;
+            stream->next_out = context->out.data;
+            ret = deflate(stream, flush);
+            have = chunk - stream->avail_out;
+            if (fwrite(context->out.data, 1, have, dest) != have || ferror(dest)) {
                 return Z_ERRNO;
             }
-        } while (stream.avail_out == 0);
+        } while (stream->avail_out == 0);
 
     } while (flush != Z_FINISH);
 
-    // Measure/print compression ratio.
-    mean_compression_ratio += (stream.total_out / (float)stream.total_in) * 100.0f;
-
-    deflateEnd(&stream);
     return Z_OK;
 }
 
 /**
  * @brief Decompress data from source file to dest file.
+ * @param context zlib context (streaming buffers and inflate stream)
  * @param source input file
  * @param output output, decompressed file
  * @return Returns Z_OK on success,
@@ -78,45 +169,39 @@ static int def(FILE *source, FILE *dest, int level)
  * ZVERSION_ERROR if the version of zlib.h and the version of the library linked do not match,
  * Z_ERRNO if there is an error reading or writing the files.
  */
-static int inf(FILE *source, FILE *output)
+static int inf(zlib_context *context, FILE *source, FILE *output)
 {
     int ret;
     unsigned int have;
-    z_stream stream;    // Is used to pass information to/from zlib routines.
-    unsigned char in[CHUNK];    // Input buffer.
-    unsigned char out[CHUNK];   // Output buffer.
-
-    // Initialize zlib state.
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
-    stream.avail_in = 0;
-    stream.next_in = Z_NULL;
-
-    ret = inflateInit(&stream);
+    z_stream *stream = &context->inflate_stream;
+    size_t chunk = context->chunk_size;
+
+    ret = streaming_buffers(context);
+    if (ret == Z_OK) {
+        ret = inflate_stream(context);
+    }
     if (ret != Z_OK) {
         return ret;
     }
 
     // Start compression (until the end of file).
     do {
-        stream.avail_in = fread(in, 1, CHUNK, source);
+        stream->avail_in = fread(context->in.data, 1, chunk, source);
         if (ferror(source)) {
-            inflateEnd(&stream);
             return Z_ERRNO;
         }
-        if (stream.avail_in == 0) {
+        if (stream->avail_in == 0) {
             break;
         }
-        stream.next_in = in;
+        stream->next_in = context->in.data;
 
         // Run inflate until output buffer not null.
         do {
-            stream.avail_out = CHUNK;
-            stream.next_out = out;
+            stream->avail_out = chunk;
+            stream->next_out = context->out.data;
 
             // No need to adjust flush parameter - zlib format is self-terminating.
-            ret = inflate(&stream, Z_NO_FLUSH);
+            ret = inflate(stream, Z_NO_FLUSH);
 
             // But we need to pay atention to return value.
             switch (ret) {
@@ -124,114 +209,318 @@ static int inf(FILE *source, FILE *output)
                 ret = Z_DATA_ERROR;
             case Z_DATA_ERROR:
             case Z_MEM_ERROR:
-                inflateEnd(&stream);
                 return ret;
             }
 
-            have = CHUNK - stream.avail_out;
-            if (fwrite(out, 1, have, output) != have || ferror(output)) {
+            have = chunk - stream->avail_out;
+            if (fwrite(context->out.data, 1, have, output) != have || ferror(output)) {
                 puts("zlib decompression error: problem with writing to output file");
-                inflateEnd(&stream);
                 return Z_ERRNO;
             }
-        } while (stream.avail_out == 0);
+        } while (stream->avail_out == 0);
 
     } while (ret != Z_STREAM_END);
 
-    inflateEnd(&stream);
     return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
 }
 
+static int zlib_init(void **ctx, int level, const codec_params *params)
+{
+    zlib_context *context = (zlib_context*)calloc(1, sizeof(zlib_context));
+    if (!context) {
+        return CODEC_FAILURE;
+    }
+
+    context->level = level;
+    context->chunk_size = params && params->chunk_size ? params->chunk_size : CHUNK;
+
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t zlib_compress_bound(size_t source_len)
+{
+    return compressBound(source_len);
+}
+
 /**
- * @brief Runs def function and measure compression stats.
- * @param source input file
- * @param arch archive file
- * @param level compression level
- * @return Returns ZLIB_SUCCESS on success or ZLIB_FAILURE if something go wrong.
+ * @brief Refills avail_in and avail_out of stream from the rest of buffers, at most UINT_MAX bytes at once
+ * (avail_in and avail_out are uInt), so buffers of several GB are fed in slices.
+ * @param stream zlib stream
+ * @param in_left rest of input buffer, decreased by the new avail_in
+ * @param out_left rest of output buffer, decreased by the new avail_out
  */
-static int compress_with_zlib(FILE *source, FILE *arch, int level)
+static void feed_stream(z_stream *stream, size_t *in_left, size_t *out_left)
+{
+    if (stream->avail_in == 0) {
+        stream->avail_in = *in_left > UINT_MAX ? UINT_MAX : (uInt)*in_left;
+        *in_left -= stream->avail_in;
+    }
+    if (stream->avail_out == 0) {
+        stream->avail_out = *out_left > UINT_MAX ? UINT_MAX : (uInt)*out_left;
+        *out_left -= stream->avail_out;
+    }
+}
+
+// Same as compress2(), but with deflate stream of context instead of new one for every call.
+static int zlib_compress(void *ctx, const unsigned char *source, size_t source_len,
+                         unsigned char *dest, size_t *dest_len)
 {
-    struct timespec start_ts, stop_ts;
+    zlib_context *context = (zlib_context*)ctx;
+    z_stream *stream = &context->deflate_stream;
+    size_t in_left = source_len, out_left = *dest_len;
+    int ret;
 
-    clock_gettime(CLOCK_REALTIME, &start_ts);
-    if (def(source, arch, level) != Z_OK) {
+    if (deflate_stream(context) != Z_OK) {
         puts("zlib compression error.");
-        return ZLIB_FAILURE;
+        return CODEC_FAILURE;
     }
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
 
-    // Measure/print stats.
-    struct timespec result_ts = diff(start_ts, stop_ts);
+    stream->next_in = (Bytef*)source;
+    stream->avail_in = 0;
+    stream->next_out = dest;
+    stream->avail_out = 0;
 
-    mean_compression_time += result_ts.tv_nsec / 1000000.0f;
+    do {
+        feed_stream(stream, &in_left, &out_left);
+        ret = deflate(stream, in_left ? Z_NO_FLUSH : Z_FINISH);
+    } while (ret == Z_OK);
+
+    if (ret != Z_STREAM_END) {
+        puts("zlib compression error.");
+        return CODEC_FAILURE;
+    }
 
-    return ZLIB_SUCCESS;
+    *dest_len = stream->total_out;
+    return CODEC_SUCCESS;
 }
 
-/**
- * @brief Runs inf function and measure decompression stats.
- * @param source input file
- * @param output output, decompressed file
- * @return Returns ZLIB_SUCCESS on success or ZLIB_FAILURE if something go wrong.
- */
-static int decompress_with_zlib(FILE *source, FILE *output)
+// Same as uncompress2(), but with inflate stream of context.
+static int zlib_decompress(void *ctx, const unsigned char *source, size_t source_len,
+                           unsigned char *dest, size_t *dest_len)
 {
-    struct timespec start_ts, stop_ts;
+    zlib_context *context = (zlib_context*)ctx;
+    z_stream *stream = &context->inflate_stream;
 
-    clock_gettime(CLOCK_REALTIME, &start_ts);
-    if (inf(source, output) != Z_OK) {
+    size_t in_left = source_len, out_left = *dest_len;
+    int ret;
+
+    if (inflate_stream(context) != Z_OK) {
         puts("zlib decompression error.");
-        return ZLIB_FAILURE;
+        return CODEC_FAILURE;
     }
-    clock_gettime(CLOCK_REALTIME, &stop_ts);
 
-    // Measure/print stats.
-    struct timespec result_ts = diff(start_ts, stop_ts);
+    stream->next_in = (Bytef*)source;
+    stream->avail_in = 0;
+    stream->next_out = dest;
+    stream->avail_out = 0;
+
+    do {
+        feed_stream(stream, &in_left, &out_left);
+        ret = inflate(stream, Z_NO_FLUSH);
+    } while (ret == Z_OK);
 
-    mean_decompression_time += result_ts.tv_nsec / 1000000.0f;
+    if (ret != Z_STREAM_END) {
+        puts("zlib decompression error.");
+        return CODEC_FAILURE;
+    }
 
-    return ZLIB_SUCCESS;
+    *dest_len = stream->total_out;
+    return CODEC_SUCCESS;
 }
 
-int run_zlib(FILE *source, FILE *arch, FILE *output, int compression_level, int iterations)
+static int zlib_compress_file(void *ctx, FILE *source, FILE *arch)
 {
-    int ret;
-    // Compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 9, where 0 gives no compression at all.
-    int level;
-    if (compression_level == LOW_COMPRESSION) {
-        level = 1;
-    } else {
-        level = 9;
-    }
+    zlib_context *context = (zlib_context*)ctx;
 
     SET_BINARY_MODE(source);
     SET_BINARY_MODE(arch);
 
-    printf("zlib: compression level set on %d\n", level);
-    for (int i = 0; i < iterations; ++i) {
-        ret = compress_with_zlib(source, arch, level);
-        if (ret == ZLIB_FAILURE) {
-            return ret;
+    if (def(context, source, arch) != Z_OK) {
+        puts("zlib compression error.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int zlib_decompress_file(void *ctx, FILE *arch, FILE *output, size_t source_len)
+{
+    zlib_context *context = (zlib_context*)ctx;
+
+    if (inf(context, arch, output) != Z_OK) {
+        puts("zlib decompression error.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int zlib_reserve(void *ctx, arena *a, size_t source_len)
+{
+    zlib_context *context = (zlib_context*)ctx;
+
+    if (work_buffer_reserve(&context->in, context->chunk_size, a) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, a) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    // Stream state (window, hash chains) is allocated from arena now, instead of in the first iteration.
+    if (!context->deflate_ready && !context->inflate_ready) {
+        context->arena = a;
+        if (deflate_stream(context) != Z_OK || inflate_stream(context) != Z_OK) {
+            return CODEC_FAILURE;
         }
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static void zlib_teardown(void *ctx)
+{
+    zlib_context *context = (zlib_context*)ctx;
+
+    if (context->deflate_ready) {
+        deflateEnd(&context->deflate_stream);
+    }
+    if (context->inflate_ready) {
+        inflateEnd(&context->inflate_stream);
+    }
+    if (context->block_stream_ready) {
+        deflateEnd(&context->block_stream);
+    }
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    free(context);
+}
 
-        rewind(source);
-        rewind(arch);
+static size_t zlib_block_bound(size_t block_len)
+{
+    // Sync flush adds empty stored block (5 bytes) after compressed data.
+    return compressBound(block_len) + 16;
+}
+
+static size_t zlib_block_header(void *ctx, size_t block_size, unsigned char *dest)
+{
+    zlib_context *context = (zlib_context*)ctx;
+    int flevel;
+
+    // FLEVEL field: 0 - fastest, 1 - fast, 2 - default, 3 - maximum compression.
+    if (context->level < 2) {
+        flevel = 0;
+    } else if (context->level < 6) {
+        flevel = 1;
+    } else if (context->level == 6) {
+        flevel = 2;
+    } else {
+        flevel = 3;
     }
 
-    printf("Mean compression ratio: %.2f%%\n", mean_compression_ratio / iterations);
-    printf("Mean compression time: %.3f ms\n", mean_compression_time / iterations);
+    // Deflate with 32 KB window, no preset dictionary. Header must be multiple of 31.
+    dest[0] = 0x78;
+    dest[1] = flevel << 6;
+    dest[1] += 31 - (dest[0] * 256 + dest[1]) % 31;
+    return 2;
+}
+
+/**
+ * @brief Compresses block to raw deflate data. Every block except the last one ends with sync flush,
+ * so blocks compressed independently can be concatenated into a single deflate stream (like pigz does).
+ * Up to 32 KB of data preceding the block is used as dictionary. Blocks above 4 GB are fed in slices.
+ */
+static int zlib_compress_block(void *ctx, const unsigned char *dict, size_t dict_len,
+                               const unsigned char *block, size_t block_len, int last,
+                               unsigned char *dest, size_t *dest_len, unsigned long *check)
+{
+    zlib_context *context = (zlib_context*)ctx;
+    z_stream *stream = &context->block_stream;
+    size_t in_left = block_len, out_left = *dest_len;
+    int ret;
 
-    rewind(arch);
-    for (int i = 0; i < iterations; ++i) {
-        ret = decompress_with_zlib(arch, output);
-        if (ret == ZLIB_FAILURE) {
-            return ret;
+    if (!context->block_stream_ready) {
+        stream->zalloc = Z_NULL;
+        stream->zfree = Z_NULL;
+        stream->opaque = Z_NULL;
+        if (deflateInit2(stream, context->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            puts("zlib compression error: problem with deflate initialization.");
+            return CODEC_FAILURE;
         }
+        context->block_stream_ready = 1;
+    } else if (deflateReset(stream) != Z_OK) {
+        puts("zlib compression error: problem with deflate reset.");
+        return CODEC_FAILURE;
+    }
+
+    if (dict_len > ZLIB_WINDOW_SIZE) {
+        dict += dict_len - ZLIB_WINDOW_SIZE;
+        dict_len = ZLIB_WINDOW_SIZE;
+    }
+    if (dict_len && deflateSetDictionary(stream, dict, dict_len) != Z_OK) {
+        puts("zlib compression error: problem with setting dictionary.");
+        return CODEC_FAILURE;
+    }
+
+    stream->next_in = (Bytef*)block;
+    stream->avail_in = 0;
+    stream->next_out = dest;
+    stream->avail_out = 0;
 
-        rewind(arch);
+    // Sync flush is complete when all input is consumed and deflate leaves room in output.
+    do {
+        feed_stream(stream, &in_left, &out_left);
+        ret = deflate(stream, in_left ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH);
+    } while (ret == Z_OK && (last || in_left || stream->avail_in || stream->avail_out == 0));
+
+    if ((last && ret != Z_STREAM_END) || (!last && ret != Z_OK)) {
+        puts("zlib compression error: problem with block compression.");
+        return CODEC_FAILURE;
     }
 
-    printf("Mean decompression time: %.3f ms\n", mean_decompression_time / iterations);
+    *dest_len = stream->total_out;
+    *check = adler32_z(adler32(0L, Z_NULL, 0), block, block_len);
+    return CODEC_SUCCESS;
+}
+
+static unsigned long zlib_combine_check(unsigned long check, unsigned long block_check, size_t block_len)
+{
+    return adler32_combine(check, block_check, block_len);
+}
 
-    return ZLIB_SUCCESS;
+static size_t zlib_block_trailer(void *ctx, unsigned long check, unsigned char *dest)
+{
+    // Adler-32 of uncompressed data, most significant byte first.
+    dest[0] = (check >> 24) & 0xff;
+    dest[1] = (check >> 16) & 0xff;
+    dest[2] = (check >> 8) & 0xff;
+    dest[3] = check & 0xff;
+    return 4;
 }
+
+static const block_codec zlib_block_codec = {
+    .min_block_size = 1024,
+    .max_block_size = (size_t)-1,
+    .block_bound = zlib_block_bound,
+    .header = zlib_block_header,
+    .compress_block = zlib_compress_block,
+    .combine_check = zlib_combine_check,
+    .trailer = zlib_block_trailer
+};
+
+// Compression level must be Z_DEFAULT_COMPRESSION, or between 0 and 9, where 0 gives no compression at all.
+const codec zlib_codec = {
+    .name = "zlib",
+    .extension = ".zlib",
+    .min_level = 0,
+    .max_level = 9,
+    .low_level = 1,
+    .high_level = 9,
+    .init = zlib_init,
+    .compress_bound = zlib_compress_bound,
+    .compress = zlib_compress,
+    .decompress = zlib_decompress,
+    .compress_file = zlib_compress_file,
+    .decompress_file = zlib_decompress_file,
+    .reserve = zlib_reserve,
+    .teardown = zlib_teardown,
+    .block = &zlib_block_codec
+};
@@ -7,11 +7,7 @@
 #define ZLIB_COMPRESSION_H
 
 #include <stdio.h>
-
-enum {
-    ZLIB_SUCCESS,
-    ZLIB_FAILURE
-};
+#include "codec.h"
 
 // Hack for Windows/MS-DOS to avoid corruption of the input and output data.
 // Source: www.zlib.net/zlib_how.html
@@ -23,19 +19,7 @@ enum {
     #define SET_BINARY_MODE(file)
 #endif
 
-// Buffer size for feeding data to and pulling data from zlib routines.
-#define CHUNK 262144    // 256 KB
-
-/**
- * @brief Start benchmark with zlib.
- * @param source input file
- * @param arch archive file after compression
- * @param output output file after decompression
- * @param compression_level compression level
- * @param iterations iterations count
- * @return Returns ZLIB_SUCCESS on success or ZLIB_FAILURE if something go wrong.
- */
-int run_zlib(FILE *source, FILE *arch, FILE *output, int compression_level, int iterations);
-
+// zlib backend.
+extern const codec zlib_codec;
 
 #endif // ZLIB_COMPRESSION_H
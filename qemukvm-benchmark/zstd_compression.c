@@ -0,0 +1,268 @@
+#include "zstd_compression.h"
+#include "util.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <zstd.h>
+
+typedef struct {
+    int level;
+    size_t chunk_size;      // Size of streaming buffers (--chunk, the same default as zlib).
+    work_buffer in;         // Streaming input and output buffers of file functions.
+    work_buffer out;
+    ZSTD_CCtx *cctx;        // Contexts reused across calls, only session is reset.
+    ZSTD_DCtx *dctx;
+    ZSTD_CDict *cdict;      // Dictionary (--dictionary) digested once, NULL - no dictionary.
+    ZSTD_DDict *ddict;
+} zstd_context;
+
+/**
+ * @brief Checks result of zstd function and prints error.
+ * @param ret result of zstd function
+ * @param what name of operation
+ * @return Returns CODEC_SUCCESS if ret is not an error, CODEC_FAILURE otherwise.
+ */
+static int check(size_t ret, const char *what)
+{
+    if (ZSTD_isError(ret)) {
+        printf("zstd %s error: %s.\n", what, ZSTD_getErrorName(ret));
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static void zstd_teardown(void *ctx)
+{
+    zstd_context *context = (zstd_context*)ctx;
+
+    ZSTD_freeCCtx(context->cctx);
+    ZSTD_freeDCtx(context->dctx);
+    ZSTD_freeCDict(context->cdict);
+    ZSTD_freeDDict(context->ddict);
+    work_buffer_free(&context->in);
+    work_buffer_free(&context->out);
+    free(context);
+}
+
+static int zstd_init(void **ctx, int level, const codec_params *params)
+{
+    zstd_context *context = (zstd_context*)calloc(1, sizeof(zstd_context));
+    if (!context) {
+        return CODEC_FAILURE;
+    }
+
+    context->level = level;
+    context->chunk_size = params->chunk_size ? params->chunk_size : CHUNK;
+    context->cctx = ZSTD_createCCtx();
+    context->dctx = ZSTD_createDCtx();
+    if (!context->cctx || !context->dctx) {
+        puts("zstd error: problem with creating contexts.");
+        zstd_teardown(context);
+        return CODEC_FAILURE;
+    }
+
+    // Worker threads (--workers) need libzstd built with multithreading support.
+    if (check(ZSTD_CCtx_setParameter(context->cctx, ZSTD_c_compressionLevel, level), "initialization") != CODEC_SUCCESS ||
+            check(ZSTD_CCtx_setParameter(context->cctx, ZSTD_c_nbWorkers, params->workers), "workers") != CODEC_SUCCESS) {
+        zstd_teardown(context);
+        return CODEC_FAILURE;
+    }
+
+    if (params->dict) {
+        context->cdict = ZSTD_createCDict(params->dict, params->dict_len, level);
+        context->ddict = ZSTD_createDDict(params->dict, params->dict_len);
+        if (!context->cdict || !context->ddict ||
+                check(ZSTD_CCtx_refCDict(context->cctx, context->cdict), "dictionary") != CODEC_SUCCESS ||
+                check(ZSTD_DCtx_refDDict(context->dctx, context->ddict), "dictionary") != CODEC_SUCCESS) {
+            puts("zstd error: problem with loading dictionary.");
+            zstd_teardown(context);
+            return CODEC_FAILURE;
+        }
+    }
+
+    *ctx = context;
+    return CODEC_SUCCESS;
+}
+
+static size_t zstd_compress_bound(size_t source_len)
+{
+    return ZSTD_compressBound(source_len);
+}
+
+static int zstd_compress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                unsigned char *dest, size_t *dest_len)
+{
+    zstd_context *context = (zstd_context*)ctx;
+    size_t ret = ZSTD_compress2(context->cctx, dest, *dest_len, source, source_len);
+
+    if (check(ret, "compression") != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    *dest_len = ret;
+    return CODEC_SUCCESS;
+}
+
+static int zstd_decompress_buffer(void *ctx, const unsigned char *source, size_t source_len,
+                                  unsigned char *dest, size_t *dest_len)
+{
+    zstd_context *context = (zstd_context*)ctx;
+    size_t ret = ZSTD_decompressDCtx(context->dctx, dest, *dest_len, source, source_len);
+
+    if (check(ret, "decompression") != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    *dest_len = ret;
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Gets streaming buffers of context, allocated on first use.
+ * @param context zstd context
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int streaming_buffers(zstd_context *context)
+{
+    if (work_buffer_reserve(&context->in, context->chunk_size, NULL) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, NULL) != 0) {
+        puts("zstd error: problem with allocating memory for buffers.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Compresses source file to archive file, chunk by chunk.
+ * @param ctx codec context
+ * @param source source file
+ * @param arch archive file
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int zstd_compress_file(void *ctx, FILE *source, FILE *arch)
+{
+    zstd_context *context = (zstd_context*)ctx;
+    ZSTD_EndDirective mode;
+    size_t remaining;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS ||
+            check(ZSTD_CCtx_reset(context->cctx, ZSTD_reset_session_only), "compression") != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    do {
+        ZSTD_inBuffer input = { context->in.data, fread(context->in.data, 1, context->chunk_size, source), 0 };
+
+        if (ferror(source)) {
+            puts("zstd compression error: problem with reading input file.");
+            return CODEC_FAILURE;
+        }
+        mode = feof(source) ? ZSTD_e_end : ZSTD_e_continue;
+
+        // Until whole chunk is consumed, or frame is finished on the last one.
+        do {
+            ZSTD_outBuffer output = { context->out.data, context->chunk_size, 0 };
+
+            remaining = ZSTD_compressStream2(context->cctx, &output, &input, mode);
+            if (check(remaining, "compression") != CODEC_SUCCESS) {
+                return CODEC_FAILURE;
+            }
+            if (fwrite(context->out.data, 1, output.pos, arch) != output.pos || ferror(arch)) {
+                puts("zstd compression error: problem with writing to archive file");
+                return CODEC_FAILURE;
+            }
+        } while (mode == ZSTD_e_end ? remaining != 0 : input.pos != input.size);
+    } while (mode != ZSTD_e_end);
+
+    return CODEC_SUCCESS;
+}
+
+/**
+ * @brief Decompresses archive file to output file, chunk by chunk.
+ * @param ctx codec context
+ * @param arch archive file
+ * @param output_file output, decompressed file
+ * @param source_len source (uncompressed) data size, checked against output.
+ * @return Returns CODEC_SUCCESS on success or CODEC_FAILURE if something go wrong.
+ */
+static int zstd_decompress_file(void *ctx, FILE *arch, FILE *output_file, size_t source_len)
+{
+    zstd_context *context = (zstd_context*)ctx;
+    size_t read_len;
+    size_t remaining = 1;   // 0 - frame is complete and flushed.
+    size_t total_len = 0;
+
+    if (streaming_buffers(context) != CODEC_SUCCESS ||
+            check(ZSTD_DCtx_reset(context->dctx, ZSTD_reset_session_only), "decompression") != CODEC_SUCCESS) {
+        return CODEC_FAILURE;
+    }
+
+    while ((read_len = fread(context->in.data, 1, context->chunk_size, arch)) != 0) {
+        ZSTD_inBuffer input = { context->in.data, read_len, 0 };
+
+        ZSTD_outBuffer output;
+
+        // Until whole chunk is consumed and nothing is left in internal buffers (output is not full).
+        do {
+            output.dst = context->out.data;
+            output.size = context->chunk_size;
+            output.pos = 0;
+
+            remaining = ZSTD_decompressStream(context->dctx, &output, &input);
+            if (check(remaining, "decompression") != CODEC_SUCCESS) {
+                return CODEC_FAILURE;
+            }
+            total_len += output.pos;
+            if (fwrite(context->out.data, 1, output.pos, output_file) != output.pos || ferror(output_file)) {
+                puts("zstd decompression error: problem with writing to output file");
+                return CODEC_FAILURE;
+            }
+        } while (input.pos < input.size || output.pos == output.size);
+    }
+
+    if (ferror(arch)) {
+        puts("zstd decompression error: problem with reading archive file.");
+        return CODEC_FAILURE;
+    }
+
+    // Incomplete frame (library still expects input) or frame of other data.
+    if (remaining != 0 || total_len != source_len) {
+        puts("zstd decompression error: archive is truncated.");
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+static int zstd_reserve(void *ctx, arena *a, size_t source_len)
+{
+    zstd_context *context = (zstd_context*)ctx;
+
+    // Work memory of zstd contexts is allocated by the library on first use.
+    if (work_buffer_reserve(&context->in, context->chunk_size, a) != 0 ||
+            work_buffer_reserve(&context->out, context->chunk_size, a) != 0) {
+        return CODEC_FAILURE;
+    }
+
+    return CODEC_SUCCESS;
+}
+
+const codec zstd_codec = {
+    .name = "zstd",
+    .extension = ".zst",
+    .min_level = 1,
+    .max_level = 19,
+    .low_level = 1,
+    .high_level = 19,
+    .dictionary = 1,
+    .multithreaded = 1,
+    .init = zstd_init,
+    .compress_bound = zstd_compress_bound,
+    .compress = zstd_compress_buffer,
+    .decompress = zstd_decompress_buffer,
+    .compress_file = zstd_compress_file,
+    .decompress_file = zstd_decompress_file,
+    .reserve = zstd_reserve,
+    .teardown = zstd_teardown
+};
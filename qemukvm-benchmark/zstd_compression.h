@@ -0,0 +1,12 @@
+// Compression levels: 1 to 19 (20-22 - "ultra" levels are not used).
+// Level 3 is zstd default.
+
+#ifndef ZSTD_COMPRESSION_H
+#define ZSTD_COMPRESSION_H
+
+#include "codec.h"
+
+// zstd backend.
+extern const codec zstd_codec;
+
+#endif // ZSTD_COMPRESSION_H